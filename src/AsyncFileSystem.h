@@ -0,0 +1,648 @@
+#pragma once
+// API assíncrona do sistema de arquivos com corrotinas do C++20 (compilar com -std=c++20)
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <functional>
+#include <condition_variable>
+#include <thread>
+#include <unordered_set>
+#include "FileSystem.h"
+
+template <typename T>
+class Task;
+
+// Parte comum das promessas de Task: a corrotina que espera o resultado e a exceção lançada
+struct TaskPromiseBase
+{
+    coroutine_handle<> continuation; // Retomada quando a tarefa termina
+    exception_ptr error;
+
+    // Ao terminar, a tarefa passa a execução direto para quem a aguardava (transferência simétrica)
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> handle) noexcept
+        {
+            coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        error = current_exception();
+    }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    optional<T> value;
+
+    Task<T> get_return_object();
+
+    void return_value(T result)
+    {
+        value = move(result);
+    }
+
+    T result()
+    {
+        if (error)
+        {
+            rethrow_exception(error);
+        }
+        return move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result()
+    {
+        if (error)
+        {
+            rethrow_exception(error);
+        }
+    }
+};
+
+// Corrotina preguiçosa: começa a executar quando é aguardada com co_await e, ao terminar,
+// retoma quem a aguardava na mesma thread. Tarefas independentes são lançadas com Executor::spawn.
+template <typename T = void>
+class Task
+{
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(coroutine_handle<promise_type> coroutine) : handle(coroutine) {}
+
+    Task(Task &&other) noexcept : handle(exchange(other.handle, nullptr)) {}
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+            {
+                handle.destroy();
+            }
+            handle = exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept
+    {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume()
+    {
+        return handle.promise().result();
+    }
+
+private:
+    coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Executor das corrotinas:
+//  - threads que retomam as corrotinas prontas;
+//  - um reator que envia as leituras do disco pela fila assíncrona (io_uring ou pool de threads) e
+//    retoma cada corrotina quando todas as suas leituras terminam;
+//  - um pool para as operações que podem bloquear (metadados e escritas na cache), para que as threads
+//    do executor nunca esperem o disco.
+// Enquanto o reator espera uma conclusão, leituras novas só são enviadas quando ela chega.
+class Executor
+{
+public:
+    // Leituras do disco de um ReadPlan, pendentes para uma corrotina
+    struct IoOperation
+    {
+        const ReadPlan *plan = nullptr;
+        coroutine_handle<> waiting;
+        u_int32_t remaining = 0; // Leituras ainda em andamento
+        int error = 0;           // errno da primeira leitura que falhou
+    };
+
+private:
+    AsyncIo *io;
+    u_int32_t depth;
+    vector<thread> workers;
+    thread reactor;
+
+    mutex lock;
+    condition_variable readyChanged;
+    condition_variable inboxChanged;
+    condition_variable idle;
+    deque<coroutine_handle<>> ready;
+    vector<IoOperation *> inbox; // Leituras ainda não entregues ao reator
+    uint64_t outstanding = 0;    // Tarefas lançadas com spawn e ainda não terminadas
+    bool stopping = false;
+    IoThreadPool blockingPool; // Declarado por último: suas threads terminam antes da trava ser destruída
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            coroutine_handle<> next;
+            {
+                unique_lock<mutex> guard(lock);
+                readyChanged.wait(guard, [this]() { return stopping || !ready.empty(); });
+                if (ready.empty())
+                {
+                    return;
+                }
+                next = ready.front();
+                ready.pop_front();
+            }
+            next.resume();
+        }
+    }
+
+    /**
+     * @brief Conta uma leitura concluída e retoma a corrotina quando a última termina
+     *
+     */
+    void complete(IoOperation &op, int error)
+    {
+        if (error != 0 && op.error == 0)
+        {
+            op.error = error;
+        }
+        if (--op.remaining == 0)
+        {
+            schedule(op.waiting);
+        }
+    }
+
+    void reactorLoop()
+    {
+        unordered_map<uint64_t, IoOperation *> operations; // pedido da fila -> operação
+        vector<IoOperation *> incoming;
+        unique_ptr<IoQueue> queue(new IoQueue(*io, depth));
+        while (true)
+        {
+            {
+                unique_lock<mutex> guard(lock);
+                if (operations.empty())
+                {
+                    inboxChanged.wait(guard, [this]() { return stopping || !inbox.empty(); });
+                    if (inbox.empty())
+                    {
+                        return;
+                    }
+                }
+                incoming.swap(inbox);
+            }
+
+            try
+            {
+                for (IoOperation *op : incoming)
+                {
+                    for (const ReadPlan::DiskRead &read : op->plan->reads)
+                    {
+                        // Com a fila cheia, read() espera uma conclusão, que é recolhida abaixo
+                        operations[queue->read(read.offset, read.iov, read.iovcnt)] = op;
+                    }
+                }
+                incoming.clear();
+                queue->submit();
+
+                uint64_t tag;
+                int error;
+                bool progressed = false;
+                while (queue->poll(tag, error))
+                {
+                    progressed = true;
+                    auto it = operations.find(tag);
+                    IoOperation *op = it->second;
+                    operations.erase(it);
+                    complete(*op, error);
+                }
+                if (!progressed && queue->pending() > 0)
+                {
+                    tag = queue->wait(error);
+                    auto it = operations.find(tag);
+                    IoOperation *op = it->second;
+                    operations.erase(it);
+                    complete(*op, error);
+                }
+            }
+            catch (const exception &e)
+            {
+                // Falha da própria fila: as leituras pendentes falham e a fila é recriada
+                cerr << "Erro no reator de E/S: " << e.what() << endl;
+                queue.reset();
+                unordered_set<IoOperation *> failed(incoming.begin(), incoming.end());
+                for (auto &item : operations)
+                {
+                    failed.insert(item.second);
+                }
+                incoming.clear();
+                operations.clear();
+                for (IoOperation *op : failed)
+                {
+                    op->remaining = 1;
+                    complete(*op, EIO);
+                }
+                queue.reset(new IoQueue(*io, depth));
+            }
+        }
+    }
+
+    void finished()
+    {
+        lock_guard<mutex> guard(lock);
+        if (--outstanding == 0)
+        {
+            idle.notify_all();
+        }
+    }
+
+public:
+    /**
+     * @brief Construtor do executor
+     *
+     * @param diskIo Motor de E/S do disco (FileSystem::asyncIo); nullptr desativa o reator
+     * @param threads Threads que retomam as corrotinas
+     * @param blockingThreads Threads do pool de operações que podem bloquear
+     * @param ioDepth Leituras do disco em andamento ao mesmo tempo
+     */
+    Executor(AsyncIo *diskIo, u_int32_t threads = 2, u_int32_t blockingThreads = IO_THREADS, u_int32_t ioDepth = IO_RING_ENTRIES)
+        : io(diskIo), depth(ioDepth), blockingPool(blockingThreads)
+    {
+        for (u_int32_t i = 0; i < getMax<u_int32_t>(threads, 1); i++)
+        {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+        if (io != nullptr)
+        {
+            reactor = thread([this]() { reactorLoop(); });
+        }
+    }
+
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+
+    ~Executor()
+    {
+        join();
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        readyChanged.notify_all();
+        inboxChanged.notify_all();
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+        if (reactor.joinable())
+        {
+            reactor.join();
+        }
+    }
+
+    bool hasReactor() const
+    {
+        return io != nullptr;
+    }
+
+    /**
+     * @brief Coloca uma corrotina suspensa na fila de prontas
+     *
+     */
+    void schedule(coroutine_handle<> handle)
+    {
+        // Notificar com a trava: a corrotina retomada pode terminar e o executor ser destruído logo em seguida
+        lock_guard<mutex> guard(lock);
+        ready.push_back(handle);
+        readyChanged.notify_one();
+    }
+
+    /**
+     * @brief Lança uma tarefa independente nas threads do executor
+     *
+     */
+    void spawn(Task<void> task)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            outstanding++;
+        }
+        launch(*this, move(task));
+    }
+
+    /**
+     * @brief Espera todas as tarefas lançadas com spawn terminarem
+     *
+     */
+    void join()
+    {
+        unique_lock<mutex> guard(lock);
+        idle.wait(guard, [this]() { return outstanding == 0; });
+    }
+
+    /**
+     * @brief co_await executor.scheduled(): continua a corrotina em uma thread do executor
+     *
+     */
+    auto scheduled()
+    {
+        struct Awaiter
+        {
+            Executor &executor;
+
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(coroutine_handle<> handle)
+            {
+                executor.schedule(handle);
+            }
+
+            void await_resume() noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    /**
+     * @brief co_await executor.read(plan): envia as leituras do plano ao reator e suspende até todas terminarem
+     *
+     * @param plan Plano preparado com FileSystem::planRead (o executor precisa ter reator)
+     */
+    auto read(const ReadPlan &plan)
+    {
+        struct Awaiter
+        {
+            Executor &executor;
+            IoOperation op;
+
+            bool await_ready() noexcept
+            {
+                return op.plan->reads.empty();
+            }
+
+            void await_suspend(coroutine_handle<> handle)
+            {
+                op.waiting = handle;
+                op.remaining = op.plan->reads.size();
+                // Depois de destravar, a corrotina (e este objeto) pode já ter sido retomada e destruída
+                lock_guard<mutex> guard(executor.lock);
+                executor.inbox.push_back(&op);
+                executor.inboxChanged.notify_one();
+            }
+
+            void await_resume()
+            {
+                if (op.error != 0)
+                {
+                    throw runtime_error("Erro ao ler o disco: " + string(strerror(op.error)));
+                }
+            }
+        };
+        IoOperation op;
+        op.plan = &plan;
+        return Awaiter{*this, op};
+    }
+
+    /**
+     * @brief co_await executor.blocking(fn): executa fn no pool de operações que podem bloquear
+     * e retoma a corrotina em uma thread do executor com o resultado (ou a exceção) de fn
+     *
+     */
+    template <typename F>
+    auto blocking(F fn)
+    {
+        using R = invoke_result_t<F>;
+        struct Awaiter
+        {
+            Executor &executor;
+            F fn;
+            conditional_t<is_void_v<R>, bool, optional<R>> value{};
+            exception_ptr error{};
+
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(coroutine_handle<> handle)
+            {
+                Executor *owner = &executor;
+                executor.blockingPool.post([this, owner, handle]()
+                                           {
+                                               try
+                                               {
+                                                   if constexpr (is_void_v<R>)
+                                                   {
+                                                       fn();
+                                                   }
+                                                   else
+                                                   {
+                                                       value = fn();
+                                                   }
+                                               }
+                                               catch (...)
+                                               {
+                                                   error = current_exception();
+                                               }
+                                               owner->schedule(handle); });
+            }
+
+            R await_resume()
+            {
+                if (error)
+                {
+                    rethrow_exception(error);
+                }
+                if constexpr (!is_void_v<R>)
+                {
+                    return move(*value);
+                }
+            }
+        };
+        return Awaiter{*this, move(fn)};
+    }
+
+private:
+    // Corrotina raiz de uma tarefa lançada com spawn; o quadro se destrói ao terminar
+    struct Detached
+    {
+        struct promise_type
+        {
+            Executor &executor;
+
+            promise_type(Executor &owner, Task<void> &) : executor(owner) {}
+
+            Detached get_return_object()
+            {
+                return {};
+            }
+
+            suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            // O quadro é destruído antes de a tarefa ser dada como terminada (join não retorna antes)
+            struct FinalAwaiter
+            {
+                bool await_ready() noexcept
+                {
+                    return false;
+                }
+
+                void await_suspend(coroutine_handle<promise_type> handle) noexcept
+                {
+                    Executor &executor = handle.promise().executor;
+                    handle.destroy();
+                    executor.finished();
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            FinalAwaiter final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception()
+            {
+                terminate();
+            }
+        };
+    };
+
+    static Detached launch(Executor &executor, Task<void> task)
+    {
+        co_await executor.scheduled();
+        try
+        {
+            co_await task;
+        }
+        catch (const exception &e)
+        {
+            cerr << "Erro em uma tarefa assíncrona: " << e.what() << endl;
+        }
+    }
+};
+
+// Versões co_await das operações de arquivo. As leituras de dados vão para o reator do executor
+// sem ocupar nenhuma thread; as demais operações rodam no pool de operações que podem bloquear.
+// Os argumentos são copiados para a corrotina; os buffers de dados precisam existir até o co_await terminar.
+class AsyncFileSystem
+{
+private:
+    FileSystem &fs;
+    Executor &executor;
+
+public:
+    AsyncFileSystem(FileSystem &fileSystem, Executor &exec) : fs(fileSystem), executor(exec) {}
+
+    Task<void> createFile(string filename, char filetype, string parentDir = "./")
+    {
+        co_await executor.blocking([&]() { fs.createFile(filename, filetype, parentDir); });
+    }
+
+    Task<void> deleteFile(string filename)
+    {
+        co_await executor.blocking([&]() { fs.deleteFile(filename); });
+    }
+
+    Task<u_int32_t> openFile(string filename)
+    {
+        co_return co_await executor.blocking([&]() { return fs.openFile(filename); });
+    }
+
+    Task<void> closeFile(u_int32_t handle)
+    {
+        co_await executor.blocking([&]() { fs.closeFile(handle); });
+    }
+
+    /**
+     * @brief Escreve em um arquivo aberto (na cache de blocos; a alocação e o despejo da cache podem bloquear)
+     *
+     * @return Task<uint32_t> Bytes escritos
+     */
+    Task<uint32_t> writeFile(u_int32_t handle, uint32_t offset, const char *data, uint32_t size)
+    {
+        co_return co_await executor.blocking([&]() { return fs.writeFile(handle, offset, data, size); });
+    }
+
+    /**
+     * @brief Le de um arquivo aberto: os blocos de dados são lidos pelo reator, todos ao mesmo tempo
+     * (sem reator, no modo MMAP, a leitura é uma cópia da imagem mapeada)
+     *
+     * @return Task<uint32_t> Bytes lidos
+     */
+    Task<uint32_t> readFile(u_int32_t handle, uint32_t offset, char *data, uint32_t size)
+    {
+        if (!executor.hasReactor())
+        {
+            co_return fs.readFileAt(handle, offset, data, size);
+        }
+        ReadPlan plan;
+        uint32_t n = fs.planRead(handle, offset, data, size, plan);
+        co_await executor.read(plan);
+        fs.finishRead(plan);
+        co_return n;
+    }
+};
@@ -0,0 +1,852 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <stdexcept>
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+// <linux/fs.h>, incluído pelo io_uring.h, define BLOCK_SIZE (nome do parâmetro de template do sistema de arquivos)
+#undef BLOCK_SIZE
+#undef BLOCK_SIZE_BITS
+
+using namespace std;
+
+#define IO_QUEUE_DEPTH 64 //Profundidade padrão de uma fila de E/S assíncrona (pedidos em andamento)
+#define IO_RING_ENTRIES 256 //Entradas de cada anel do io_uring (limite da profundidade de uma fila)
+#define IO_IDLE_RINGS 16 //Anéis ociosos guardados para reutilização
+#define IO_THREADS 8 //Threads do pool usado quando o io_uring não está disponível
+
+// Motor usado pelas filas de E/S assíncrona
+enum class AsyncEngine
+{
+    IO_URING,   // io_uring (com o pool de threads como alternativa se o kernel não permitir)
+    THREAD_POOL // preadv/pwritev bloqueantes em um pool de threads
+};
+
+/**
+ * @brief Avança um vetor de buffers depois de uma transferência parcial de n bytes
+ *
+ * @param iov Buffers (o primeiro pendente é ajustado no lugar)
+ * @param next Primeiro buffer pendente
+ * @param n Bytes transferidos
+ */
+inline void advanceIov(vector<iovec> &iov, size_t &next, size_t n)
+{
+    while (n > 0)
+    {
+        if (n >= iov[next].iov_len)
+        {
+            n -= iov[next].iov_len;
+            next++;
+        }
+        else
+        {
+            iov[next].iov_base = static_cast<char *>(iov[next].iov_base) + n;
+            iov[next].iov_len -= n;
+            n = 0;
+        }
+    }
+    while (next < iov.size() && iov[next].iov_len == 0)
+    {
+        next++;
+    }
+}
+
+/**
+ * @brief Preenche com zeros os buffers ainda pendentes (leitura além do fim da imagem)
+ *
+ */
+inline void zeroIov(vector<iovec> &iov, size_t next)
+{
+    cerr << "Erro ao ler o bloco: tamanho lido diferente do esperado" << endl;
+    for (; next < iov.size(); next++)
+    {
+        memset(iov[next].iov_base, 0x00, iov[next].iov_len);
+    }
+}
+
+/**
+ * @brief Transfere todos os buffers com preadv/pwritev, repetindo as transferências parciais.
+ * Uma leitura além do fim da imagem completa os buffers com zeros.
+ *
+ * @param fd Descritor do disco
+ * @param write true para escrita
+ * @param iov Buffers
+ * @param iovcnt Número de buffers
+ * @param offset Posição em bytes
+ * @return int 0 ou o errno da falha
+ */
+inline int ioTransfer(int fd, bool write, const iovec *iov, int iovcnt, off_t offset)
+{
+    // Cópia dos vetores: uma transferência parcial avança o primeiro vetor pendente
+    vector<iovec> pending(iov, iov + iovcnt);
+    size_t next = 0;
+    advanceIov(pending, next, 0);
+    while (next < pending.size())
+    {
+        int count = min<size_t>(pending.size() - next, IOV_MAX);
+        ssize_t n = write ? ::pwritev(fd, &pending[next], count, offset) : ::preadv(fd, &pending[next], count, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return errno;
+        }
+        if (n == 0)
+        {
+            if (write)
+            {
+                return EIO;
+            }
+            zeroIov(pending, next);
+            return 0;
+        }
+        offset += n;
+        advanceIov(pending, next, n);
+    }
+    return 0;
+}
+
+// Anel do io_uring criado com as chamadas de sistema diretas. Usado por uma fila de cada vez.
+class IoRing
+{
+private:
+    int ringFd = -1;
+    unsigned entries = 0;
+    void *sqRing = nullptr;
+    void *cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe *cqes;
+    unsigned toSubmit = 0; // Entradas preenchidas e ainda não entregues ao kernel
+
+    IoRing() = default;
+
+public:
+    IoRing(const IoRing &) = delete;
+    IoRing &operator=(const IoRing &) = delete;
+
+    ~IoRing()
+    {
+        if (sqes != nullptr)
+        {
+            ::munmap(sqes, sqesSize);
+        }
+        if (cqRing != nullptr && cqRing != sqRing)
+        {
+            ::munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != nullptr)
+        {
+            ::munmap(sqRing, sqRingSize);
+        }
+        if (ringFd >= 0)
+        {
+            ::close(ringFd);
+        }
+    }
+
+    /**
+     * @brief Cria um anel com numEntries entradas
+     *
+     * @return unique_ptr<IoRing> Anel criado, ou nullptr se o kernel não oferecer io_uring
+     */
+    static unique_ptr<IoRing> create(unsigned numEntries)
+    {
+        unique_ptr<IoRing> ring(new IoRing());
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring->ringFd = (int)::syscall(__NR_io_uring_setup, numEntries, &params);
+        if (ring->ringFd < 0)
+        {
+            return nullptr;
+        }
+        ring->entries = params.sq_entries;
+        ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+        {
+            ring->sqRingSize = ring->cqRingSize = max(ring->sqRingSize, ring->cqRingSize);
+        }
+        void *sq = ::mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQ_RING);
+        if (sq == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        ring->sqRing = sq;
+        if (single)
+        {
+            ring->cqRing = sq;
+        }
+        else
+        {
+            void *cq = ::mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_CQ_RING);
+            if (cq == MAP_FAILED)
+            {
+                return nullptr;
+            }
+            ring->cqRing = cq;
+        }
+        ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *entriesPtr = ::mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQES);
+        if (entriesPtr == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        ring->sqes = static_cast<io_uring_sqe *>(entriesPtr);
+
+        char *sqBase = static_cast<char *>(ring->sqRing);
+        char *cqBase = static_cast<char *>(ring->cqRing);
+        ring->sqHead = reinterpret_cast<unsigned *>(sqBase + params.sq_off.head);
+        ring->sqTail = reinterpret_cast<unsigned *>(sqBase + params.sq_off.tail);
+        ring->sqMask = reinterpret_cast<unsigned *>(sqBase + params.sq_off.ring_mask);
+        ring->sqArray = reinterpret_cast<unsigned *>(sqBase + params.sq_off.array);
+        ring->cqHead = reinterpret_cast<unsigned *>(cqBase + params.cq_off.head);
+        ring->cqTail = reinterpret_cast<unsigned *>(cqBase + params.cq_off.tail);
+        ring->cqMask = reinterpret_cast<unsigned *>(cqBase + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe *>(cqBase + params.cq_off.cqes);
+        return ring;
+    }
+
+    unsigned size() const
+    {
+        return entries;
+    }
+
+    /**
+     * @brief Preenche uma entrada de leitura/escrita vetorial (entregue ao kernel no próximo submit)
+     *
+     * @return false se a fila de submissão estiver cheia
+     */
+    bool push(int fd, bool write, const iovec *iov, int iovcnt, off_t offset, uint64_t userData)
+    {
+        unsigned tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= entries)
+        {
+            return false;
+        }
+        unsigned index = tail & *sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe.fd = fd;
+        sqe.addr = (uint64_t)(uintptr_t)iov;
+        sqe.len = iovcnt;
+        sqe.off = offset;
+        sqe.user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        toSubmit++;
+        return true;
+    }
+
+    /**
+     * @brief Entrega as entradas preenchidas ao kernel e, opcionalmente, espera conclusões
+     *
+     * @param waitFor Número mínimo de conclusões a esperar (0 não bloqueia)
+     */
+    void submit(unsigned waitFor)
+    {
+        while (toSubmit > 0 || waitFor > 0)
+        {
+            int n = (int)::syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n < 0)
+            {
+                throw runtime_error("Erro ao submeter E/S ao io_uring: " + string(strerror(errno)));
+            }
+            toSubmit -= min<unsigned>(n, toSubmit);
+            return;
+        }
+    }
+
+    /**
+     * @brief Retira uma conclusão da fila de conclusões, sem bloquear
+     *
+     * @return true se havia uma conclusão
+     */
+    bool reap(uint64_t &userData, int &result)
+    {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+        const io_uring_cqe &cqe = cqes[head & *cqMask];
+        userData = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+};
+
+// Pool de threads que executa as transferências bloqueantes (alternativa ao io_uring)
+class IoThreadPool
+{
+private:
+    vector<thread> workers;
+    deque<function<void()>> tasks;
+    mutex lock;
+    condition_variable ready;
+    bool stopping = false;
+
+public:
+    explicit IoThreadPool(u_int32_t numThreads)
+    {
+        for (u_int32_t i = 0; i < numThreads; i++)
+        {
+            workers.emplace_back([this]()
+                                 {
+                                     while (true)
+                                     {
+                                         function<void()> task;
+                                         {
+                                             unique_lock<mutex> guard(lock);
+                                             ready.wait(guard, [this]() { return stopping || !tasks.empty(); });
+                                             if (tasks.empty())
+                                             {
+                                                 return;
+                                             }
+                                             task = move(tasks.front());
+                                             tasks.pop_front();
+                                         }
+                                         task();
+                                     } });
+        }
+    }
+
+    IoThreadPool(const IoThreadPool &) = delete;
+    IoThreadPool &operator=(const IoThreadPool &) = delete;
+
+    ~IoThreadPool()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    void post(function<void()> task)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            tasks.push_back(move(task));
+        }
+        ready.notify_one();
+    }
+};
+
+// Motor de E/S assíncrona de um disco: guarda os anéis ociosos e o pool de threads.
+// Pode ser usado por várias threads; cada fila (IoQueue) pertence a um chamador por vez.
+class AsyncIo
+{
+private:
+    int fd;
+    AsyncEngine engine;
+    vector<unique_ptr<IoRing>> idleRings;
+    unique_ptr<IoThreadPool> pool;
+    mutex lock;
+
+public:
+    /**
+     * @brief Construtor do motor
+     *
+     * @param diskFd Descritor do disco (continua pertencendo ao chamador)
+     * @param preferred Motor desejado; sem io_uring no kernel, o pool de threads é usado
+     */
+    AsyncIo(int diskFd, AsyncEngine preferred = AsyncEngine::IO_URING) : fd(diskFd), engine(preferred)
+    {
+        if (engine == AsyncEngine::IO_URING)
+        {
+            unique_ptr<IoRing> ring = IoRing::create(IO_RING_ENTRIES);
+            if (ring == nullptr)
+            {
+                engine = AsyncEngine::THREAD_POOL;
+            }
+            else
+            {
+                idleRings.push_back(move(ring));
+            }
+        }
+    }
+
+    AsyncIo(const AsyncIo &) = delete;
+    AsyncIo &operator=(const AsyncIo &) = delete;
+
+    int diskFd() const
+    {
+        return fd;
+    }
+
+    AsyncEngine activeEngine() const
+    {
+        return engine;
+    }
+
+    /**
+     * @brief Empresta um anel ocioso (ou cria um novo)
+     *
+     * @return unique_ptr<IoRing> Anel, ou nullptr se o motor for o pool de threads ou o kernel recusar um novo anel
+     */
+    unique_ptr<IoRing> acquireRing()
+    {
+        if (engine != AsyncEngine::IO_URING)
+        {
+            return nullptr;
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            if (!idleRings.empty())
+            {
+                unique_ptr<IoRing> ring = move(idleRings.back());
+                idleRings.pop_back();
+                return ring;
+            }
+        }
+        return IoRing::create(IO_RING_ENTRIES);
+    }
+
+    /**
+     * @brief Devolve um anel sem pedidos em andamento
+     *
+     */
+    void releaseRing(unique_ptr<IoRing> ring)
+    {
+        lock_guard<mutex> guard(lock);
+        if (idleRings.size() < IO_IDLE_RINGS)
+        {
+            idleRings.push_back(move(ring));
+        }
+    }
+
+    /**
+     * @brief Pool de threads, iniciado no primeiro uso
+     *
+     */
+    IoThreadPool &threadPool()
+    {
+        lock_guard<mutex> guard(lock);
+        if (pool == nullptr)
+        {
+            pool.reset(new IoThreadPool(IO_THREADS));
+        }
+        return *pool;
+    }
+};
+
+// Fila de E/S assíncrona: os pedidos são enfileirados, entregues juntos ao kernel (submit) e
+// suas conclusões recolhidas sem bloquear (poll) ou esperadas (wait/drain).
+// No máximo depth pedidos ficam em andamento; um novo pedido com a fila cheia espera uma conclusão.
+// Não deve ser usada por duas threads ao mesmo tempo. Os buffers precisam existir até a conclusão.
+class IoQueue
+{
+private:
+    struct Request
+    {
+        bool write = false;
+        off_t offset = 0;
+        vector<iovec> iov;
+        size_t next = 0;  // Primeiro buffer pendente (transferências parciais são reenviadas)
+        uint64_t tag = 0;
+        int error = 0;
+    };
+
+    struct Completion
+    {
+        uint64_t tag;
+        int error;
+        bool write;
+    };
+
+    AsyncIo &io;
+    unique_ptr<IoRing> ring; // nullptr: pool de threads
+    u_int32_t depth;
+    vector<Request> slots;
+    vector<u_int32_t> freeSlots;
+    u_int32_t inFlight = 0;     // Pedidos enviados e ainda não concluídos
+    uint64_t nextTag = 0;
+    deque<Completion> done;     // Concluídos ainda não recolhidos
+
+    // Pool de threads: as conclusões chegam das threads do pool
+    mutex lock;
+    condition_variable finished;
+    deque<u_int32_t> finishedSlots;
+
+    /**
+     * @brief Envia (ou reenvia, depois de uma transferência parcial) o pedido de um quadro
+     *
+     */
+    void issue(u_int32_t slot)
+    {
+        Request &request = slots[slot];
+        if (ring != nullptr)
+        {
+            int count = min<size_t>(request.iov.size() - request.next, IOV_MAX);
+            if (!ring->push(io.diskFd(), request.write, &request.iov[request.next], count, request.offset, slot))
+            {
+                ring->submit(0);
+                ring->push(io.diskFd(), request.write, &request.iov[request.next], count, request.offset, slot);
+            }
+            return;
+        }
+        int fd = io.diskFd();
+        io.threadPool().post([this, slot, fd]()
+                             {
+                                 Request &r = slots[slot];
+                                 r.error = ioTransfer(fd, r.write, r.iov.data(), r.iov.size(), r.offset);
+                                 // Notificar com a trava: logo depois a fila pode esperar a conclusão e ser destruída
+                                 lock_guard<mutex> guard(lock);
+                                 finishedSlots.push_back(slot);
+                                 finished.notify_one(); });
+    }
+
+    /**
+     * @brief Encerra um pedido, liberando o quadro e guardando a conclusão
+     *
+     */
+    void complete(u_int32_t slot)
+    {
+        Request &request = slots[slot];
+        done.push_back({request.tag, request.error, request.write});
+        request.iov.clear();
+        freeSlots.push_back(slot);
+        inFlight--;
+    }
+
+    /**
+     * @brief Trata uma conclusão do io_uring: reenvia o restante de uma transferência parcial
+     *
+     */
+    void onRingCompletion(u_int32_t slot, int result)
+    {
+        Request &request = slots[slot];
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            issue(slot);
+            return;
+        }
+        if (result < 0)
+        {
+            request.error = -result;
+        }
+        else if (result == 0)
+        {
+            if (request.write)
+            {
+                request.error = EIO;
+            }
+            else
+            {
+                zeroIov(request.iov, request.next);
+            }
+        }
+        else
+        {
+            request.offset += result;
+            advanceIov(request.iov, request.next, result);
+            if (request.next < request.iov.size())
+            {
+                issue(slot);
+                return;
+            }
+        }
+        complete(slot);
+    }
+
+    /**
+     * @brief Recolhe as conclusões disponíveis; com block, espera pelo menos uma
+     *
+     */
+    void collect(bool block)
+    {
+        if (ring != nullptr)
+        {
+            size_t before = done.size();
+            ring->submit(0);
+            while (true)
+            {
+                uint64_t userData;
+                int result;
+                while (ring->reap(userData, result))
+                {
+                    onRingCompletion((u_int32_t)userData, result);
+                }
+                if (!block || done.size() > before || inFlight == 0)
+                {
+                    return;
+                }
+                ring->submit(1);
+            }
+        }
+
+        unique_lock<mutex> guard(lock);
+        if (block)
+        {
+            finished.wait(guard, [this]() { return !finishedSlots.empty() || inFlight == 0; });
+        }
+        while (!finishedSlots.empty())
+        {
+            u_int32_t slot = finishedSlots.front();
+            finishedSlots.pop_front();
+            complete(slot);
+        }
+    }
+
+    uint64_t enqueue(bool write, off_t offset, const iovec *iov, int iovcnt)
+    {
+        while (freeSlots.empty())
+        {
+            collect(true);
+        }
+        u_int32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        Request &request = slots[slot];
+        request.write = write;
+        request.offset = offset;
+        request.iov.assign(iov, iov + iovcnt);
+        request.next = 0;
+        advanceIov(request.iov, request.next, 0);
+        request.tag = nextTag++;
+        request.error = 0;
+        inFlight++;
+        if (request.next == request.iov.size())
+        {
+            complete(slot);
+        }
+        else
+        {
+            issue(slot);
+        }
+        return request.tag;
+    }
+
+    static uint64_t check(const Completion &completion)
+    {
+        if (completion.error != 0)
+        {
+            throw runtime_error(string(completion.write ? "Erro ao escrever no disco: " : "Erro ao ler o disco: ") + strerror(completion.error));
+        }
+        return completion.tag;
+    }
+
+public:
+    /**
+     * @brief Construtor da fila
+     *
+     * @param engine Motor do disco
+     * @param maxDepth Pedidos em andamento ao mesmo tempo (limitado a IO_RING_ENTRIES)
+     */
+    IoQueue(AsyncIo &engine, u_int32_t maxDepth = IO_QUEUE_DEPTH) : io(engine), ring(engine.acquireRing())
+    {
+        depth = max<u_int32_t>(1, min<u_int32_t>(maxDepth, ring != nullptr ? ring->size() : IO_RING_ENTRIES));
+        slots.resize(depth);
+        for (u_int32_t i = depth; i > 0; i--)
+        {
+            freeSlots.push_back(i - 1);
+        }
+    }
+
+    IoQueue(const IoQueue &) = delete;
+    IoQueue &operator=(const IoQueue &) = delete;
+
+    ~IoQueue()
+    {
+        // Os buffers dos pedidos pertencem ao chamador: nada pode ficar em andamento
+        try
+        {
+            while (inFlight > 0)
+            {
+                collect(true);
+            }
+        }
+        catch (const exception &e)
+        {
+            cerr << "Erro ao esperar a E/S assíncrona: " << e.what() << endl;
+        }
+        if (ring != nullptr && inFlight == 0)
+        {
+            io.releaseRing(move(ring));
+        }
+    }
+
+    /**
+     * @brief Enfileira a leitura de bytes consecutivos para vários buffers
+     *
+     * @param offset Posição em bytes
+     * @param iov Buffers de destino (o vetor é copiado)
+     * @param iovcnt Número de buffers
+     * @return uint64_t Identificador do pedido
+     */
+    uint64_t read(off_t offset, const iovec *iov, int iovcnt)
+    {
+        return enqueue(false, offset, iov, iovcnt);
+    }
+
+    /**
+     * @brief Enfileira a escrita de vários buffers em bytes consecutivos
+     *
+     * @param offset Posição em bytes
+     * @param iov Buffers de origem (o vetor é copiado)
+     * @param iovcnt Número de buffers
+     * @return uint64_t Identificador do pedido
+     */
+    uint64_t write(off_t offset, const iovec *iov, int iovcnt)
+    {
+        return enqueue(true, offset, iov, iovcnt);
+    }
+
+    /**
+     * @brief Entrega ao kernel os pedidos enfileirados, sem esperar
+     *
+     */
+    void submit()
+    {
+        if (ring != nullptr)
+        {
+            ring->submit(0);
+        }
+    }
+
+    /**
+     * @brief Recolhe um pedido concluído, sem bloquear e sem lançar o erro do pedido
+     *
+     * @param tag Recebe o identificador do pedido
+     * @param error Recebe 0 ou o errno da falha do pedido
+     * @return true se havia um pedido concluído
+     */
+    bool poll(uint64_t &tag, int &error)
+    {
+        if (done.empty())
+        {
+            collect(false);
+        }
+        if (done.empty())
+        {
+            return false;
+        }
+        tag = done.front().tag;
+        error = done.front().error;
+        done.pop_front();
+        return true;
+    }
+
+    /**
+     * @brief Recolhe um pedido concluído, sem bloquear
+     *
+     * @param tag Recebe o identificador do pedido
+     * @return true se havia um pedido concluído
+     */
+    bool poll(uint64_t &tag)
+    {
+        if (done.empty())
+        {
+            collect(false);
+        }
+        if (done.empty())
+        {
+            return false;
+        }
+        Completion completion = done.front();
+        done.pop_front();
+        tag = check(completion);
+        return true;
+    }
+
+    /**
+     * @brief Espera um pedido terminar, sem lançar o erro do pedido
+     *
+     * @param error Recebe 0 ou o errno da falha do pedido
+     * @return uint64_t Identificador do pedido concluído
+     */
+    uint64_t wait(int &error)
+    {
+        while (done.empty())
+        {
+            if (inFlight == 0)
+            {
+                throw runtime_error("Nenhum pedido de E/S em andamento!");
+            }
+            collect(true);
+        }
+        uint64_t tag = done.front().tag;
+        error = done.front().error;
+        done.pop_front();
+        return tag;
+    }
+
+    /**
+     * @brief Espera um pedido terminar
+     *
+     * @return uint64_t Identificador do pedido concluído
+     */
+    uint64_t wait()
+    {
+        while (done.empty())
+        {
+            if (inFlight == 0)
+            {
+                throw runtime_error("Nenhum pedido de E/S em andamento!");
+            }
+            collect(true);
+        }
+        Completion completion = done.front();
+        done.pop_front();
+        return check(completion);
+    }
+
+    /**
+     * @brief Espera todos os pedidos terminarem; o primeiro erro é lançado depois que nada mais está em andamento
+     *
+     */
+    void drain()
+    {
+        while (inFlight > 0)
+        {
+            collect(true);
+        }
+        deque<Completion> completions;
+        completions.swap(done);
+        for (const Completion &completion : completions)
+        {
+            check(completion);
+        }
+    }
+
+    u_int32_t pending() const
+    {
+        return inFlight;
+    }
+
+    bool usesRing() const
+    {
+        return ring != nullptr;
+    }
+};
@@ -0,0 +1,376 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+#define BITMAP_NONE 0xFFFFFFFF //Valor retornado quando não há blocos livres suficientes
+
+/*
+    Mapa de bits dos blocos, armazenado em palavras de 64 bits.
+    O layout em memória é o mesmo do disco (little-endian): o bit i da palavra i / 64
+    corresponde ao bit i % 8 do byte i / 8.
+*/
+class BlockBitmap
+{
+private:
+    vector<uint64_t> words;
+    uint32_t totalBlocks = 0;
+    uint32_t cursor = 0; // Próximo bloco a partir do qual a busca começa (next-fit)
+    uint32_t bitsPerBlock = 1;       // Bits do mapa guardados em cada bloco do disco
+    vector<uint8_t> dirtyFlags;      // Blocos do mapa alterados desde o último descarregamento
+    vector<uint32_t> groupFree;      // Blocos livres em cada grupo (um grupo por bloco do mapa)
+
+    // Cada grupo só altera o próprio byte de dirtyFlags: grupos diferentes podem ser alterados
+    // em paralelo (ver FileSystem::AllocShard)
+    void markDirty(uint32_t block)
+    {
+        dirtyFlags[block / bitsPerBlock] = 1;
+    }
+
+    /**
+     * @brief Procura n blocos livres contíguos no intervalo [from, to).
+     * Percorre o mapa uma palavra por vez, pulando sequências de bits 1 e contando
+     * sequências de bits 0 com ctz.
+     *
+     * @param n Número de blocos contíguos
+     * @param from Primeiro bloco do intervalo
+     * @param to Fim (exclusivo) do intervalo
+     * @return uint32_t Primeiro bloco da sequência ou BITMAP_NONE
+     */
+    uint32_t findRun(uint32_t n, uint32_t from, uint32_t to) const
+    {
+        uint32_t runStart = 0;
+        uint32_t runLength = 0;
+        uint32_t i = from;
+        while (i < to)
+        {
+            uint32_t group = i / bitsPerBlock;
+            if (groupFree[group] == 0)
+            {
+                // Grupo cheio: nenhuma sequência livre passa por ele
+                runLength = 0;
+                i = (uint32_t)min<uint64_t>((uint64_t)(group + 1) * bitsPerBlock, to);
+                continue;
+            }
+
+            uint32_t shift = i & 63;
+            uint64_t word = words[i >> 6] >> shift;
+            uint32_t avail = min<uint32_t>(64 - shift, to - i);
+
+            if (runLength == 0)
+            {
+                // Pular os blocos ocupados (countr_one)
+                uint32_t ones = (~word == 0) ? 64 : (uint32_t)__builtin_ctzll(~word);
+                if (ones >= avail)
+                {
+                    i += avail;
+                    continue;
+                }
+                i += ones;
+                word >>= ones;
+                avail -= ones;
+                runStart = i;
+            }
+
+            // Contar os blocos livres (countr_zero)
+            uint32_t zeros = (word == 0) ? avail : min<uint32_t>((uint32_t)__builtin_ctzll(word), avail);
+            runLength += zeros;
+            i += zeros;
+            if (runLength >= n)
+            {
+                return runStart;
+            }
+            if (zeros < avail)
+            {
+                runLength = 0; // Encontrou um bloco ocupado
+            }
+        }
+        return BITMAP_NONE;
+    }
+
+public:
+    /**
+     * @brief Redimensiona o mapa, marcando todos os blocos como livres.
+     *
+     * @param numBlocks Número de blocos do sistema de arquivos
+     * @param numBytes Tamanho em bytes do mapa no disco (múltiplo de 8)
+     * @param blockBytes Tamanho de um bloco do disco em bytes
+     */
+    void reset(uint32_t numBlocks, uint32_t numBytes, uint32_t blockBytes)
+    {
+        totalBlocks = numBlocks;
+        words.assign(numBytes / sizeof(uint64_t), 0);
+        cursor = 0;
+        bitsPerBlock = blockBytes * 8;
+        dirtyFlags.assign((numBytes + blockBytes - 1) / blockBytes, 0);
+        groupFree.assign(dirtyFlags.size(), 0);
+        for (uint32_t group = 0; group < groupFree.size(); group++)
+        {
+            uint64_t first = (uint64_t)group * bitsPerBlock;
+            groupFree[group] = first < numBlocks ? (uint32_t)min<uint64_t>(bitsPerBlock, numBlocks - first) : 0;
+        }
+    }
+
+    /**
+     * @brief Marca todos os blocos do mapa para serem escritos (usado na formatação).
+     *
+     */
+    void markAllDirty()
+    {
+        for (uint32_t mapBlock = 0; mapBlock < dirtyFlags.size(); mapBlock++)
+        {
+            markDirty(mapBlock * bitsPerBlock);
+        }
+    }
+
+    /**
+     * @brief Número de blocos livres de um grupo (um grupo cobre os blocos descritos por um bloco do mapa).
+     *
+     * @param group Índice do grupo
+     */
+    uint32_t freeInGroup(uint32_t group) const
+    {
+        return groupFree[group];
+    }
+
+    uint32_t numGroups() const
+    {
+        return groupFree.size();
+    }
+
+    uint32_t blocksPerGroup() const
+    {
+        return bitsPerBlock;
+    }
+
+    uint32_t size() const
+    {
+        return totalBlocks;
+    }
+
+    bool test(uint32_t block) const
+    {
+        return (words[block >> 6] >> (block & 63)) & 1;
+    }
+
+    void set(uint32_t block)
+    {
+        if (!test(block))
+        {
+            words[block >> 6] |= (uint64_t)1 << (block & 63);
+            groupFree[block / bitsPerBlock]--;
+            markDirty(block);
+        }
+    }
+
+    void clear(uint32_t block)
+    {
+        if (test(block))
+        {
+            words[block >> 6] &= ~((uint64_t)1 << (block & 63));
+            groupFree[block / bitsPerBlock]++;
+            markDirty(block);
+        }
+    }
+
+    /**
+     * @brief Marca como ocupados os blocos [start, start + n), uma palavra por vez.
+     *
+     * @param start Primeiro bloco
+     * @param n Número de blocos
+     */
+    void setRange(uint32_t start, uint32_t n)
+    {
+        uint32_t i = start;
+        uint32_t end = start + n;
+        while (i < end)
+        {
+            uint32_t shift = i & 63;
+            uint32_t count = min<uint32_t>(64 - shift, end - i);
+            uint64_t mask = (count == 64) ? ~(uint64_t)0 : (((uint64_t)1 << count) - 1) << shift;
+            groupFree[i / bitsPerBlock] -= __builtin_popcountll(mask & ~words[i >> 6]);
+            words[i >> 6] |= mask;
+            i += count;
+        }
+        for (uint32_t mapBlock = start / bitsPerBlock; n > 0 && mapBlock <= (end - 1) / bitsPerBlock; mapBlock++)
+        {
+            markDirty(mapBlock * bitsPerBlock);
+        }
+    }
+
+    /**
+     * @brief Conta quantos blocos livres consecutivos existem a partir de start (até max).
+     *
+     * @param start Primeiro bloco (deve estar livre)
+     * @param max Limite da contagem
+     * @return uint32_t Tamanho da sequência livre
+     */
+    uint32_t freeRunLength(uint32_t start, uint32_t max) const
+    {
+        uint32_t i = start;
+        uint32_t end = (uint32_t)min<uint64_t>((uint64_t)start + max, totalBlocks);
+        while (i < end)
+        {
+            uint32_t shift = i & 63;
+            uint64_t word = words[i >> 6] >> shift;
+            uint32_t avail = min<uint32_t>(64 - shift, end - i);
+            uint32_t zeros = (word == 0) ? avail : min<uint32_t>((uint32_t)__builtin_ctzll(word), avail);
+            i += zeros;
+            if (zeros < avail)
+            {
+                break;
+            }
+        }
+        return i - start;
+    }
+
+    /**
+     * @brief Procura n blocos livres contíguos no intervalo [from, to) a partir de start (next-fit),
+     * voltando ao início do intervalo se necessário. Não altera o mapa.
+     *
+     * @param n Número de blocos contíguos
+     * @param from Primeiro bloco do intervalo
+     * @param to Fim (exclusivo) do intervalo
+     * @param start Bloco a partir do qual a busca começa
+     * @return uint32_t Primeiro bloco da sequência ou BITMAP_NONE
+     */
+    uint32_t findFreeExtentIn(uint32_t n, uint32_t from, uint32_t to, uint32_t start) const
+    {
+        if (n == 0 || to <= from || n > to - from)
+        {
+            return BITMAP_NONE;
+        }
+        if (start < from || start >= to)
+        {
+            start = from;
+        }
+        uint32_t found = findRun(n, start, to);
+        if (found == BITMAP_NONE && start > from)
+        {
+            found = findRun(n, from, min<uint32_t>(start + n - 1, to));
+        }
+        return found;
+    }
+
+    uint32_t findFreeExtent(uint32_t n) const
+    {
+        return findFreeExtentIn(n, 0, totalBlocks, cursor);
+    }
+
+    /**
+     * @brief Aloca n blocos livres contíguos em [from, to) e avança o cursor informado.
+     *
+     * @param n Número de blocos contíguos
+     * @param from Primeiro bloco do intervalo
+     * @param to Fim (exclusivo) do intervalo
+     * @param rangeCursor Cursor next-fit do intervalo
+     * @return uint32_t Primeiro bloco alocado ou BITMAP_NONE
+     */
+    uint32_t allocExtentIn(uint32_t n, uint32_t from, uint32_t to, uint32_t &rangeCursor)
+    {
+        uint32_t found = findFreeExtentIn(n, from, to, rangeCursor);
+        if (found != BITMAP_NONE)
+        {
+            setRange(found, n);
+            rangeCursor = found + n;
+        }
+        return found;
+    }
+
+    uint32_t allocExtent(uint32_t n)
+    {
+        return allocExtentIn(n, 0, totalBlocks, cursor);
+    }
+
+    /**
+     * @brief Aloca a primeira sequência livre de [from, to) a partir do cursor informado, com até maxLength blocos.
+     *
+     * @param maxLength Tamanho máximo da sequência
+     * @param from Primeiro bloco do intervalo
+     * @param to Fim (exclusivo) do intervalo
+     * @param rangeCursor Cursor next-fit do intervalo
+     * @param length Tamanho da sequência alocada
+     * @return uint32_t Primeiro bloco alocado ou BITMAP_NONE
+     */
+    uint32_t allocRunIn(uint32_t maxLength, uint32_t from, uint32_t to, uint32_t &rangeCursor, uint32_t &length)
+    {
+        length = 0;
+        uint32_t found = findFreeExtentIn(1, from, to, rangeCursor);
+        if (found != BITMAP_NONE)
+        {
+            length = freeRunLength(found, min<uint32_t>(maxLength, to - found));
+            setRange(found, length);
+            rangeCursor = found + length;
+        }
+        return found;
+    }
+
+    uint32_t allocRun(uint32_t maxLength, uint32_t &length)
+    {
+        return allocRunIn(maxLength, 0, totalBlocks, cursor, length);
+    }
+
+    /**
+     * @brief Recalcula os blocos livres de cada grupo a partir das palavras do mapa
+     * (usado após carregar o mapa do disco). Bits além do último bloco são ignorados.
+     *
+     * @return uint32_t Total de blocos livres
+     */
+    uint32_t recount()
+    {
+        uint32_t total = 0;
+        for (uint32_t group = 0; group < groupFree.size(); group++)
+        {
+            uint64_t first = (uint64_t)group * bitsPerBlock;
+            uint64_t last = min<uint64_t>(first + bitsPerBlock, totalBlocks);
+            uint32_t used = 0;
+            for (uint64_t i = first; i < last; i += 64)
+            {
+                uint64_t word = words[i >> 6];
+                if (last - i < 64)
+                {
+                    word &= ((uint64_t)1 << (last - i)) - 1;
+                }
+                used += __builtin_popcountll(word);
+            }
+            groupFree[group] = last > first ? (uint32_t)(last - first) - used : 0;
+            total += groupFree[group];
+        }
+        cursor = 0;
+        fill(dirtyFlags.begin(), dirtyFlags.end(), 0);
+        return total;
+    }
+
+    char *data()
+    {
+        return reinterpret_cast<char *>(words.data());
+    }
+
+    /**
+     * @brief Retorna os blocos do mapa alterados entre os grupos [firstGroup, endGroup) e os marca como limpos.
+     *
+     * @param firstGroup Primeiro grupo (bloco do mapa)
+     * @param endGroup Fim (exclusivo) do intervalo de grupos
+     * @return vector<uint32_t> Índices (relativos ao início do mapa) dos blocos alterados, em ordem crescente
+     */
+    vector<uint32_t> takeDirtyBlocks(uint32_t firstGroup, uint32_t endGroup)
+    {
+        vector<uint32_t> blocks;
+        for (uint32_t mapBlock = firstGroup; mapBlock < endGroup; mapBlock++)
+        {
+            if (dirtyFlags[mapBlock])
+            {
+                dirtyFlags[mapBlock] = 0;
+                blocks.push_back(mapBlock);
+            }
+        }
+        return blocks;
+    }
+
+    vector<uint32_t> takeDirtyBlocks()
+    {
+        return takeDirtyBlocks(0, dirtyFlags.size());
+    }
+};
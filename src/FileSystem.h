@@ -4,7 +4,60 @@
 #include <cstring>
 #include <cmath>
 #include <cstdint>
+#include <cerrno>
+#include <type_traits>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <algorithm>
+#include <utility>
+#include <memory>
+#include <climits>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <condition_variable>
+#include <random>
+#include <thread>
+#include <exception>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "estruturas.h"
+#include "BlockBitmap.h"
+#include "AsyncIo.h"
+
+#define CACHE_CAPACITY 1024 //Número padrão de blocos mantidos na cache
+#define DENTRY_CACHE_CAPACITY 65536 //Número máximo de caminhos guardados na cache de dentries
+#define READAHEAD_MIN_BYTES 4096 //Janela inicial da leitura antecipada em bytes
+#define READAHEAD_MAX_BYTES (1 << 20) //Janela máxima da leitura antecipada em bytes
+#define ALLOC_SHARDS 16 //Número máximo de partições do alocador (cada uma com sua própria trava)
+#define ALLOC_CACHE_BLOCKS 256 //Blocos reservados de uma vez para o cache de alocação de cada thread
+#define JOURNAL_AUTO 0xFFFFFFFF //Tamanho do diário escolhido na formatação (1/32 do disco, até JOURNAL_MAX_BYTES)
+#define JOURNAL_MIN_BLOCKS 32 //Menor diário de metadados (discos pequenos demais ficam sem diário)
+#define JOURNAL_MAX_BYTES (32 << 20) //Maior diário criado automaticamente
+#define DIR_HASH_THRESHOLD 128 //Entradas a partir das quais um subdiretório passa a usar o índice por hash (versão 4)
+#define DIR_HASH_MAX_DEPTH 8 //Níveis máximos de nós no índice por hash de um diretório
+#define FSCK_MAX_MESSAGES 100 //Problemas descritos no relatório do fsck (os demais só são contados)
+#define FSCK_MIN_ITEMS 64 //Blocos de um nível do percurso por thread do fsck (níveis menores usam menos threads)
+
+// Forma de acesso à imagem do disco
+enum class DiskBackend
+{
+    PREAD, // pread/pwrite com descritor persistente e cache de blocos
+    MMAP   // Imagem inteira mapeada em memória (msync como ponto de durabilidade)
+};
+
+// Como a imagem é criada na formatação
+enum class ImageAllocation
+{
+    SPARSE,      // ftruncate: os blocos só ocupam espaço quando escritos
+    PREALLOCATE, // fallocate: reserva todos os blocos no armazenamento
+    ZERO         // fallocate com FALLOC_FL_ZERO_RANGE: reserva e zera os blocos (também em dispositivos)
+};
 
 // Criar a função min
 template <typename T>
@@ -13,12 +66,198 @@ T getMin(T a, T b)
     return a < b ? a : b;
 }
 
+template <typename T>
+T getMax(T a, T b)
+{
+    return a > b ? a : b;
+}
+
+static const char zeroBuffer[4 * MAX_BLOCK_SIZE] = {}; // Fonte de zeros para preencher lacunas em arquivos
+
+// Leitura de bytes de um arquivo decomposta em leituras vetoriais do disco (ver FileSystem::planRead).
+// Os buffers apontam para o destino do chamador e para scratch, que guarda o primeiro e o último bloco parciais.
+struct ReadPlan
+{
+    struct DiskRead
+    {
+        off_t offset; // Posição em bytes (início de um bloco)
+        iovec iov[3]; // Buffers de destino, cada um com um número inteiro de blocos
+        int iovcnt;
+    };
+
+    struct PartialCopy
+    {
+        char *dst;
+        const char *src;
+        size_t length;
+    };
+
+    vector<DiskRead> reads;
+    vector<PartialCopy> copies; // Feitas por finishRead depois que todas as leituras terminam
+    vector<char> scratch;
+    uint32_t size = 0;          // Bytes devolvidos pela leitura
+};
+
+// Contadores do diário de metadados
+struct JournalStats
+{
+    uint64_t commits = 0;       // Transações escritas (um fdatasync cada)
+    uint64_t blocks = 0;        // Cópias de blocos de metadados escritas no diário
+    uint64_t groupedSyncs = 0;  // Chamadas a sync atendidas pelo commit de outra thread
+    uint64_t overflows = 0;     // Metadados escritos no lugar sem passar pelo diário (cache ou diário pequenos demais)
+    uint64_t replayed = 0;      // Transações reaplicadas na montagem
+    uint64_t checkpoints = 0;   // Checkpoints (cópias do diário escritas no lugar para liberar espaço)
+};
+
+// Resultado da verificação de consistência (fsck)
+struct FsckReport
+{
+    uint64_t directories = 0;      // Diretórios percorridos (incluindo o raiz)
+    uint64_t files = 0;            // Arquivos percorridos
+    uint64_t reachableBlocks = 0;  // Blocos alcançáveis a partir do diretório raiz (incluindo a área reservada)
+    uint64_t leakedBlocks = 0;     // Ocupados no bitmap sem nenhuma referência (ex.: caches de alocação de uma montagem que caiu)
+    uint64_t unmarkedBlocks = 0;   // Em uso, mas livres no bitmap (seriam alocados de novo)
+    uint64_t doubleAllocated = 0;  // Referências a blocos que já pertencem a outro arquivo ou diretório
+    uint64_t invalidPointers = 0;  // Ponteiros para fora do disco ou para a área reservada
+    uint64_t invalidEntries = 0;   // Entradas de diretório com nome, tipo ou bloco de índice inválido
+    uint64_t sizeMismatches = 0;   // Arquivos maiores que os blocos de dados que possuem
+    uint32_t freeBlocksRecorded = 0; // free_blocks do superbloco antes da verificação
+    uint32_t freeBlocksActual = 0;   // Blocos livres no bitmap ao fim da verificação
+    uint32_t passes = 0;           // Percursos feitos (uma correção pode deixar blocos sem referência para o seguinte)
+    bool repaired = false;         // Alguma correção foi escrita
+    bool clean = false;            // O último percurso não encontrou nenhum problema
+    vector<string> messages;       // Os primeiros FSCK_MAX_MESSAGES problemas encontrados
+};
+
+// Interface do sistema de arquivos. O tamanho do bloco é escolhido na formatação e cada tamanho
+// suportado tem sua própria implementação (SizedFileSystem), com BLOCK_SIZE constante em tempo de compilação.
 class FileSystem
 {
+public:
+    virtual ~FileSystem() = default;
+
+    static unique_ptr<FileSystem> mkfs(string &path, u_int32_t numBlocks, u_int32_t blockSize = DEFAULT_BLOCK_SIZE,
+                                       DiskBackend backend = DiskBackend::PREAD, u_int32_t cacheBlocks = CACHE_CAPACITY,
+                                       ImageAllocation allocation = ImageAllocation::SPARSE, u_int32_t journalBlocks = JOURNAL_AUTO);
+    static unique_ptr<FileSystem> mount(string &path, DiskBackend backend = DiskBackend::PREAD, u_int32_t cacheBlocks = CACHE_CAPACITY);
+
+    /**
+     * @brief Valida a identificação, a versão e o checksum de um superbloco lido do disco
+     * 
+     * @param sb Superbloco
+     */
+    static void checkSuperblock(const Superblock &sb)
+    {
+        if (sb.magic != FS_MAGIC)
+        {
+            throw runtime_error("O disco não contém um sistema de arquivos válido!");
+        }
+        if (sb.version < FS_MIN_VERSION || sb.version > FS_VERSION)
+        {
+            throw runtime_error("Versão do sistema de arquivos não suportada: " + to_string(sb.version));
+        }
+        if (sb.checksum != superblockChecksum(sb))
+        {
+            throw runtime_error("Checksum do superbloco inválido!");
+        }
+        if (decodeBlockSize(sb.block_size) == 0)
+        {
+            throw runtime_error("Tamanho de bloco inválido no superbloco!");
+        }
+    }
+
+    /**
+     * @brief Converte o campo block_size do superbloco (log2(tamanho) - log2(512)) em bytes
+     * 
+     * @return u_int32_t Tamanho do bloco em bytes, ou 0 se o campo for inválido
+     */
+    static u_int32_t decodeBlockSize(uint32_t field)
+    {
+        return field <= 7 ? (u_int32_t)MIN_BLOCK_SIZE << field : 0;
+    }
+
+    virtual u_int32_t blockSize() const = 0;
+
+    virtual void sync() = 0;
+    virtual u_int32_t allocBlock() = 0;
+    virtual u_int32_t allocExtent(u_int32_t n) = 0;
+    virtual bool allocBlocks(u_int32_t count, vector<u_int32_t> &out) = 0;
+    virtual void freeBlocks(const vector<u_int32_t> &blocks) = 0;
+    virtual void freeBlock(u_int32_t blockIndex) = 0;
+
+    virtual void createFile(string &filename, char filetype, const string &parentDir = "./") = 0;
+    virtual void readFile(string &filename, char *filetype, u_int32_t *index_block) = 0;
+    virtual u_int32_t getFileBlockIndex(string &filename) = 0;
+    virtual u_int32_t getFileDataBlockIndex(u_int32_t index_block, u_int32_t block_offset) = 0;
+    virtual void deleteFile(string &filename) = 0;
+    virtual void renameFile(const string &oldPath, const string &newPath) = 0;
+    virtual void searchFile(string &filename) = 0;
+
+    virtual u_int32_t openFile(const string &filename) = 0;
+    virtual uint32_t writeFile(u_int32_t handle, uint32_t offset, const char *data, uint32_t size) = 0;
+    virtual uint32_t readFileAt(u_int32_t handle, uint32_t offset, char *data, uint32_t size) = 0;
+    virtual void closeFile(u_int32_t handle) = 0;
+    virtual void writeFile(const string &filename, const char *data, uint32_t size) = 0;
+    virtual void readFile(uint32_t index_block, uint32_t block_offset, char *data, uint32_t size) = 0;
+    virtual void setReadahead(u_int32_t minBlocks, u_int32_t maxBlocks) = 0;
+    virtual uint32_t planRead(u_int32_t handle, uint32_t offset, char *data, uint32_t size, ReadPlan &plan) = 0;
+    virtual void finishRead(ReadPlan &plan) = 0;
+    virtual AsyncIo *asyncIo() = 0;
+
+    virtual void listFilesRecursively() = 0;
+    virtual void listFreeBlocks() = 0;
+    virtual void listSuperblock() = 0;
+    virtual void listCacheStats() = 0;
+    virtual void listDentryStats() = 0;
+    virtual void listReadaheadStats() = 0;
+    virtual void listJournalStats() = 0;
+    virtual JournalStats journalStats() = 0;
+    virtual FsckReport fsck(u_int32_t threads, bool repair) = 0;
+    virtual void listIndexBlock(uint32_t index_block) = 0;
+    virtual void listDataBlock(uint32_t data_block) = 0;
+    virtual void listBitmap() = 0;
+    virtual void listDisk() = 0;
+    virtual void listDiskHex() = 0;
+
+protected:
+    virtual void formatDisk(u_int32_t numBlocks, ImageAllocation allocation, u_int32_t journalBlocks) = 0;
+    virtual void loadDisk() = 0;
+
+    /**
+     * @brief Identificador único de uma instância (nunca reutilizado, ao contrário do endereço)
+     * 
+     */
+    static uint64_t nextInstanceId()
+    {
+        static atomic<uint64_t> ids{0};
+        return ++ids;
+    }
+
+private:
+    static unique_ptr<FileSystem> instantiate(u_int32_t blockSize, string &path, DiskBackend backend, u_int32_t cacheBlocks);
+};
+
+template <u_int32_t BLOCK_SIZE>
+class SizedFileSystem : public FileSystem
+{
+    static_assert(BLOCK_SIZE >= MIN_BLOCK_SIZE && BLOCK_SIZE <= MAX_BLOCK_SIZE && (BLOCK_SIZE & (BLOCK_SIZE - 1)) == 0,
+                  "Tamanho de bloco não suportado");
+
+    using IndexBlock = IndexBlockLayout<BLOCK_SIZE>;
+    static constexpr u_int32_t INDEX_PTRS = IndexBlock::PTRS;
+    static constexpr u_int32_t TREE_DIRECT = IndexBlock::TREE_DIRECT;
+    static constexpr u_int32_t TREE_FANOUT = IndexBlock::WORDS;
+    static constexpr u_int32_t EXTENTS = IndexBlock::EXTENTS;
+    static constexpr u_int32_t EXTENT_NEXT = IndexBlock::EXTENT_NEXT;
+    static constexpr u_int32_t INLINE_BYTES = IndexBlock::INLINE_BYTES;
+    static constexpr u_int32_t HASH_PAIRS = IndexBlock::HASH_PAIRS;
+    static_assert(sizeof(IndexBlock) == BLOCK_SIZE && is_trivially_copyable<IndexBlock>::value,
+                  "Bloco de índice deve ocupar exatamente um bloco");
+
 private:
     fstream disk;
     Superblock superblock;
-    vector<uint8_t> bitmap;
+    BlockBitmap bitmap;
     vector<RootDirEntry> rootDir;
     string diskPath;
 
@@ -30,270 +269,5560 @@ private:
      */
     u_int32_t calcNumBlocksBitmap(u_int32_t numBlocks)
     {
-        return (numBlocks + BLOCK_SIZE * 8 - 1) / (BLOCK_SIZE * 8);
+        return ((uint64_t)numBlocks + BLOCK_SIZE * 8 - 1) / (BLOCK_SIZE * 8);
+    }
+
+    /**
+     * @brief Testa um bit do bitmap lendo diretamente o bloco do bitmap correspondente
+     * 
+     * @param blockIndex Bloco cujo bit será testado
+     * @return true se o bloco estiver ocupado no disco
+     */
+    bool diskBitmapTest(u_int32_t blockIndex)
+    {
+        auto mapBlock = cache.pin(superblock.bitmap_start + blockIndex / (BLOCK_SIZE * 8));
+        u_int32_t bit = blockIndex % (BLOCK_SIZE * 8);
+        return reinterpret_cast<const uint8_t *>(mapBlock.data())[bit / 8] & (1 << (bit % 8));
     }
 
     // Gerenciador de disco
     class DiskManager
     {
     private:
-        bool openFlag = false;
+        int fd = -1; // Descritor do disco, aberto uma única vez
         string diskPath;
+        DiskBackend backend = DiskBackend::PREAD;
+        char *map = nullptr; // Imagem mapeada em memória (apenas no modo MMAP)
+        uint64_t mapSize = 0;
+        AsyncEngine asyncEngine = AsyncEngine::IO_URING;
+        unique_ptr<AsyncIo> asyncIo; // Motor das filas assíncronas, criado no primeiro uso
+        mutex asyncLock;
 
-    public:
-        fstream disk;
+        /**
+         * @brief Mapeia a imagem inteira em memória (modo MMAP).
+         * 
+         */
+        void mapDisk()
+        {
+            if (map != nullptr)
+            {
+                ::munmap(map, mapSize);
+                map = nullptr;
+                mapSize = 0;
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+            {
+                throw runtime_error("Erro ao obter o tamanho do disco: " + string(strerror(errno)));
+            }
+            if (st.st_size == 0)
+            {
+                return;
+            }
+            void *ptr = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (ptr == MAP_FAILED)
+            {
+                throw runtime_error("Erro ao mapear o disco em memória: " + string(strerror(errno)));
+            }
+            map = static_cast<char *>(ptr);
+            mapSize = st.st_size;
+        }
+
+        /**
+         * @brief Retorna o endereço do bloco na imagem mapeada, validando os limites.
+         * 
+         * @param blockIndex indice do bloco
+         */
+        char *mappedBlock(u_int32_t blockIndex)
+        {
+            uint64_t offset = (uint64_t)blockIndex * BLOCK_SIZE;
+            if (offset + BLOCK_SIZE > mapSize)
+            {
+                throw runtime_error("Bloco fora da imagem mapeada!");
+            }
+            return map + offset;
+        }
+
+        /**
+         * @brief Abre o disco caso ainda não esteja aberto.
+         * 
+         * @param flags Flags adicionais de abertura (ex: O_CREAT).
+         */
+        void openDisk(int flags = 0)
+        {
+            if (fd >= 0)
+            {
+                return;
+            }
+            fd = ::open(diskPath.c_str(), O_RDWR | flags, 0644);
+            if (fd < 0)
+            {
+                throw runtime_error("Erro ao abrir o disco: " + string(strerror(errno)));
+            }
+            if (backend == DiskBackend::MMAP)
+            {
+                mapDisk();
+            }
+        }
 
+    public:
         DiskManager() = default; // Construtor padrão
 
         /**
          * @brief Construtor do gerenciador de disco.
          * 
          * @param path Caminho do disco.
+         * @param diskBackend Forma de acesso ao disco (pread/pwrite ou mmap).
          */
-        DiskManager(string &path)
+        DiskManager(string &path, DiskBackend diskBackend = DiskBackend::PREAD)
         {
             diskPath = path;
+            backend = diskBackend;
+        }
+
+        DiskManager(const DiskManager &) = delete;
+        DiskManager &operator=(const DiskManager &) = delete;
+
+        ~DiskManager()
+        {
+            asyncIo.reset();
+            if (map != nullptr)
+            {
+                ::msync(map, mapSize, MS_SYNC);
+                ::munmap(map, mapSize);
+            }
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
         }
 
         /**
-         * @brief Cria o disco.
+         * @brief Cria o disco com o tamanho exato, descartando o conteúdo anterior.
+         * Em arquivos comuns a imagem é truncada (esparsa); dispositivos mantêm o tamanho.
          * 
          * @param size Tamanho do disco.
+         * @param allocation Forma de alocação da imagem (esparsa, pré-alocada ou zerada)
          */
-        void create(u_int32_t size)
+        void create(uint64_t size, ImageAllocation allocation = ImageAllocation::SPARSE)
         {
-            disk.open(diskPath, ios::in | ios::out | ios::binary);
-            if (!disk.is_open())
+            openDisk(O_CREAT);
+            if (map != nullptr)
+            {
+                ::munmap(map, mapSize);
+                map = nullptr;
+                mapSize = 0;
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+            {
+                throw runtime_error("Erro ao obter o tamanho do disco: " + string(strerror(errno)));
+            }
+            if (S_ISREG(st.st_mode))
+            {
+                // Truncar para 0 libera os blocos antigos; a imagem volta a ser um arquivo esparso e zerado
+                if ((allocation != ImageAllocation::ZERO && ::ftruncate(fd, 0) != 0) || ::ftruncate(fd, (off_t)size) != 0)
+                {
+                    throw runtime_error("Erro ao criar o disco: " + string(strerror(errno)));
+                }
+            }
+            if (allocation == ImageAllocation::PREALLOCATE && ::fallocate(fd, 0, 0, (off_t)size) != 0)
+            {
+                cerr << "Aviso: fallocate não suportado, a imagem ficará esparsa (" << strerror(errno) << ")" << endl;
+            }
+            if (allocation == ImageAllocation::ZERO && ::fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, (off_t)size) != 0)
             {
-                throw runtime_error("Erro ao criar o disco");
+                throw runtime_error("Erro ao zerar o disco: " + string(strerror(errno)));
             }
-            disk.seekp(size - 1);
-            if (!disk)
+            if (backend == DiskBackend::MMAP)
             {
-                throw runtime_error("Erro ao posicionar o ponteiro de escrita ao criar o disco");
+                mapDisk();
             }
-            disk.write("", 1);
-            if (!disk)
+        }
+
+        /**
+         * @brief Tamanho atual da imagem em bytes
+         * 
+         */
+        uint64_t size()
+        {
+            openDisk();
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
             {
-                throw runtime_error("Erro ao escrever no disco ao criar o disco");
+                throw runtime_error("Erro ao obter o tamanho do disco: " + string(strerror(errno)));
             }
-            disk.close();
+            return st.st_size;
+        }
+
+        /**
+         * @brief Retorna o endereço do bloco na imagem mapeada (acesso sem cópia).
+         * 
+         * @param blockIndex indice do bloco
+         * @return char* Ponteiro para o bloco, ou nullptr se o disco não estiver mapeado
+         */
+        char *blockPtr(u_int32_t blockIndex)
+        {
+            openDisk();
+            return map != nullptr ? mappedBlock(blockIndex) : nullptr;
         }
 
         /**
-         * @brief Le um bloco do disco
+         * @brief Le um bloco do disco diretamente no buffer do chamador
          * 
          * @param blockIndex indice do bloco a ser lido
-         * @param data 
+         * @param data Buffer de destino com pelo menos BLOCK_SIZE bytes
          */
         void readBlock(u_int32_t blockIndex, char *data)
         {
+            readBlocks(blockIndex, 1, data);
+        }
 
-            //Exibir os dados do bloco
-            // Inicializar o buffer com zeros
-            char buffer[BLOCK_SIZE];
-            memset(buffer, 0x00, BLOCK_SIZE);
-            disk.open(diskPath, ios::in | ios::out | ios::binary);
-            if (disk.is_open())
-            {
-                disk.seekg(blockIndex * BLOCK_SIZE);
-                //cout << "Lendo bloco: 0x" << blockIndex * BLOCK_SIZE << endl;
-                disk.read(buffer, BLOCK_SIZE);
-                //cout << endl;
-                //Passar para a variavel data
-                data = new char[BLOCK_SIZE];
-                memcpy(data, buffer, BLOCK_SIZE);
-
-                // cout << "Data lida: ";
-                // for (int i = 0; i < BLOCK_SIZE; ++i)
-                // {
-                //     cout << hex << (int)data[i] << " ";
-                // }
+        /**
+         * @brief Le blocos consecutivos do disco com uma única operação
+         * 
+         * @param blockIndex Primeiro bloco a ser lido
+         * @param count Número de blocos
+         * @param data Buffer de destino com pelo menos count * BLOCK_SIZE bytes
+         */
+        void readBlocks(u_int32_t blockIndex, u_int32_t count, char *data)
+        {
+            iovec iov = {data, (size_t)count * BLOCK_SIZE};
+            readBlocksv(blockIndex, &iov, 1);
+        }
 
-                if (disk.gcount() != BLOCK_SIZE)
+        /**
+         * @brief Le blocos consecutivos do disco para vários buffers com preadv
+         * Os buffers são preenchidos em ordem, a partir do início de blockIndex.
+         * 
+         * @param blockIndex Primeiro bloco a ser lido
+         * @param iov Buffers de destino
+         * @param iovcnt Número de buffers
+         */
+        void readBlocksv(u_int32_t blockIndex, const iovec *iov, int iovcnt)
+        {
+            openDisk();
+            off_t offset = (off_t)blockIndex * BLOCK_SIZE;
+            if (map != nullptr)
+            {
+                for (int i = 0; i < iovcnt; i++)
                 {
-                    cerr << "Erro ao ler o bloco: tamanho lido diferente do esperado" << endl;
+                    if ((uint64_t)offset + iov[i].iov_len > mapSize)
+                    {
+                        throw runtime_error("Bloco fora da imagem mapeada!");
+                    }
+                    memcpy(iov[i].iov_base, map + offset, iov[i].iov_len);
+                    offset += iov[i].iov_len;
                 }
-                
-                disk.close();
                 return;
             }
-            throw runtime_error("Erro ao abrir e ler o disco!");
+
+            // Fim do arquivo: o restante dos blocos é considerado zerado
+            int error = ioTransfer(fd, false, iov, iovcnt, offset);
+            if (error != 0)
+            {
+                throw runtime_error("Erro ao ler o disco: " + string(strerror(error)));
+            }
         }
 
         /**
          * @brief Escreve um bloco no disco
          * 
          * @param blockIndex indice do bloco a ser escrito
-         * @param data 
+         * @param data Buffer de origem com pelo menos BLOCK_SIZE bytes
          */
-        void writeBlock(u_int32_t blockIndex, char *data)
+        void writeBlock(u_int32_t blockIndex, const char *data)
         {
-            // Inicializar o buffer com zeros
-            char buffer[BLOCK_SIZE];
-            memset(buffer, 0x00, BLOCK_SIZE);
-
-            // Copiar os dados para o buffer
-            memcpy(buffer, data, BLOCK_SIZE);
-
+            writeBlocks(blockIndex, 1, data);
+        }
 
+        /**
+         * @brief Escreve blocos consecutivos do disco com uma única operação
+         * 
+         * @param blockIndex Primeiro bloco a ser escrito
+         * @param count Número de blocos
+         * @param data Buffer de origem com pelo menos count * BLOCK_SIZE bytes
+         */
+        void writeBlocks(u_int32_t blockIndex, u_int32_t count, const char *data)
+        {
+            iovec iov = {const_cast<char *>(data), (size_t)count * BLOCK_SIZE};
+            writeBlocksv(blockIndex, &iov, 1);
+        }
 
-            disk.open(diskPath, ios::in | ios::out | ios::binary);
-            if (disk.is_open())
+        /**
+         * @brief Escreve vários buffers em blocos consecutivos do disco com pwritev
+         * Os buffers são escritos em ordem, a partir do início de blockIndex.
+         * 
+         * @param blockIndex Primeiro bloco a ser escrito
+         * @param iov Buffers de origem
+         * @param iovcnt Número de buffers
+         */
+        void writeBlocksv(u_int32_t blockIndex, const iovec *iov, int iovcnt)
+        {
+            openDisk();
+            off_t offset = (off_t)blockIndex * BLOCK_SIZE;
+            if (map != nullptr)
             {
-                //cout << "Escrevendo bloco: 0x" << blockIndex * BLOCK_SIZE << endl;
-                // cout << "Data a ser escrita: ";
-                // for (int i = 0; i < BLOCK_SIZE; ++i)
-                // {
-                //     cout << hex << (int)buffer[i] << " ";
-                // }
-                // cout << endl;
-
-                disk.seekp(blockIndex * BLOCK_SIZE);
-                disk.write(buffer, BLOCK_SIZE);
-                if (!disk)
+                for (int i = 0; i < iovcnt; i++)
                 {
-                    cerr << "Erro ao escrever no bloco" << endl;
+                    if ((uint64_t)offset + iov[i].iov_len > mapSize)
+                    {
+                        throw runtime_error("Bloco fora da imagem mapeada!");
+                    }
+                    memcpy(map + offset, iov[i].iov_base, iov[i].iov_len);
+                    offset += iov[i].iov_len;
                 }
-                disk.close();
                 return;
             }
-            throw runtime_error("Erro ao abrir e escrever no disco");
-        }
-    };
 
-    DiskManager diskManager;
-
-    /**
-     * @brief Lista os arquivos em um diretório
-     * 
-     * @param dirIndexBlock
-     * @param path 
-     */
-    void listFilesInDirectory(uint32_t dirIndexBlock, string path)
-    {
-        IndexBlock ib;
-        cout << "Listando arquivos no diretório: " << path << endl;
+            int error = ioTransfer(fd, true, iov, iovcnt, offset);
+            if (error != 0)
+            {
+                throw runtime_error("Erro ao escrever no bloco: " + string(strerror(error)));
+            }
+        }
 
-        try
+        /**
+         * @brief Escolhe o motor das filas assíncronas (io_uring por padrão).
+         * Não deve haver filas em uso.
+         * 
+         * @param engine Motor desejado
+         */
+        void setAsyncEngine(AsyncEngine engine)
         {
-            diskManager.readBlock(dirIndexBlock, reinterpret_cast<char *>(&ib));
+            lock_guard<mutex> guard(asyncLock);
+            asyncEngine = engine;
+            asyncIo.reset();
         }
-        catch (const exception &e)
+
+        /**
+         * @brief Motor das filas assíncronas, criado no primeiro uso
+         * 
+         * @return AsyncIo* Motor, ou nullptr no modo MMAP (a imagem mapeada é copiada de forma síncrona)
+         */
+        AsyncIo *async()
         {
-            cerr << "Erro ao ler o bloco de índice: " << e.what() << endl;
-            return;
+            openDisk();
+            if (map != nullptr)
+            {
+                return nullptr;
+            }
+            lock_guard<mutex> guard(asyncLock);
+            if (asyncIo == nullptr)
+            {
+                asyncIo.reset(new AsyncIo(fd, asyncEngine));
+            }
+            return asyncIo.get();
         }
 
-        cout << "Listando arquivos no diretório: " << path << endl;
-
-        for (const auto &ptr : ib.block_ptrs)
+        // Fila assíncrona de leituras/escritas de sequências de blocos (ver IoQueue).
+        // No modo MMAP cada pedido é atendido na hora e fica concluído até ser recolhido.
+        class BlockQueue
         {
-            if (ptr != 0xFFFFFFFF)
+        private:
+            DiskManager &disk;
+            unique_ptr<IoQueue> queue;
+            deque<uint64_t> done; // Pedidos atendidos na hora (modo MMAP)
+            uint64_t nextTag = 0;
+
+        public:
+            BlockQueue(DiskManager &diskManager, u_int32_t depth = IO_QUEUE_DEPTH) : disk(diskManager)
             {
-                RootDirEntry dirEntry;
-                try
+                AsyncIo *io = disk.async();
+                if (io != nullptr)
                 {
-                    diskManager.readBlock(ptr, reinterpret_cast<char *>(&dirEntry));
+                    queue.reset(new IoQueue(*io, depth));
                 }
-                catch (const exception &e)
+            }
+
+            /**
+             * @brief Enfileira a leitura de blocos consecutivos para vários buffers
+             * 
+             * @param blockIndex Primeiro bloco
+             * @param iov Buffers de destino (precisam existir até a conclusão)
+             * @param iovcnt Número de buffers
+             * @return uint64_t Identificador do pedido
+             */
+            uint64_t readv(u_int32_t blockIndex, const iovec *iov, int iovcnt)
+            {
+                if (queue != nullptr)
                 {
-                    cerr << "Erro ao ler o bloco de diretório: " << e.what() << endl;
-                    continue;
+                    return queue->read((off_t)blockIndex * BLOCK_SIZE, iov, iovcnt);
                 }
-                if (dirEntry.filename[0] != '\0') // Verifica se a entrada é válida
-                {
+                disk.readBlocksv(blockIndex, iov, iovcnt);
+                done.push_back(nextTag);
+                return nextTag++;
+            }
 
-                    string fullPath = path + "/" + string(dirEntry.filename);
-                    cout << "Filename: " << fullPath << ", Type: " << dirEntry.file_type << ", Index Block: " << dirEntry.index_block << endl;
-                    if (dirEntry.file_type == '2') // Se for um diretório, listar recursivamente
-                    {
-                        listFilesInDirectory(dirEntry.index_block, fullPath);
-                    }
+            uint64_t read(u_int32_t blockIndex, u_int32_t count, char *data)
+            {
+                iovec iov = {data, (size_t)count * BLOCK_SIZE};
+                return readv(blockIndex, &iov, 1);
+            }
+
+            /**
+             * @brief Enfileira a escrita de vários buffers em blocos consecutivos
+             * 
+             * @param blockIndex Primeiro bloco
+             * @param iov Buffers de origem (precisam existir até a conclusão)
+             * @param iovcnt Número de buffers
+             * @return uint64_t Identificador do pedido
+             */
+            uint64_t writev(u_int32_t blockIndex, const iovec *iov, int iovcnt)
+            {
+                if (queue != nullptr)
+                {
+                    return queue->write((off_t)blockIndex * BLOCK_SIZE, iov, iovcnt);
                 }
+                disk.writeBlocksv(blockIndex, iov, iovcnt);
+                done.push_back(nextTag);
+                return nextTag++;
             }
-        }
-    }
 
-public:
-    /**
-     * @brief Construtor do sistema de arquivos
-     * 
-     * @param path Caminho do disco
-     * @param numBlocks Número de blocos do sistema de arquivos
-     */
-    FileSystem(string &path, u_int32_t numBlocks)
-    {
-        if (numBlocks < 4)
-        {
-            throw runtime_error("Número de blocos insuficiente!");
-        }
-        diskManager = DiskManager(path);
+            uint64_t write(u_int32_t blockIndex, u_int32_t count, const char *data)
+            {
+                iovec iov = {const_cast<char *>(data), (size_t)count * BLOCK_SIZE};
+                return writev(blockIndex, &iov, 1);
+            }
 
-        // Inicializa o vetor de bitmap
-        bitmap.resize(BLOCK_SIZE * calcNumBlocksBitmap(numBlocks));
-        // Inicializa o vetor de entradas de diretório raiz
-        rootDir.resize(BLOCK_SIZE / ENTRY_SIZE);
-        // Inicializa o superbloco
-        superblock.total_blocks = numBlocks;
-        superblock.bitmap_blocks = calcNumBlocksBitmap(numBlocks);
-        superblock.root_dir_index = superblock.bitmap_blocks + 1;
-        superblock.free_blocks = numBlocks - superblock.root_dir_index - 1;
+            void submit()
+            {
+                if (queue != nullptr)
+                {
+                    queue->submit();
+                }
+            }
 
-        // Inicializa o superbloco no bloco 0
-        diskManager.create(numBlocks * BLOCK_SIZE);
-        for (u_int32_t i = 0; i < superblock.bitmap_start + superblock.bitmap_blocks + 1; i++)
-        {
-            bitmap[i / 8] |= 1 << (i % 8);
-        }
-        char buffer[BLOCK_SIZE];
-        //Limpar buffer
-        memset(buffer, 0x00, BLOCK_SIZE);
-        //Escrever o superbloco no disco
-        memcpy(buffer, &superblock, sizeof(Superblock));
-        diskManager.writeBlock(0, buffer);
-    
-        diskManager.writeBlock(superblock.bitmap_start, (char *)bitmap.data());
-        //Limpar buffer
-        memset(buffer, 0x00, BLOCK_SIZE);
-        //Escrever o diretório raiz no disco
-        memcpy(buffer, rootDir.data(), rootDir.size());
-        diskManager.writeBlock(superblock.root_dir_index, buffer);
+            bool poll(uint64_t &tag)
+            {
+                if (queue != nullptr)
+                {
+                    return queue->poll(tag);
+                }
+                if (done.empty())
+                {
+                    return false;
+                }
+                tag = done.front();
+                done.pop_front();
+                return true;
+            }
+
+            uint64_t wait()
+            {
+                if (queue != nullptr)
+                {
+                    return queue->wait();
+                }
+                if (done.empty())
+                {
+                    throw runtime_error("Nenhum pedido de E/S em andamento!");
+                }
+                uint64_t tag = done.front();
+                done.pop_front();
+                return tag;
+            }
+
+            void drain()
+            {
+                if (queue != nullptr)
+                {
+                    queue->drain();
+                }
+                done.clear();
+            }
+        };
+
+        /**
+         * @brief Força a escrita dos dados do disco no armazenamento.
+         * No modo MMAP o ponto de durabilidade é o msync da imagem.
+         */
+        void sync()
+        {
+            if (map != nullptr)
+            {
+                if (::msync(map, mapSize, MS_SYNC) != 0)
+                {
+                    throw runtime_error("Erro ao sincronizar o disco: " + string(strerror(errno)));
+                }
+                return;
+            }
+            if (fd >= 0 && ::fdatasync(fd) != 0)
+            {
+                throw runtime_error("Erro ao sincronizar o disco: " + string(strerror(errno)));
+            }
+        }
+    };
+
+    DiskManager diskManager;
+
+    // Cache de blocos com escrita adiada (write-back) e substituição LRU.
+    // Todas as operações são protegidas por uma única trava; as leituras e escritas diretas
+    // acessam o disco fora da trava.
+    // Com o diário ativo, os metadados alterados ficam presos na cache até o commit os escrever no lugar.
+    class BlockCache
+    {
+    private:
+        struct Frame
+        {
+            u_int32_t block;              // Bloco do disco armazenado no quadro
+            bool dirty;                   // Indica se o quadro precisa ser escrito no disco (metadados: copiado no próximo commit)
+            bool journaled;               // Metadado cuja escrita no lugar pertence ao diário: não é despejado nem descarregado
+            bool pending;                 // Metadado já durável no diário: só vai para o lugar no checkpoint ou ao ser despejado
+            u_int32_t pins;               // Referências (BlockRef) que impedem o despejo do quadro
+            uint64_t version;             // Número da última escrita no quadro
+            list<u_int32_t>::iterator lru; // Posição do quadro na lista LRU
+        };
+
+        DiskManager &disk;
+        u_int32_t capacity;
+        unique_ptr<char[]> memory;                // capacity * BLOCK_SIZE bytes (páginas ocupadas conforme o uso)
+        vector<Frame> frames;
+        vector<u_int32_t> freeFrames;
+        unordered_map<u_int32_t, u_int32_t> lookup; // bloco -> quadro
+        list<u_int32_t> lru;                      // Quadros, do mais recente ao menos recente
+        mutex lock;
+        bool journaling = false;                  // writeMetadata prende os quadros ao diário
+        uint64_t writes = 0;                      // Fonte de Frame::version
+        vector<u_int32_t> spilled;                // Metadados escritos no lugar sem passar pelo diário (ver takeFrame)
+
+        // Estado de um metadado antes da primeira escrita de uma operação em andamento (restaurado se ela falhar)
+        struct UndoImage
+        {
+            bool cached = false;     // O bloco estava na cache (senão, o conteúdo anterior é o do disco)
+            bool dirty = false;
+            bool journaled = false;
+            bool pending = false;
+            uint64_t version = 0;    // Versão do quadro depois da última escrita da operação
+            vector<char> data;       // Conteúdo anterior (somente se cached)
+        };
+        unordered_map<thread::id, unordered_map<u_int32_t, UndoImage>> undo; // Operações em andamento, por thread
+        u_int32_t undoFirst = 0;                  // Blocos anteriores (superbloco e bitmap) seguem o alocador em memória
+
+        char *frameData(u_int32_t frame)
+        {
+            return memory.get() + (size_t)frame * BLOCK_SIZE;
+        }
+
+        /**
+         * @brief Obtém um quadro para o bloco, despejando o menos recente que não esteja preso.
+         * Deve ser chamado com a trava da cache.
+         * 
+         * @param blockIndex Bloco que ocupará o quadro
+         * @return u_int32_t Quadro reservado (já no início da lista LRU)
+         */
+        u_int32_t takeFrame(u_int32_t blockIndex)
+        {
+            u_int32_t frame;
+            if (!freeFrames.empty())
+            {
+                frame = freeFrames.back();
+                freeFrames.pop_back();
+                lru.push_front(frame);
+            }
+            else
+            {
+                // Metadados presos ao diário só são despejados se não houver outro quadro livre de referências
+                auto it = lru.end();
+                auto spill = lru.end();
+                while (true)
+                {
+                    if (it == lru.begin())
+                    {
+                        if (spill == lru.end())
+                        {
+                            throw runtime_error("Cache cheia: todos os quadros estão em uso!");
+                        }
+                        it = spill;
+                        break;
+                    }
+                    --it;
+                    if (frames[*it].pins > 0)
+                    {
+                        continue;
+                    }
+                    if (!frames[*it].journaled)
+                    {
+                        break;
+                    }
+                    if (spill == lru.end())
+                    {
+                        spill = it;
+                    }
+                }
+                frame = *it;
+                Frame &victim = frames[frame];
+                if (victim.journaled)
+                {
+                    // As alterações em andamento não cabem na cache: o bloco vai para o lugar fora do diário
+                    // e as cópias antigas dele no diário serão revogadas no próximo commit
+                    victim.journaled = false;
+                    journaledFrames--;
+                    spilled.push_back(victim.block);
+                    spills++;
+                    disk.writeBlock(victim.block, frameData(frame));
+                    writebacks++;
+                }
+                else if (victim.dirty)
+                {
+                    disk.writeBlock(victim.block, frameData(frame));
+                    writebacks++;
+                }
+                lookup.erase(victim.block);
+                evictions++;
+                lru.splice(lru.begin(), lru, victim.lru);
+            }
+            frames[frame].block = blockIndex;
+            frames[frame].dirty = false;
+            frames[frame].journaled = false;
+            frames[frame].pending = false;
+            frames[frame].pins = 0;
+            frames[frame].version = 0;
+            frames[frame].lru = lru.begin();
+            lookup[blockIndex] = frame;
+            return frame;
+        }
+
+        /**
+         * @brief Retorna o quadro que guarda o bloco, lendo-o do disco em caso de falta.
+         * Deve ser chamado com a trava da cache.
+         * 
+         * @param blockIndex indice do bloco
+         * @return u_int32_t Quadro do bloco (no início da lista LRU)
+         */
+        u_int32_t loadFrame(u_int32_t blockIndex)
+        {
+            auto it = lookup.find(blockIndex);
+            if (it != lookup.end())
+            {
+                hits++;
+                lru.splice(lru.begin(), lru, frames[it->second].lru);
+                return it->second;
+            }
+            misses++;
+            u_int32_t frame = takeFrame(blockIndex);
+            try
+            {
+                disk.readBlock(blockIndex, frameData(frame));
+            }
+            catch (...)
+            {
+                lookup.erase(blockIndex);
+                lru.erase(frames[frame].lru);
+                freeFrames.push_back(frame);
+                throw;
+            }
+            return frame;
+        }
+
+        /**
+         * @brief Copia sobre os buffers os blocos que estão na cache (o quadro pode estar mais novo que o disco).
+         * Deve ser chamado com a trava da cache.
+         * 
+         * @param blockIndex Primeiro bloco lido
+         * @param iov Buffers, cada um com um número inteiro de blocos
+         * @param iovcnt Número de buffers
+         */
+        void overlayCached(u_int32_t blockIndex, const iovec *iov, int iovcnt)
+        {
+            if (lookup.empty())
+            {
+                return;
+            }
+            u_int32_t block = blockIndex;
+            for (int i = 0; i < iovcnt; i++)
+            {
+                for (size_t off = 0; off < iov[i].iov_len; off += BLOCK_SIZE, block++)
+                {
+                    auto it = lookup.find(block);
+                    if (it != lookup.end())
+                    {
+                        memcpy(static_cast<char *>(iov[i].iov_base) + off, frameData(it->second), BLOCK_SIZE);
+                    }
+                }
+            }
+        }
+
+        void unpin(u_int32_t frame)
+        {
+            lock_guard<mutex> guard(lock);
+            frames[frame].pins--;
+        }
+
+        /**
+         * @brief Escreve um bloco inteiro em um quadro (sem ler o disco) e o marca como sujo.
+         * Deve ser chamado com a trava da cache.
+         * 
+         * @return u_int32_t Quadro do bloco
+         */
+        u_int32_t writeFrame(u_int32_t blockIndex, const char *data)
+        {
+            u_int32_t frame;
+            auto it = lookup.find(blockIndex);
+            if (it != lookup.end())
+            {
+                hits++;
+                frame = it->second;
+                lru.splice(lru.begin(), lru, frames[frame].lru);
+            }
+            else
+            {
+                // O bloco é sobrescrito por inteiro, então não é preciso lê-lo do disco
+                frame = takeFrame(blockIndex);
+            }
+            memcpy(frameData(frame), data, BLOCK_SIZE);
+            frames[frame].dirty = true;
+            frames[frame].pending = false;
+            frames[frame].version = ++writes;
+            return frame;
+        }
+
+        /**
+         * @brief Estado anterior de um metadado que a thread vai escrever, se ela está em uma operação
+         * Deve ser chamado com a trava da cache, antes da escrita.
+         * 
+         * @return UndoImage* Estado guardado na primeira escrita da operação, ou nullptr
+         */
+        UndoImage *undoImage(u_int32_t blockIndex)
+        {
+            if (undo.empty() || blockIndex < undoFirst)
+            {
+                return nullptr;
+            }
+            auto op = undo.find(this_thread::get_id());
+            if (op == undo.end())
+            {
+                return nullptr;
+            }
+            auto inserted = op->second.try_emplace(blockIndex);
+            UndoImage &image = inserted.first->second;
+            auto it = lookup.find(blockIndex);
+            if (inserted.second && it != lookup.end())
+            {
+                Frame &frame = frames[it->second];
+                image.cached = true;
+                image.dirty = frame.dirty;
+                image.journaled = frame.journaled;
+                image.pending = frame.pending;
+                image.data.assign(frameData(it->second), frameData(it->second) + BLOCK_SIZE);
+            }
+            return &image;
+        }
+
+        /**
+         * @brief Solta um quadro do diário (o bloco passou a guardar dados ou foi liberado).
+         * Deve ser chamado com a trava da cache.
+         * 
+         */
+        void unjournal(Frame &frame)
+        {
+            if (frame.journaled)
+            {
+                frame.journaled = false;
+                journaledFrames--;
+            }
+        }
+
+    public:
+        atomic<uint64_t> hits{0};       // Leituras/escritas atendidas pela cache
+        atomic<uint64_t> misses{0};     // Leituras que precisaram acessar o disco
+        atomic<uint64_t> evictions{0};  // Quadros despejados
+        atomic<uint64_t> writebacks{0}; // Blocos sujos escritos no disco
+        atomic<uint64_t> spills{0};     // Metadados despejados antes do commit (escritos fora do diário)
+        atomic<u_int32_t> journaledFrames{0}; // Quadros presos ao diário
+
+        // Referência a um bloco sem cópia: enquanto existir, o quadro não é despejado.
+        // Sem cache (capacidade 0) a referência guarda a própria cópia do bloco.
+        class BlockRef
+        {
+        private:
+            BlockCache *owner = nullptr;
+            u_int32_t frame = 0;
+            const char *ptr = nullptr;
+            unique_ptr<char[]> copy;
+
+        public:
+            BlockRef() = default;
+            BlockRef(BlockCache *cache, u_int32_t pinnedFrame, const char *data) : owner(cache), frame(pinnedFrame), ptr(data) {}
+            explicit BlockRef(const char *data) : ptr(data) {}
+            explicit BlockRef(unique_ptr<char[]> buffer) : ptr(buffer.get()), copy(move(buffer)) {}
+
+            BlockRef(BlockRef &&other) noexcept : owner(other.owner), frame(other.frame), ptr(other.ptr), copy(move(other.copy))
+            {
+                other.owner = nullptr;
+                other.ptr = nullptr;
+            }
+
+            BlockRef &operator=(BlockRef &&other) noexcept
+            {
+                if (this != &other)
+                {
+                    release();
+                    owner = other.owner;
+                    frame = other.frame;
+                    ptr = other.ptr;
+                    copy = move(other.copy);
+                    other.owner = nullptr;
+                    other.ptr = nullptr;
+                }
+                return *this;
+            }
+
+            ~BlockRef()
+            {
+                release();
+            }
+
+            const char *data() const
+            {
+                return ptr;
+            }
+
+            void release()
+            {
+                if (owner != nullptr)
+                {
+                    owner->unpin(frame);
+                    owner = nullptr;
+                }
+                ptr = nullptr;
+                copy.reset();
+            }
+        };
+
+        /**
+         * @brief Construtor da cache de blocos.
+         * 
+         * @param diskManager Gerenciador de disco subjacente
+         * @param numBlocks Capacidade da cache em blocos (0 desativa a cache)
+         */
+        BlockCache(DiskManager &diskManager, u_int32_t numBlocks) : disk(diskManager), capacity(numBlocks)
+        {
+            memory.reset(new char[(size_t)capacity * BLOCK_SIZE]);
+            frames.resize(capacity);
+            for (u_int32_t i = capacity; i > 0; i--)
+            {
+                freeFrames.push_back(i - 1);
+            }
+        }
+
+        BlockCache(const BlockCache &) = delete;
+        BlockCache &operator=(const BlockCache &) = delete;
+
+        ~BlockCache()
+        {
+            try
+            {
+                flush();
+            }
+            catch (const exception &e)
+            {
+                cerr << "Erro ao descarregar a cache: " << e.what() << endl;
+            }
+        }
+
+        /**
+         * @brief Le um bloco, buscando no disco apenas em caso de falta
+         * 
+         * @param blockIndex indice do bloco a ser lido
+         * @param data Buffer de destino com pelo menos BLOCK_SIZE bytes
+         */
+        void readBlock(u_int32_t blockIndex, char *data)
+        {
+            if (capacity == 0)
+            {
+                misses++;
+                disk.readBlock(blockIndex, data);
+                return;
+            }
+            lock_guard<mutex> guard(lock);
+            memcpy(data, frameData(loadFrame(blockIndex)), BLOCK_SIZE);
+        }
+
+        /**
+         * @brief Retorna o conteúdo de um bloco sem copiá-lo para o chamador.
+         * O quadro fica preso na cache até a referência ser destruída.
+         * 
+         * @param blockIndex indice do bloco
+         * @return BlockRef Bloco na imagem mapeada, no quadro da cache ou em uma cópia própria
+         */
+        BlockRef pin(u_int32_t blockIndex)
+        {
+            char *mapped = disk.blockPtr(blockIndex);
+            if (mapped != nullptr)
+            {
+                hits++;
+                return BlockRef(mapped);
+            }
+            if (capacity == 0)
+            {
+                unique_ptr<char[]> buffer(new char[BLOCK_SIZE]);
+                readBlock(blockIndex, buffer.get());
+                return BlockRef(move(buffer));
+            }
+            lock_guard<mutex> guard(lock);
+            u_int32_t frame = loadFrame(blockIndex);
+            frames[frame].pins++;
+            return BlockRef(this, frame, frameData(frame));
+        }
+
+        /**
+         * @brief Escreve um bloco de dados na cache, adiando a escrita no disco
+         * 
+         * @param blockIndex indice do bloco a ser escrito
+         * @param data Buffer de origem com pelo menos BLOCK_SIZE bytes
+         */
+        void writeBlock(u_int32_t blockIndex, const char *data)
+        {
+            if (capacity == 0)
+            {
+                disk.writeBlock(blockIndex, data);
+                return;
+            }
+            lock_guard<mutex> guard(lock);
+            unjournal(frames[writeFrame(blockIndex, data)]);
+        }
+
+        /**
+         * @brief Escreve um bloco de metadados na cache. Com o diário ativo, o quadro fica preso à cache
+         * até um commit copiá-lo para o diário e escrevê-lo no lugar.
+         * 
+         * @param blockIndex indice do bloco a ser escrito
+         * @param data Buffer de origem com pelo menos BLOCK_SIZE bytes
+         */
+        void writeMetadata(u_int32_t blockIndex, const char *data)
+        {
+            if (capacity == 0)
+            {
+                disk.writeBlock(blockIndex, data);
+                return;
+            }
+            lock_guard<mutex> guard(lock);
+            UndoImage *image = undoImage(blockIndex);
+            Frame &frame = frames[writeFrame(blockIndex, data)];
+            if (journaling && !frame.journaled)
+            {
+                frame.journaled = true;
+                journaledFrames++;
+            }
+            if (image != nullptr)
+            {
+                image->version = frame.version;
+            }
+        }
+
+        /**
+         * @brief Le um bloco e copia apenas sizeof(T) bytes para a estrutura.
+         * 
+         * @param blockIndex indice do bloco a ser lido
+         * @param obj Estrutura de destino
+         */
+        template <typename T>
+        void readStruct(u_int32_t blockIndex, T &obj)
+        {
+            static_assert(is_trivially_copyable<T>::value && sizeof(T) <= BLOCK_SIZE, "Estrutura inválida para um bloco");
+            char buffer[BLOCK_SIZE];
+            readBlock(blockIndex, buffer);
+            memcpy((void *)&obj, buffer, sizeof(T));
+        }
+
+        /**
+         * @brief Escreve uma estrutura de metadados em um bloco, completando o restante com zeros.
+         * 
+         * @param blockIndex indice do bloco a ser escrito
+         * @param obj Estrutura de origem
+         */
+        template <typename T>
+        void writeStruct(u_int32_t blockIndex, const T &obj)
+        {
+            static_assert(is_trivially_copyable<T>::value && sizeof(T) <= BLOCK_SIZE, "Estrutura inválida para um bloco");
+            char buffer[BLOCK_SIZE];
+            memset(buffer, 0x00, BLOCK_SIZE);
+            memcpy(buffer, (const void *)&obj, sizeof(T));
+            writeMetadata(blockIndex, buffer);
+        }
+
+        /**
+         * @brief Escreve blocos consecutivos direto no disco, sem ocupar quadros da cache.
+         * Quadros que já guardam algum desses blocos são atualizados para não ficarem obsoletos.
+         * 
+         * @param blockIndex Primeiro bloco a ser escrito
+         * @param count Número de blocos
+         * @param data Buffer de origem com pelo menos count * BLOCK_SIZE bytes
+         */
+        void writeBlocksDirect(u_int32_t blockIndex, u_int32_t count, const char *data)
+        {
+            {
+                lock_guard<mutex> guard(lock);
+                for (u_int32_t i = 0; i < count && !lookup.empty(); i++)
+                {
+                    auto it = lookup.find(blockIndex + i);
+                    if (it != lookup.end())
+                    {
+                        memcpy(frameData(it->second), data + (size_t)i * BLOCK_SIZE, BLOCK_SIZE);
+                        frames[it->second].dirty = false;
+                        frames[it->second].pending = false;
+                        frames[it->second].version = ++writes;
+                        unjournal(frames[it->second]);
+                    }
+                }
+            }
+            disk.writeBlocks(blockIndex, count, data);
+        }
+
+        /**
+         * @brief Le blocos consecutivos direto do disco (preadv), sem ocupar quadros da cache.
+         * Blocos presentes na cache são copiados do quadro, que pode estar mais novo que o disco.
+         * 
+         * @param blockIndex Primeiro bloco a ser lido
+         * @param iov Buffers de destino, cada um com um número inteiro de blocos
+         * @param iovcnt Número de buffers
+         */
+        void readBlocksDirect(u_int32_t blockIndex, const iovec *iov, int iovcnt)
+        {
+            disk.readBlocksv(blockIndex, iov, iovcnt);
+            lock_guard<mutex> guard(lock);
+            overlayCached(blockIndex, iov, iovcnt);
+        }
+
+        /**
+         * @brief Le várias sequências de blocos direto do disco, enviando todas as leituras juntas pela fila assíncrona
+         * Depois que todas terminam, os blocos presentes na cache são copiados do quadro.
+         * 
+         * @param reads Sequências a serem lidas
+         */
+        void readBlocksDirect(const vector<ReadPlan::DiskRead> &reads)
+        {
+            if (reads.size() == 1)
+            {
+                readBlocksDirect(reads[0].offset / BLOCK_SIZE, reads[0].iov, reads[0].iovcnt);
+                return;
+            }
+            {
+                typename DiskManager::BlockQueue queue(disk);
+                for (const ReadPlan::DiskRead &read : reads)
+                {
+                    queue.readv(read.offset / BLOCK_SIZE, read.iov, read.iovcnt);
+                }
+                queue.drain();
+            }
+            overlayCached(reads);
+        }
+
+        /**
+         * @brief Copia sobre os buffers de leituras já concluídas os blocos que estão na cache
+         * 
+         * @param reads Sequências lidas direto do disco
+         */
+        void overlayCached(const vector<ReadPlan::DiskRead> &reads)
+        {
+            lock_guard<mutex> guard(lock);
+            for (const ReadPlan::DiskRead &read : reads)
+            {
+                overlayCached(read.offset / BLOCK_SIZE, read.iov, read.iovcnt);
+            }
+        }
+
+        /**
+         * @brief Copia parte de um bloco se ele estiver na cache, sem acessar o disco nem alterar a ordem LRU
+         * 
+         * @param blockIndex indice do bloco
+         * @param offset Deslocamento dentro do bloco
+         * @param length Número de bytes
+         * @param data Buffer de destino
+         * @return true se o bloco estava na cache
+         */
+        bool readCached(u_int32_t blockIndex, u_int32_t offset, u_int32_t length, char *data)
+        {
+            lock_guard<mutex> guard(lock);
+            auto it = lookup.find(blockIndex);
+            if (it == lookup.end())
+            {
+                return false;
+            }
+            memcpy(data, frameData(it->second) + offset, length);
+            return true;
+        }
+
+        /**
+         * @brief Escreve no disco todos os blocos sujos, em ordem crescente de bloco.
+         * Metadados presos ao diário ficam de fora: só o checkpoint os escreve no lugar.
+         * 
+         */
+        void flush()
+        {
+            lock_guard<mutex> guard(lock);
+            vector<u_int32_t> dirty;
+            for (u_int32_t frame : lru)
+            {
+                if (frames[frame].dirty && !frames[frame].journaled && !frames[frame].pending)
+                {
+                    dirty.push_back(frame);
+                }
+            }
+            sort(dirty.begin(), dirty.end(), [&](u_int32_t a, u_int32_t b)
+                 { return frames[a].block < frames[b].block; });
+            for (u_int32_t frame : dirty)
+            {
+                disk.writeBlock(frames[frame].block, frameData(frame));
+                frames[frame].dirty = false;
+                writebacks++;
+            }
+        }
+
+        /**
+         * @brief Descarrega a cache e força os dados no armazenamento (ponto de durabilidade).
+         * 
+         */
+        void sync()
+        {
+            flush();
+            disk.sync();
+        }
+
+        /**
+         * @brief Capacidade da cache em blocos
+         * 
+         */
+        u_int32_t frameCount() const
+        {
+            return capacity;
+        }
+
+        /**
+         * @brief Liga ou desliga o diário: com ele desligado, writeMetadata é igual a writeBlock
+         * 
+         */
+        void setJournaling(bool enabled)
+        {
+            lock_guard<mutex> guard(lock);
+            journaling = enabled && capacity > 0;
+        }
+
+        /**
+         * @brief Copia os metadados alterados desde o último commit, em ordem crescente de bloco.
+         * Os quadros continuam presos ao diário até o commit ficar durável, então o disco nunca os vê pela metade.
+         * 
+         * @param blocks Recebe os blocos copiados
+         * @param versions Recebe a versão de cada quadro no momento da cópia
+         * @param images Recebe o conteúdo dos blocos, BLOCK_SIZE bytes cada
+         */
+        void captureJournaled(vector<u_int32_t> &blocks, vector<uint64_t> &versions, vector<char> &images)
+        {
+            lock_guard<mutex> guard(lock);
+            vector<u_int32_t> captured;
+            for (u_int32_t frame : lru)
+            {
+                if (frames[frame].journaled && frames[frame].dirty)
+                {
+                    captured.push_back(frame);
+                }
+            }
+            sort(captured.begin(), captured.end(), [&](u_int32_t a, u_int32_t b)
+                 { return frames[a].block < frames[b].block; });
+            images.resize(captured.size() * BLOCK_SIZE);
+            for (size_t i = 0; i < captured.size(); i++)
+            {
+                Frame &frame = frames[captured[i]];
+                blocks.push_back(frame.block);
+                versions.push_back(frame.version);
+                memcpy(images.data() + i * BLOCK_SIZE, frameData(captured[i]), BLOCK_SIZE);
+                frame.dirty = false;
+            }
+        }
+
+        /**
+         * @brief Solta do diário os quadros que não mudaram desde a cópia, depois que o commit ficou durável.
+         * Se a transação foi para o diário, os quadros ficam pendentes: a escrita no lugar é adiada até o checkpoint
+         * (ou até o quadro ser despejado), e um bloco alterado por vários commits seguidos é escrito uma vez só.
+         * 
+         * @param blocks Blocos copiados pelo commit (em ordem crescente)
+         * @param versions Versões dos quadros no momento da cópia
+         * @param logged false se a transação foi escrita direto no lugar (não coube no diário)
+         */
+        void commitFrames(const vector<u_int32_t> &blocks, const vector<uint64_t> &versions, bool logged)
+        {
+            lock_guard<mutex> guard(lock);
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                auto it = lookup.find(blocks[i]);
+                if (it != lookup.end() && frames[it->second].journaled && frames[it->second].version == versions[i])
+                {
+                    Frame &frame = frames[it->second];
+                    unjournal(frame);
+                    frame.dirty = logged;
+                    frame.pending = logged;
+                }
+            }
+        }
+
+        /**
+         * @brief Checkpoint: escreve no lugar as cópias já duráveis no diário, para que ele possa ser reutilizado.
+         * Feito com a trava da cache: um metadado despejado antes do commit (já escrito no lugar com um conteúdo
+         * mais novo) não pode ser sobrescrito pela cópia antiga.
+         * 
+         * @param images Blocos e conteúdo de cada um no último commit
+         */
+        void checkpoint(const map<u_int32_t, vector<char>> &images)
+        {
+            lock_guard<mutex> guard(lock);
+            unordered_set<u_int32_t> skip(spilled.begin(), spilled.end());
+            vector<iovec> iov;
+            u_int32_t first = 0;
+            for (auto it = images.begin();; ++it)
+            {
+                bool write = it != images.end() && skip.count(it->first) == 0;
+                // Blocos vizinhos no disco saem em uma única escrita vetorial
+                if (!iov.empty() && (!write || it->first != first + iov.size() || iov.size() == IOV_MAX))
+                {
+                    disk.writeBlocksv(first, iov.data(), iov.size());
+                    writebacks += iov.size();
+                    iov.clear();
+                }
+                if (it == images.end())
+                {
+                    break;
+                }
+                if (write)
+                {
+                    if (iov.empty())
+                    {
+                        first = it->first;
+                    }
+                    iov.push_back({const_cast<char *>(it->second.data()), BLOCK_SIZE});
+                }
+            }
+            for (Frame &frame : frames)
+            {
+                if (frame.pending)
+                {
+                    frame.pending = false;
+                    frame.dirty = images.count(frame.block) == 0;
+                }
+            }
+        }
+
+        /**
+         * @brief Solta do diário os quadros de blocos liberados: o conteúdo deles não precisa mais chegar ao disco
+         * 
+         */
+        void discardJournaled(const vector<u_int32_t> &blocks)
+        {
+            lock_guard<mutex> guard(lock);
+            for (u_int32_t block : blocks)
+            {
+                auto it = lookup.find(block);
+                if (it != lookup.end() && (frames[it->second].journaled || frames[it->second].pending))
+                {
+                    frames[it->second].dirty = false;
+                    frames[it->second].pending = false;
+                    unjournal(frames[it->second]);
+                }
+            }
+        }
+
+        /**
+         * @brief Início de uma operação da thread: o estado anterior de cada metadado que ela escrever é guardado
+         * 
+         * @param first Primeiro bloco guardado (o superbloco e o bitmap são reescritos a partir do alocador em memória)
+         */
+        void beginUndo(u_int32_t first)
+        {
+            lock_guard<mutex> guard(lock);
+            undoFirst = first;
+            undo[this_thread::get_id()].clear();
+        }
+
+        /**
+         * @brief Fim da operação da thread. Se ela falhou, os metadados que escreveu voltam ao estado anterior; um
+         * bloco escrito depois por outra operação (ou já despejado para o disco) não pode ser restaurado.
+         * 
+         * @param restore true se a operação falhou
+         * @return u_int32_t Blocos que não puderam ser restaurados
+         */
+        u_int32_t endUndo(bool restore)
+        {
+            lock_guard<mutex> guard(lock);
+            auto op = undo.find(this_thread::get_id());
+            if (op == undo.end())
+            {
+                return 0;
+            }
+            u_int32_t lost = 0;
+            for (auto &item : op->second)
+            {
+                if (!restore)
+                {
+                    break;
+                }
+                const UndoImage &image = item.second;
+                auto it = lookup.find(item.first);
+                if (it == lookup.end() || frames[it->second].version != image.version)
+                {
+                    lost++;
+                    continue;
+                }
+                Frame &frame = frames[it->second];
+                try
+                {
+                    if (image.cached)
+                    {
+                        memcpy(frameData(it->second), image.data.data(), BLOCK_SIZE);
+                    }
+                    else
+                    {
+                        disk.readBlock(item.first, frameData(it->second));
+                    }
+                }
+                catch (const exception &)
+                {
+                    lost++;
+                    continue;
+                }
+                frame.dirty = image.cached && image.dirty;
+                frame.pending = image.cached && image.pending;
+                if (!image.cached || !image.journaled)
+                {
+                    unjournal(frame);
+                }
+                frame.version = ++writes;
+            }
+            undo.erase(op);
+            return lost;
+        }
+
+        /**
+         * @brief Retira a lista de metadados escritos fora do diário desde a última chamada
+         * 
+         */
+        void takeSpilled(vector<u_int32_t> &out)
+        {
+            lock_guard<mutex> guard(lock);
+            out.insert(out.end(), spilled.begin(), spilled.end());
+            spilled.clear();
+        }
+    };
+
+    BlockCache cache;
+    using BlockRef = typename BlockCache::BlockRef;
+
+    // Partição do alocador: um intervalo de grupos inteiros do bitmap com trava e cursor próprios.
+    // Threads diferentes começam em partições diferentes e só disputam a mesma trava quando a sua enche.
+    struct AllocShard
+    {
+        mutex lock;
+        u_int32_t first = 0;          // Primeiro bloco da partição
+        u_int32_t end = 0;            // Fim (exclusivo) da partição
+        u_int32_t cursor = 0;         // Próximo bloco a partir do qual a busca começa (next-fit)
+        atomic<bool> dirty{false};    // Blocos do bitmap alterados e ainda não escritos
+    };
+
+    unique_ptr<AllocShard[]> shards;
+    u_int32_t numShards = 0;
+    atomic<uint32_t> freeBlocksCount{0};   // Blocos livres ainda não reservados (fonte de superblock.free_blocks)
+    mutex metadataLock;                    // Serializa a escrita do bitmap e do superbloco
+    atomic<bool> superblockDirty{false};   // Superbloco alterado em memória e ainda não escrito
+    atomic<u_int32_t> batchDepth{0};       // Lotes de metadados abertos (a escrita é adiada até o último fechar)
+
+    /**
+     * @brief Divide o bitmap em partições de grupos inteiros (chamado na formatação e na montagem)
+     * 
+     */
+    void setupShards()
+    {
+        u_int32_t groups = bitmap.numGroups();
+        u_int32_t groupBlocks = bitmap.blocksPerGroup();
+        numShards = getMin<u_int32_t>(ALLOC_SHARDS, groups);
+        shards.reset(new AllocShard[numShards]);
+        for (u_int32_t i = 0; i < numShards; i++)
+        {
+            shards[i].first = (uint64_t)groups * i / numShards * groupBlocks;
+            shards[i].end = getMin<uint64_t>((uint64_t)groups * (i + 1) / numShards * groupBlocks, superblock.total_blocks);
+            shards[i].cursor = shards[i].first;
+        }
+    }
+
+    /**
+     * @brief Partição em que a thread atual começa a alocar
+     * 
+     */
+    u_int32_t homeShard()
+    {
+        static atomic<u_int32_t> threads{0};
+        thread_local u_int32_t thread = threads++;
+        return thread % numShards;
+    }
+
+    /**
+     * @brief Partição que contém um bloco
+     * 
+     */
+    AllocShard &shardOf(u_int32_t blockIndex)
+    {
+        u_int32_t i = numShards - 1;
+        while (shards[i].first > blockIndex)
+        {
+            i--;
+        }
+        return shards[i];
+    }
+
+    // Cache de alocação de uma thread: uma sequência de blocos já marcada no bitmap, entregue sem travas
+    // e sem operações atômicas de leitura-modificação-escrita. Só a thread dona altera next e end.
+    struct AllocCache
+    {
+        u_int32_t next = 0;             // Próximo bloco a entregar
+        u_int32_t end = 0;              // Fim (exclusivo) da sequência reservada
+        uint64_t epoch = 0;             // cacheEpoch no momento da reserva
+        atomic<u_int32_t> available{0}; // end - next, publicado (relaxed) para o cálculo de free_blocks
+        atomic<bool> orphaned{false};   // A thread dona terminou: sync devolve os blocos ao bitmap
+    };
+
+    // Caches da thread atual, um por sistema de arquivos; marcados como órfãos quando a thread termina
+    struct ThreadCaches
+    {
+        vector<pair<uint64_t, shared_ptr<AllocCache>>> caches;
+
+        ~ThreadCaches()
+        {
+            for (auto &item : caches)
+            {
+                item.second->orphaned = true;
+            }
+        }
+    };
+
+    const uint64_t instanceId = nextInstanceId();
+    vector<shared_ptr<AllocCache>> allocCaches; // Caches de todas as threads que já alocaram
+    mutex allocCachesLock;
+    atomic<uint64_t> cacheEpoch{0};             // Incrementado para pedir que as threads devolvam suas sequências
+
+    /**
+     * @brief Cache de alocação da thread atual, registrado na primeira chamada
+     * 
+     */
+    AllocCache &threadCache()
+    {
+        thread_local ThreadCaches mine;
+        thread_local uint64_t lastId = 0;
+        thread_local AllocCache *last = nullptr;
+        if (lastId == instanceId)
+        {
+            return *last;
+        }
+
+        shared_ptr<AllocCache> local;
+        for (auto it = mine.caches.begin(); it != mine.caches.end();)
+        {
+            if (it->first == instanceId)
+            {
+                local = it->second;
+            }
+            // Sistemas de arquivos já destruídos soltaram a sua referência
+            it = it->second.use_count() == 1 ? mine.caches.erase(it) : it + 1;
+        }
+        if (!local)
+        {
+            local = make_shared<AllocCache>();
+            local->epoch = cacheEpoch;
+            lock_guard<mutex> guard(allocCachesLock);
+            allocCaches.push_back(local);
+            mine.caches.push_back({instanceId, local});
+        }
+        lastId = instanceId;
+        last = local.get();
+        return *last;
+    }
+
+    /**
+     * @brief Devolve ao bitmap os blocos ainda não usados de um cache (pela thread dona ou com ela já terminada)
+     * 
+     */
+    void returnCache(AllocCache &local)
+    {
+        if (local.next < local.end)
+        {
+            AllocShard &shard = shardOf(local.next);
+            {
+                lock_guard<mutex> guard(shard.lock);
+                for (u_int32_t block = local.next; block < local.end; block++)
+                {
+                    bitmap.clear(block);
+                }
+                shard.dirty = true;
+            }
+            freeBlocksCount += local.end - local.next;
+            superblockDirty = true;
+        }
+        local.next = local.end;
+        local.available.store(0, memory_order_relaxed);
+    }
+
+    /**
+     * @brief Devolve ao bitmap os caches das threads que já terminaram (ou todos, sem outras threads ativas)
+     * 
+     * @param all Devolver também os caches de threads vivas (somente no desligamento)
+     */
+    void reclaimCaches(bool all)
+    {
+        lock_guard<mutex> guard(allocCachesLock);
+        for (auto it = allocCaches.begin(); it != allocCaches.end();)
+        {
+            bool orphaned = (*it)->orphaned;
+            if (all || orphaned)
+            {
+                returnCache(**it);
+            }
+            it = orphaned ? allocCaches.erase(it) : it + 1;
+        }
+    }
+
+    /**
+     * @brief Entrega count blocos contíguos do cache da thread, reservando uma nova sequência se necessário
+     * O caminho rápido só lê e escreve campos da própria thread; a troca de sequência passa pelas partições.
+     * 
+     * @param count Número de blocos (no máximo ALLOC_CACHE_BLOCKS)
+     * @param start Recebe o primeiro bloco
+     * @return true se os blocos vieram do cache
+     */
+    bool takeCached(u_int32_t count, u_int32_t &start)
+    {
+        AllocCache &local = threadCache();
+        if (local.end - local.next < count || local.epoch != cacheEpoch.load(memory_order_relaxed))
+        {
+            // Sequência insuficiente ou devolução pedida: trocar a sequência (caminho lento)
+            returnCache(local);
+            local.epoch = cacheEpoch;
+            if (!refillCache(local, count))
+            {
+                flushAllocMetadata();
+                return false;
+            }
+            flushAllocMetadata();
+        }
+        start = local.next;
+        local.next += count;
+        local.available.store(local.end - local.next, memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Reserva para o cache uma sequência livre de pelo menos count blocos (até ALLOC_CACHE_BLOCKS)
+     * 
+     * @return true se a sequência foi reservada
+     */
+    bool refillCache(AllocCache &local, u_int32_t count)
+    {
+        if (!reserveBlocks(ALLOC_CACHE_BLOCKS))
+        {
+            return false; // Disco quase cheio: alocar direto das partições
+        }
+        u_int32_t home = homeShard();
+        for (u_int32_t i = 0; i < numShards; i++)
+        {
+            AllocShard &shard = shards[(home + i) % numShards];
+            lock_guard<mutex> guard(shard.lock);
+            u_int32_t found = bitmap.findFreeExtentIn(count, shard.first, shard.end, shard.cursor);
+            if (found == BITMAP_NONE)
+            {
+                continue;
+            }
+            u_int32_t length = bitmap.freeRunLength(found, getMin<u_int32_t>(ALLOC_CACHE_BLOCKS, shard.end - found));
+            bitmap.setRange(found, length);
+            shard.cursor = found + length;
+            shard.dirty = true;
+            freeBlocksCount += ALLOC_CACHE_BLOCKS - length;
+            local.next = found;
+            local.end = found + length;
+            local.available.store(length, memory_order_relaxed);
+            superblockDirty = true;
+            return true;
+        }
+        freeBlocksCount += ALLOC_CACHE_BLOCKS;
+        return false;
+    }
+
+    /**
+     * @brief Reserva count blocos do total livre antes de procurá-los no bitmap
+     * 
+     * @return true se havia blocos livres suficientes
+     */
+    bool reserveBlocks(u_int32_t count)
+    {
+        uint32_t available = freeBlocksCount.load();
+        do
+        {
+            if (available < count)
+            {
+                return false;
+            }
+        } while (!freeBlocksCount.compare_exchange_weak(available, available - count));
+        return true;
+    }
+
+    /**
+     * @brief Escreve os blocos alterados do bitmap e o superbloco, a menos que um lote esteja aberto.
+     * 
+     */
+    void flushAllocMetadata()
+    {
+        if (batchDepth > 0)
+        {
+            return;
+        }
+        JournalOp op(*this);
+        writeAllocMetadata();
+    }
+
+    /**
+     * @brief Copia para a cache os blocos alterados do bitmap e o superbloco.
+     * Cada partição é copiada com a própria trava, então a cópia é consistente.
+     * 
+     */
+    void writeAllocMetadata()
+    {
+        lock_guard<mutex> guard(metadataLock);
+        u_int32_t groupBlocks = bitmap.blocksPerGroup();
+        for (u_int32_t i = 0; i < numShards; i++)
+        {
+            AllocShard &shard = shards[i];
+            if (!shard.dirty.exchange(false))
+            {
+                continue;
+            }
+            lock_guard<mutex> shardGuard(shard.lock);
+            for (u_int32_t mapBlock : bitmap.takeDirtyBlocks(shard.first / groupBlocks, (shard.end + groupBlocks - 1) / groupBlocks))
+            {
+                cache.writeMetadata(superblock.bitmap_start + mapBlock, bitmap.data() + (size_t)mapBlock * BLOCK_SIZE);
+            }
+        }
+        if (superblockDirty.exchange(false))
+        {
+            // Os blocos ainda não entregues pelos caches das threads continuam livres
+            uint32_t cached = 0;
+            {
+                lock_guard<mutex> cachesGuard(allocCachesLock);
+                for (const auto &local : allocCaches)
+                {
+                    cached += local->available.load(memory_order_relaxed);
+                }
+            }
+            superblock.free_blocks = freeBlocksCount + cached;
+            superblock.checksum = superblockChecksum(superblock);
+            cache.writeStruct(0, superblock);
+        }
+    }
+
+    // Lote de alterações de metadados: enquanto existir, alocações e liberações
+    // atualizam apenas a memória, e o bitmap/superbloco são escritos uma vez ao final.
+    struct MetadataBatch
+    {
+        SizedFileSystem &fs;
+
+        MetadataBatch(SizedFileSystem &fileSystem) : fs(fileSystem)
+        {
+            fs.batchDepth++;
+        }
+
+        ~MetadataBatch()
+        {
+            fs.batchDepth--;
+            try
+            {
+                fs.flushAllocMetadata();
+            }
+            catch (const exception &e)
+            {
+                cerr << "Erro ao escrever os metadados do lote: " << e.what() << endl;
+            }
+        }
+    };
+
+    // Diário de metadados (write-ahead): os blocos de metadados alterados ficam presos na cache e são copiados
+    // para o diário antes de serem escritos no lugar. Cada transação reúne todas as operações concluídas desde
+    // o commit anterior, e um único fdatasync torna todas duráveis (commit em grupo). A escrita no lugar fica para
+    // o checkpoint, feito quando o diário enche.
+    bool journalActive = false;               // Diário presente e cache de blocos ativa (modo PREAD)
+    u_int32_t journalHead = 1;                // Próxima posição livre do diário (a posição 0 é o cabeçalho)
+    uint32_t journalSequence = 0;             // Número da próxima transação escrita no diário
+    u_int32_t journalThreshold = 1;           // Metadados presos na cache que disparam um commit ao fim de uma operação
+    mutex commitLock;                         // Um commit por vez
+    mutex gateLock;                           // Protege activeOps e gateClosed
+    condition_variable gateChanged;
+    u_int32_t activeOps = 0;                  // Operações que alteram metadados em andamento
+    bool gateClosed = false;                  // Um commit está copiando os metadados: novas operações esperam
+    mutex journalStateLock;                   // Protege journaledBlocks, pendingRevokes e checkpointImages
+    unordered_set<u_int32_t> journaledBlocks; // Blocos com cópias nas transações que estão no diário
+    vector<u_int32_t> pendingRevokes;         // Desses, os liberados desde o último commit
+    map<u_int32_t, vector<char>> checkpointImages; // Última cópia durável de cada bloco ainda não escrita no lugar
+    atomic<uint64_t> runningTransaction{1};   // Transação que recebe as operações em andamento
+    atomic<uint64_t> committedTransaction{0}; // Última transação durável
+    atomic<uint64_t> journalCommits{0};
+    atomic<uint64_t> journalBlocksLogged{0};
+    atomic<uint64_t> journalGroupedSyncs{0};
+    atomic<uint64_t> journalOverflows{0};
+    atomic<uint64_t> journalCheckpoints{0};
+    uint64_t journalReplayed = 0;
+
+    struct InodeUndo;
+
+    // Efeitos de uma operação em andamento que não passam pela cache, desfeitos se ela falhar
+    struct OpUndo
+    {
+        // Arquivo aberto cuja entrada mudou de posição no diretório (posição anterior)
+        struct Moved
+        {
+            u_int32_t indexBlock;
+            u_int32_t block;
+            u_int32_t slot;
+        };
+
+        vector<u_int32_t> allocated; // Blocos alocados (voltam a ficar livres se a operação falhar)
+        vector<u_int32_t> freed;     // Blocos liberados (só ficam livres quando a operação termina)
+        vector<u_int32_t> dirs;      // Diretórios cujo índice em memória foi alterado (recarregados do disco)
+        vector<Moved> moved;
+        vector<InodeUndo> files;     // Arquivos abertos em que a operação escreveu (estado anterior)
+    };
+
+    /**
+     * @brief Sistemas de arquivos em que a thread atual está dentro de uma operação (e os efeitos dela)
+     * 
+     */
+    static vector<pair<uint64_t, OpUndo *>> &threadOps()
+    {
+        thread_local vector<pair<uint64_t, OpUndo *>> active;
+        return active;
+    }
+
+    /**
+     * @brief Operação mais externa da thread atual neste sistema de arquivos
+     * 
+     * @return OpUndo* Efeitos da operação, ou nullptr fora de uma operação (ou sem o diário)
+     */
+    OpUndo *currentOp()
+    {
+        for (auto &op : threadOps())
+        {
+            if (op.first == instanceId)
+            {
+                return op.second;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Início de uma operação que altera metadados: espera o commit em andamento terminar de copiá-los
+     * Operações aninhadas da mesma thread não esperam (o commit estaria esperando por elas).
+     * 
+     * @param undo Efeitos da operação
+     * @return true se esta é a operação mais externa da thread
+     */
+    bool beginOp(OpUndo &undo)
+    {
+        if (!journalActive || currentOp() != nullptr)
+        {
+            return false;
+        }
+        {
+            unique_lock<mutex> guard(gateLock);
+            gateChanged.wait(guard, [&]
+                             { return !gateClosed; });
+            activeOps++;
+        }
+        threadOps().push_back({instanceId, &undo});
+        cache.beginUndo(superblock.bitmap_start + superblock.bitmap_blocks);
+        return true;
+    }
+
+    /**
+     * @brief Desfaz uma operação que falhou: os metadados que ela escreveu voltam ao conteúdo anterior, os blocos
+     * alocados voltam a ficar livres, os liberados continuam ocupados e os índices de diretório são recarregados.
+     * Sem isso, o próximo commit gravaria no diário a operação pela metade.
+     * 
+     * @param undo Efeitos da operação
+     */
+    void rollbackOp(OpUndo &undo)
+    {
+        u_int32_t lost = cache.endUndo(true);
+        if (lost > 0)
+        {
+            cerr << "Operação desfeita em parte: " << lost << " bloco(s) de metadados já alterado(s)" << endl;
+        }
+        // O índice em memória dos arquivos abertos não pode apontar para os blocos que voltam a ficar livres
+        for (InodeUndo &saved : undo.files)
+        {
+            unique_lock<shared_mutex> guard(saved.inode->lock);
+            restoreInode(saved);
+        }
+        undo.files.clear();
+        {
+            lock_guard<mutex> guard(openFilesLock);
+            for (auto it = undo.moved.rbegin(); it != undo.moved.rend(); ++it)
+            {
+                auto open = inodes.find(it->indexBlock);
+                if (open != inodes.end())
+                {
+                    open->second->loc = {it->block, it->slot};
+                }
+            }
+        }
+        vector<u_int32_t> allocated;
+        allocated.swap(undo.allocated);
+        undo.freed.clear();
+        if (!allocated.empty())
+        {
+            releaseBlocks(allocated);
+        }
+
+        sort(undo.dirs.begin(), undo.dirs.end());
+        undo.dirs.erase(unique(undo.dirs.begin(), undo.dirs.end()), undo.dirs.end());
+        for (u_int32_t dirIndexBlock : undo.dirs)
+        {
+            shared_ptr<DirIndex> dir = openDirIndex(dirIndexBlock);
+            unique_lock<shared_mutex> guard(dir->lock);
+            if (!dir->removed)
+            {
+                loadDirIndex(*dir);
+            }
+        }
+        if (!undo.dirs.empty())
+        {
+            invalidateDentries("", true);
+        }
+    }
+
+    /**
+     * @brief Fim da operação mais externa; com muitos metadados presos na cache, faz um commit
+     * 
+     * @param undo Efeitos da operação
+     * @param failed true se a operação terminou com uma exceção (é desfeita)
+     */
+    void endOp(OpUndo &undo, bool failed)
+    {
+        vector<pair<uint64_t, OpUndo *>> &active = threadOps();
+        try
+        {
+            if (failed)
+            {
+                rollbackOp(undo);
+            }
+            else
+            {
+                cache.endUndo(false);
+                if (!undo.freed.empty())
+                {
+                    releaseBlocks(undo.freed);
+                }
+            }
+        }
+        catch (...)
+        {
+            cache.endUndo(false);
+            active.erase(find(active.begin(), active.end(), make_pair(instanceId, &undo)));
+            lock_guard<mutex> guard(gateLock);
+            if (--activeOps == 0 && gateClosed)
+            {
+                gateChanged.notify_all();
+            }
+            throw;
+        }
+        active.erase(find(active.begin(), active.end(), make_pair(instanceId, &undo)));
+        {
+            lock_guard<mutex> guard(gateLock);
+            if (--activeOps == 0 && gateClosed)
+            {
+                gateChanged.notify_all();
+            }
+        }
+        if (cache.journaledFrames >= journalThreshold)
+        {
+            commitJournal();
+        }
+    }
+
+    // Operação que altera metadados (deve ser criada antes de qualquer trava): um commit nunca copia
+    // os metadados de uma operação pela metade. Se a operação sai por uma exceção, ela é desfeita.
+    struct JournalOp
+    {
+        SizedFileSystem &fs;
+        OpUndo undo;
+        int exceptions; // Exceções em andamento na criação (a operação falhou se houver mais na destruição)
+        bool outer;
+
+        explicit JournalOp(SizedFileSystem &fileSystem)
+            : fs(fileSystem), exceptions(uncaught_exceptions()), outer(fileSystem.beginOp(undo)) {}
+
+        ~JournalOp()
+        {
+            if (!outer)
+            {
+                return;
+            }
+            try
+            {
+                fs.endOp(undo, uncaught_exceptions() > exceptions);
+            }
+            catch (const exception &e)
+            {
+                cerr << "Erro no commit do diário: " << e.what() << endl;
+            }
+        }
+    };
+
+    /**
+     * @brief Fecha a passagem para novas operações e espera as que estão em andamento terminarem
+     * 
+     */
+    void closeGate()
+    {
+        unique_lock<mutex> guard(gateLock);
+        gateClosed = true;
+        gateChanged.wait(guard, [&]
+                         { return activeOps == 0; });
+    }
+
+    void openGate()
+    {
+        lock_guard<mutex> guard(gateLock);
+        gateClosed = false;
+        gateChanged.notify_all();
+    }
+
+    /**
+     * @brief Torna duráveis todas as operações concluídas (commit em grupo)
+     * Os metadados alterados são copiados sem nenhuma operação em andamento; depois as operações continuam
+     * enquanto os dados sujos, a transação e um único fdatasync vão para o disco. Quem chega durante um commit
+     * espera e, se as suas operações já entraram no commit seguinte feito por outra thread, retorna sem escrever nada.
+     * 
+     */
+    void commitJournal()
+    {
+        uint64_t target = runningTransaction;
+        lock_guard<mutex> commitGuard(commitLock);
+        if (committedTransaction >= target)
+        {
+            journalGroupedSyncs++;
+            return;
+        }
+
+        vector<u_int32_t> blocks, revokes;
+        vector<uint64_t> versions;
+        vector<char> images;
+        uint64_t transaction;
+        closeGate();
+        try
+        {
+            writeAllocMetadata();
+            cache.captureJournaled(blocks, versions, images);
+            cache.takeSpilled(revokes);
+            lock_guard<mutex> guard(journalStateLock);
+            for (u_int32_t block : revokes)
+            {
+                checkpointImages.erase(block); // Já escrito no lugar com um conteúdo mais novo
+            }
+            revokes.insert(revokes.end(), pendingRevokes.begin(), pendingRevokes.end());
+            pendingRevokes.clear();
+            journaledBlocks.insert(blocks.begin(), blocks.end());
+        }
+        catch (...)
+        {
+            openGate();
+            throw;
+        }
+        transaction = runningTransaction++;
+        openGate();
+
+        sort(revokes.begin(), revokes.end());
+        revokes.erase(unique(revokes.begin(), revokes.end()), revokes.end());
+        // Dados antes do registro de commit: um bloco recém-alocado não aparece com o conteúdo antigo
+        cache.flush();
+        bool logged = true;
+        if (blocks.empty() && revokes.empty())
+        {
+            diskManager.sync();
+        }
+        else
+        {
+            logged = writeTransaction(blocks, images, revokes);
+        }
+        if (logged)
+        {
+            // Blocos liberados depois da cópia não podem voltar ao lugar no checkpoint
+            lock_guard<mutex> guard(journalStateLock);
+            unordered_set<u_int32_t> freed(pendingRevokes.begin(), pendingRevokes.end());
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                if (freed.count(blocks[i]) == 0)
+                {
+                    const char *image = images.data() + i * BLOCK_SIZE;
+                    checkpointImages[blocks[i]].assign(image, image + BLOCK_SIZE);
+                }
+            }
+        }
+        cache.commitFrames(blocks, versions, logged);
+        committedTransaction = transaction;
+        journalCommits++;
+    }
+
+    /**
+     * @brief Escreve uma transação no diário com uma única escrita e a torna durável com um fdatasync
+     * Sem espaço até o fim do diário, os commits anteriores passam por um checkpoint e ele recomeça do início.
+     * 
+     * @param blocks Blocos de destino, em ordem crescente
+     * @param images Conteúdo dos blocos
+     * @param revokes Blocos liberados cujas cópias anteriores não devem ser reaplicadas
+     * @return false se a transação não coube no diário e foi escrita direto no lugar
+     */
+    bool writeTransaction(const vector<u_int32_t> &blocks, const vector<char> &images, const vector<u_int32_t> &revokes)
+    {
+        const u_int32_t perRecord = (BLOCK_SIZE - sizeof(JournalRecord)) / sizeof(uint32_t);
+        u_int32_t descriptors = (blocks.size() + perRecord - 1) / perRecord;
+        u_int32_t revokeRecords = (revokes.size() + perRecord - 1) / perRecord;
+        uint64_t length = (uint64_t)descriptors + blocks.size() + revokeRecords + 1;
+        if (length > superblock.journal_blocks - 1)
+        {
+            // Transação maior que o diário: os blocos vão direto para o lugar e o diário é invalidado
+            journalOverflows++;
+            checkpointJournal();
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                diskManager.writeBlock(blocks[i], images.data() + i * BLOCK_SIZE);
+            }
+            diskManager.sync();
+            resetJournal();
+            diskManager.sync();
+            return false;
+        }
+        if (journalHead + length > superblock.journal_blocks)
+        {
+            // Os blocos das transações anteriores precisam estar duráveis no lugar antes de serem sobrescritos
+            checkpointJournal();
+            diskManager.sync();
+            resetJournal(blocks);
+        }
+
+        vector<char> buffer(length * BLOCK_SIZE, 0);
+        char *out = buffer.data();
+        auto writeRecord = [&](uint32_t type, const u_int32_t *targets, uint32_t count)
+        {
+            JournalRecord record(type, journalSequence, count);
+            memcpy(out, (const void *)&record, sizeof(JournalRecord));
+            memcpy(out + sizeof(JournalRecord), targets, (size_t)count * sizeof(uint32_t));
+            out += BLOCK_SIZE;
+        };
+        for (size_t first = 0; first < blocks.size(); first += perRecord)
+        {
+            uint32_t count = getMin<size_t>(perRecord, blocks.size() - first);
+            writeRecord(JOURNAL_DESCRIPTOR, blocks.data() + first, count);
+            memcpy(out, images.data() + first * BLOCK_SIZE, (size_t)count * BLOCK_SIZE);
+            out += (size_t)count * BLOCK_SIZE;
+        }
+        for (size_t first = 0; first < revokes.size(); first += perRecord)
+        {
+            writeRecord(JOURNAL_REVOKE, revokes.data() + first, getMin<size_t>(perRecord, revokes.size() - first));
+        }
+        JournalRecord commit(JOURNAL_COMMIT, journalSequence, length - 1);
+        commit.checksum = crc32(buffer.data(), (length - 1) * BLOCK_SIZE);
+        memcpy(out, (const void *)&commit, sizeof(JournalRecord));
+
+        diskManager.writeBlocks(superblock.journal_start + journalHead, length, buffer.data());
+        diskManager.sync();
+        journalHead += length;
+        journalSequence++;
+        journalBlocksLogged += blocks.size();
+        return true;
+    }
+
+    /**
+     * @brief Escreve no lugar as últimas cópias duráveis dos blocos do diário (sem fdatasync)
+     * 
+     */
+    void checkpointJournal()
+    {
+        lock_guard<mutex> guard(journalStateLock);
+        if (checkpointImages.empty())
+        {
+            return;
+        }
+        cache.checkpoint(checkpointImages);
+        checkpointImages.clear();
+        journalCheckpoints++;
+    }
+
+    /**
+     * @brief Recomeça o diário: o cabeçalho passa a esperar journalSequence logo na primeira posição
+     * Os blocos das transações anteriores já precisam estar duráveis no lugar.
+     * 
+     * @param keep Blocos da transação que será escrita logo em seguida no diário
+     */
+    void resetJournal(const vector<u_int32_t> &keep = {})
+    {
+        char buffer[BLOCK_SIZE];
+        memset(buffer, 0x00, BLOCK_SIZE);
+        JournalRecord header(JOURNAL_HEADER, journalSequence, superblock.journal_blocks);
+        header.checksum = crc32(&header, sizeof(JournalRecord));
+        memcpy(buffer, (const void *)&header, sizeof(JournalRecord));
+        diskManager.writeBlock(superblock.journal_start, buffer);
+        journalHead = 1;
+        lock_guard<mutex> guard(journalStateLock);
+        journaledBlocks.clear();
+        journaledBlocks.insert(keep.begin(), keep.end());
+    }
+
+    /**
+     * @brief Registra revogações para blocos liberados que têm cópias no diário: se o bloco for reutilizado
+     * para dados, a cópia antiga não pode ser reaplicada por cima deles depois de uma queda (nem no checkpoint).
+     * Chamado antes de os blocos voltarem ao bitmap.
+     * 
+     * @param blocks Blocos liberados
+     */
+    void revokeFreed(const vector<u_int32_t> &blocks)
+    {
+        if (!journalActive)
+        {
+            return;
+        }
+        cache.discardJournaled(blocks);
+        lock_guard<mutex> guard(journalStateLock);
+        for (u_int32_t block : blocks)
+        {
+            if (journaledBlocks.count(block) > 0)
+            {
+                pendingRevokes.push_back(block);
+            }
+            checkpointImages.erase(block);
+        }
+    }
+
+    /**
+     * @brief Reaplica no lugar as transações completas do diário (montagem depois de uma queda) e recomeça o diário
+     * Uma transação só conta se todos os seus registros tiverem a sequência esperada e o checksum do commit
+     * conferir; a primeira que falhar (escrita interrompida pela queda) encerra a leitura.
+     * 
+     * @return u_int32_t Número de transações reaplicadas
+     */
+    u_int32_t replayJournal()
+    {
+        const u_int32_t perRecord = (BLOCK_SIZE - sizeof(JournalRecord)) / sizeof(uint32_t);
+        const u_int32_t journalEnd = superblock.journal_blocks;
+        vector<char> block(BLOCK_SIZE);
+        JournalRecord header;
+        diskManager.readBlock(superblock.journal_start, block.data());
+        memcpy((void *)&header, block.data(), sizeof(JournalRecord));
+        uint32_t stored = header.checksum;
+        header.checksum = 0;
+        if (header.magic != JOURNAL_MAGIC || header.type != JOURNAL_HEADER || header.count != journalEnd ||
+            crc32(&header, sizeof(JournalRecord)) != stored)
+        {
+            throw runtime_error("Cabeçalho do diário de metadados inválido!");
+        }
+
+        // Transações completas: destinos e cópias, e a última transação que revogou cada bloco
+        struct Replay
+        {
+            uint32_t sequence;
+            vector<u_int32_t> targets;
+            vector<char> images;
+        };
+        vector<Replay> transactions;
+        unordered_map<u_int32_t, uint32_t> revoked;
+        uint32_t sequence = header.sequence;
+        u_int32_t pos = 1;
+        while (pos < journalEnd)
+        {
+            Replay txn{sequence, {}, {}};
+            vector<u_int32_t> txnRevokes;
+            uint32_t crc = 0;
+            u_int32_t p = pos;
+            bool committed = false;
+            while (p < journalEnd)
+            {
+                diskManager.readBlock(superblock.journal_start + p, block.data());
+                JournalRecord record;
+                memcpy((void *)&record, block.data(), sizeof(JournalRecord));
+                if (record.magic != JOURNAL_MAGIC || record.sequence != sequence)
+                {
+                    break;
+                }
+                if (record.type == JOURNAL_COMMIT)
+                {
+                    committed = record.count == p - pos && record.checksum == crc;
+                    p++;
+                    break;
+                }
+                if ((record.type != JOURNAL_DESCRIPTOR && record.type != JOURNAL_REVOKE) || record.count > perRecord ||
+                    (record.type == JOURNAL_DESCRIPTOR && p + 1 + record.count > journalEnd))
+                {
+                    break;
+                }
+                crc = crc32(block.data(), BLOCK_SIZE, crc);
+                const uint32_t *targets = reinterpret_cast<const uint32_t *>(block.data() + sizeof(JournalRecord));
+                vector<u_int32_t> &list = record.type == JOURNAL_REVOKE ? txnRevokes : txn.targets;
+                list.insert(list.end(), targets, targets + record.count);
+                p++;
+                if (record.type == JOURNAL_DESCRIPTOR)
+                {
+                    size_t offset = txn.images.size();
+                    txn.images.resize(offset + (size_t)record.count * BLOCK_SIZE);
+                    diskManager.readBlocks(superblock.journal_start + p, record.count, txn.images.data() + offset);
+                    crc = crc32(txn.images.data() + offset, (size_t)record.count * BLOCK_SIZE, crc);
+                    p += record.count;
+                }
+            }
+            if (!committed)
+            {
+                break;
+            }
+            for (u_int32_t target : txn.targets)
+            {
+                if (target >= superblock.total_blocks)
+                {
+                    throw runtime_error("Diário de metadados inválido: bloco fora do disco!");
+                }
+            }
+            for (u_int32_t target : txnRevokes)
+            {
+                revoked[target] = sequence;
+            }
+            transactions.push_back(move(txn));
+            pos = p;
+            sequence++;
+        }
+
+        // Reaplicar em ordem; a revogação feita por uma transação posterior cancela as cópias anteriores do bloco
+        for (const Replay &txn : transactions)
+        {
+            for (size_t i = 0; i < txn.targets.size(); i++)
+            {
+                auto it = revoked.find(txn.targets[i]);
+                if (it == revoked.end() || it->second <= txn.sequence)
+                {
+                    diskManager.writeBlock(txn.targets[i], txn.images.data() + i * BLOCK_SIZE);
+                }
+            }
+        }
+        journalSequence = sequence;
+        journalHead = 1;
+        if (!transactions.empty())
+        {
+            diskManager.sync();
+            resetJournal();
+            diskManager.sync();
+        }
+        return transactions.size();
+    }
+
+    /**
+     * @brief Ativa o diário depois da formatação ou da montagem (somente com a cache de blocos)
+     * 
+     */
+    void startJournal()
+    {
+        journalActive = superblock.journal_blocks > 0 && cache.frameCount() > 0;
+        cache.setJournaling(journalActive);
+        // Um commit por quarto da cache ou do diário: uma transação sempre cabe no diário com folga
+        journalThreshold = getMax<u_int32_t>(1, getMin<u_int32_t>(cache.frameCount() / 4, (superblock.journal_blocks - 1) / 4));
+    }
+
+    /**
+     * @brief Le um bloco de índice do disco
+     * 
+     * @param blockIndex indice do bloco de índice
+     * @param ib Bloco de índice de destino
+     */
+    void readIndexBlock(u_int32_t blockIndex, IndexBlock &ib)
+    {
+        cache.readStruct(blockIndex, ib);
+    }
+
+    // Bloco de índice visto no lugar (cache ou imagem mapeada); o quadro fica preso enquanto a vista existir
+    struct IndexView
+    {
+        BlockRef ref;
+
+        const IndexBlock *operator->() const
+        {
+            return reinterpret_cast<const IndexBlock *>(ref.data());
+        }
+
+        const IndexBlock &operator*() const
+        {
+            return *operator->();
+        }
+    };
+
+    /**
+     * @brief Retorna um bloco de índice no lugar (cache ou imagem mapeada), sem cópia
+     * 
+     * @param blockIndex indice do bloco de índice
+     */
+    IndexView viewIndexBlock(u_int32_t blockIndex)
+    {
+        return IndexView{cache.pin(blockIndex)};
+    }
+
+    /**
+     * @brief Escreve um bloco de índice no disco
+     * 
+     * @param blockIndex indice do bloco de índice
+     * @param ib Bloco de índice a ser escrito
+     */
+    void writeIndexBlock(u_int32_t blockIndex, const IndexBlock &ib)
+    {
+        cache.writeMetadata(blockIndex, reinterpret_cast<const char *>(&ib));
+    }
+
+    /**
+     * @brief Lista os arquivos em um diretório
+     * 
+     * @param dirIndexBlock
+     * @param path 
+     */
+    void listFilesInDirectory(uint32_t dirIndexBlock, string path)
+    {
+        // Ordenar as entradas pelo nome para uma listagem estável
+        vector<pair<string, DirIndexEntry>> entries;
+        shared_ptr<DirIndex> dir = openDirIndex(dirIndexBlock);
+        {
+            shared_lock<shared_mutex> guard(dir->lock);
+            dirEntries(*dir, entries);
+        }
+        sort(entries.begin(), entries.end(), [](const pair<string, DirIndexEntry> &a, const pair<string, DirIndexEntry> &b)
+             { return a.first < b.first; });
+
+        for (const auto &item : entries)
+        {
+            const DirIndexEntry &entry = item.second;
+            string fullPath = path + "/" + item.first;
+            cout << "Filename: " << fullPath << ", Type: " << fileTypeName(entry.file_type) << ", Index Block: " << entry.index_block << endl;
+            if (entry.file_type == '2') // Se for um diretório, listar recursivamente
+            {
+                listFilesInDirectory(entry.index_block, fullPath);
+            }
+        }
+    }
+
+    // Posição de uma entrada de diretório no disco
+    struct DirSlot
+    {
+        u_int32_t block; // Bloco que contém a entrada
+        u_int32_t slot;  // Posição da entrada dentro do bloco
+    };
+
+    // Entrada do índice de nomes de um diretório (evita ler o disco em um acerto)
+    struct DirIndexEntry
+    {
+        DirSlot loc;
+        char file_type;
+        u_int32_t index_block;
+    };
+
+    // Índice em memória de um diretório, construído na primeira vez que o diretório é aberto.
+    // A trava é compartilhada nas consultas e exclusiva em qualquer alteração das entradas do diretório.
+    // Um diretório com índice por hash não guarda os nomes em memória: cada consulta desce o índice no disco.
+    struct DirIndex
+    {
+        shared_mutex lock;
+        bool removed = false;       // Diretório apagado: quem ainda guarda o índice não deve usá-lo
+        bool hashed = false;        // Índice por hash (names e freeSlots ficam vazios)
+        u_int32_t indexBlock;       // Bloco de índice do diretório (raiz do índice por hash)
+        unordered_map<string, DirIndexEntry> names;
+        vector<DirSlot> freeSlots;  // Entradas vazias já alocadas
+        u_int32_t tailIndexBlock;   // Último bloco de índice da cadeia do diretório
+    };
+
+    unordered_map<u_int32_t, shared_ptr<DirIndex>> dirIndexes; // bloco de índice do diretório -> índice de nomes
+    mutex dirIndexesLock;
+    uint64_t dirIndexesEpoch = 0; // Índices descartados do mapa (protegido por dirIndexesLock)
+    shared_mutex namespaceLock; // Exclusiva somente na renomeação, que altera dois diretórios e caminhos inteiros
+
+    /**
+     * @brief Número de entradas guardadas em cada bloco de entradas do diretório
+     * O diretório raiz guarda as entradas no próprio bloco (que também é o seu bloco de índice). Subdiretórios
+     * enchem cada bloco de entradas a partir da versão 4; nos discos anteriores, guardam uma entrada por bloco.
+     * Uma entrada livre tem o nome vazio; as livres de cada diretório ficam em DirIndex::freeSlots.
+     * 
+     * @param dirIndexBlock Bloco de índice do diretório
+     */
+    u_int32_t entriesPerBlock(u_int32_t dirIndexBlock)
+    {
+        return dirIndexBlock == superblock.root_dir_index || superblock.version >= 4 ? BLOCK_SIZE / ENTRY_SIZE : 1;
+    }
+
+    /**
+     * @brief Le uma entrada de diretório
+     * 
+     * @param loc Posição da entrada
+     */
+    RootDirEntry readEntry(DirSlot loc)
+    {
+        RootDirEntry entry;
+        BlockRef block = cache.pin(loc.block);
+        memcpy((void *)&entry, block.data() + loc.slot * ENTRY_SIZE, sizeof(RootDirEntry));
+        return entry;
+    }
+
+    /**
+     * @brief Escreve uma entrada de diretório, preservando as demais entradas do bloco
+     * Deve ser chamado com a trava exclusiva do diretório (o bloco é lido, alterado e reescrito).
+     * 
+     * @param loc Posição da entrada
+     * @param entry Entrada a ser escrita
+     */
+    void writeEntry(DirSlot loc, const RootDirEntry &entry)
+    {
+        char buffer[BLOCK_SIZE];
+        cache.readBlock(loc.block, buffer);
+        memcpy(buffer + loc.slot * ENTRY_SIZE, (const void *)&entry, sizeof(RootDirEntry));
+        cache.writeMetadata(loc.block, buffer);
+    }
+
+    /**
+     * @brief Le uma lista de blocos em lotes de até 1 MiB, enviando juntas pela fila assíncrona todas as leituras
+     * de um lote (blocos vizinhos na lista e no disco formam uma só leitura), e entrega cada bloco na ordem da lista
+     * 
+     * @param blocks Blocos a serem lidos
+     * @param visit Chamada com (bloco, conteúdo) para cada bloco
+     */
+    template <typename Visit>
+    void scanBlocks(const vector<u_int32_t> &blocks, Visit visit)
+    {
+        const size_t batch = getMax<size_t>(1, (1 << 20) / BLOCK_SIZE);
+        vector<char> buffer(getMin<size_t>(batch, blocks.size()) * BLOCK_SIZE);
+        vector<ReadPlan::DiskRead> reads;
+        for (size_t first = 0; first < blocks.size(); first += batch)
+        {
+            size_t count = getMin<size_t>(batch, blocks.size() - first);
+            reads.clear();
+            for (size_t i = 0; i < count; i++)
+            {
+                off_t offset = (off_t)blocks[first + i] * BLOCK_SIZE;
+                if (!reads.empty() && offset == reads.back().offset + (off_t)reads.back().iov[0].iov_len)
+                {
+                    reads.back().iov[0].iov_len += BLOCK_SIZE;
+                    continue;
+                }
+                ReadPlan::DiskRead read;
+                read.offset = offset;
+                read.iov[0] = {buffer.data() + i * BLOCK_SIZE, BLOCK_SIZE};
+                read.iovcnt = 1;
+                reads.push_back(read);
+            }
+            cache.readBlocksDirect(reads);
+            for (size_t i = 0; i < count; i++)
+            {
+                visit(blocks[first + i], buffer.data() + i * BLOCK_SIZE);
+            }
+        }
+    }
+
+    /**
+     * @brief Retorna o índice de nomes do diretório, construindo-o na primeira chamada
+     * As entradas são lidas fora da trava do mapa, para que outros diretórios não esperem por elas. Se outra thread
+     * publicar o mesmo diretório antes, o índice lido aqui é descartado; se algum índice foi descartado do mapa durante
+     * a leitura (dirIndexesEpoch), ela pode ter visto um diretório apagado e é refeita.
+     * 
+     * @param dirIndexBlock Bloco de índice do diretório
+     * @return shared_ptr<DirIndex> Índice do diretório
+     */
+    shared_ptr<DirIndex> openDirIndex(u_int32_t dirIndexBlock)
+    {
+        while (true)
+        {
+            uint64_t epoch;
+            {
+                lock_guard<mutex> guard(dirIndexesLock);
+                auto it = dirIndexes.find(dirIndexBlock);
+                if (it != dirIndexes.end())
+                {
+                    return it->second;
+                }
+                epoch = dirIndexesEpoch;
+            }
+
+            shared_ptr<DirIndex> created = make_shared<DirIndex>();
+            created->indexBlock = dirIndexBlock;
+            loadDirIndex(*created);
+
+            lock_guard<mutex> guard(dirIndexesLock);
+            auto it = dirIndexes.find(dirIndexBlock);
+            if (it != dirIndexes.end())
+            {
+                return it->second;
+            }
+            if (epoch == dirIndexesEpoch)
+            {
+                dirIndexes.emplace(dirIndexBlock, created);
+                return created;
+            }
+        }
+    }
+
+    /**
+     * @brief Lê do disco as entradas de um diretório para o seu índice em memória (substitui o conteúdo anterior)
+     * Uma entrada com o nome sem o \0 (corrompida) não é carregada nem reutilizada: o fsck a remove.
+     * 
+     * @param dir Índice do diretório (travado pelo chamador, ou ainda não publicado)
+     */
+    void loadDirIndex(DirIndex &dir)
+    {
+        u_int32_t dirIndexBlock = dir.indexBlock;
+        dir.hashed = false;
+        dir.names.clear();
+        dir.freeSlots.clear();
+        dir.tailIndexBlock = dirIndexBlock;
+        vector<u_int32_t> entryBlocks;
+        if (dirIndexBlock == superblock.root_dir_index)
+        {
+            entryBlocks.push_back(dirIndexBlock);
+        }
+        else if (viewIndexBlock(dirIndexBlock)->indirect_ptr == INDEX_HASHED)
+        {
+            dir.hashed = true; // Nada a carregar: as consultas descem o índice
+        }
+        else
+        {
+            u_int32_t current = dirIndexBlock;
+            while (current != 0xFFFFFFFF)
+            {
+                dir.tailIndexBlock = current;
+                IndexView ib = viewIndexBlock(current);
+                for (auto ptr : ib->block_ptrs)
+                {
+                    if (ptr != 0xFFFFFFFF)
+                    {
+                        entryBlocks.push_back(ptr);
+                    }
+                }
+                current = ib->indirect_ptr;
+            }
+        }
+
+        u_int32_t perBlock = entriesPerBlock(dirIndexBlock);
+        scanBlocks(entryBlocks, [&](u_int32_t block, const char *data)
+                   {
+                       const RootDirEntry *entries = reinterpret_cast<const RootDirEntry *>(data);
+                       for (u_int32_t slot = 0; slot < perBlock; slot++)
+                       {
+                           if (entries[slot].filename[0] == '\0')
+                           {
+                               dir.freeSlots.push_back({block, slot});
+                           }
+                           else if (entries[slot].nameTerminated())
+                           {
+                               dir.names[entries[slot].name()] = {{block, slot}, entries[slot].file_type, entries[slot].index_block};
+                           }
+                       } });
+    }
+
+    /**
+     * @brief Procura um nome em um diretório usando o índice de nomes
+     * 
+     * @param dirIndexBlock Bloco de índice do diretório
+     * @param name Nome procurado
+     * @param found Recebe uma cópia da entrada encontrada
+     * @return true se o nome existe no diretório
+     */
+    bool lookupEntry(u_int32_t dirIndexBlock, const string &name, DirIndexEntry &found)
+    {
+        shared_ptr<DirIndex> dir = openDirIndex(dirIndexBlock);
+        shared_lock<shared_mutex> guard(dir->lock);
+        return !dir->removed && dirFind(*dir, name, found);
+    }
+
+    /**
+     * @brief Confirma, com a trava do diretório já obtida, que o caminho resolvido ainda está no diretório
+     * A resolução é feita sem travas e o arquivo pode ter sido removido ou renomeado desde então.
+     * 
+     * @param dir Índice do diretório (travado pelo chamador)
+     * @param fullPath Caminho normalizado do arquivo
+     * @param found Recebe a entrada atual
+     * @return true se a entrada ainda existe
+     */
+    bool relockEntry(DirIndex &dir, const string &fullPath, DirIndexEntry &found)
+    {
+        return !dir.removed && dirFind(dir, fullPath.substr(fullPath.rfind('/') + 1), found);
+    }
+
+    // Entrada da cache de dentries: resultado (positivo ou negativo) da resolução de um caminho
+    struct Dentry
+    {
+        bool exists;          // false para entradas negativas (caminho inexistente)
+        u_int32_t parentDir;  // Bloco de índice do diretório que contém a entrada
+        DirIndexEntry entry;  // Válido somente se exists
+    };
+
+    unordered_map<string, Dentry> dentries; // caminho normalizado -> resultado da resolução
+    mutex dentryLock;                 // Protege a cache de dentries e seus contadores
+    uint64_t dentryGeneration = 0;    // Incrementado a cada invalidação (descarta resoluções concorrentes)
+    uint64_t dentryHits = 0;          // Resoluções completas atendidas pela cache
+    uint64_t dentryNegativeHits = 0;  // Acertos em entradas negativas
+    uint64_t dentryMisses = 0;        // Componentes que precisaram ser procurados no diretório
+    uint64_t dentryInvalidations = 0; // Entradas removidas por criação/remoção/renomeação
+
+    /**
+     * @brief Normaliza um caminho: começa com '/', sem '/' repetidas e sem '/' no final
+     * Caminhos relativos ("a/b" ou "./a") são interpretados a partir da raiz.
+     * 
+     * @param path Caminho
+     * @return string Caminho normalizado ("/" para a raiz)
+     */
+    static string normalizePath(const string &path)
+    {
+        string normalized;
+        size_t i = 0;
+        while (i < path.size())
+        {
+            size_t next = path.find('/', i);
+            if (next == string::npos)
+            {
+                next = path.size();
+            }
+            string component = path.substr(i, next - i);
+            if (!component.empty() && component != ".")
+            {
+                normalized += "/" + component;
+            }
+            i = next + 1;
+        }
+        return normalized.empty() ? "/" : normalized;
+    }
+
+    /**
+     * @brief Guarda uma resolução na cache de dentries, esvaziando-a se estiver cheia
+     * Deve ser chamado com dentryLock.
+     * 
+     */
+    void cacheDentry(const string &path, const Dentry &dentry)
+    {
+        if (dentries.size() >= DENTRY_CACHE_CAPACITY)
+        {
+            dentries.clear();
+        }
+        dentries[path] = dentry;
+    }
+
+    /**
+     * @brief Remove da cache de dentries um caminho e, se indicado, todos os caminhos abaixo dele
+     * 
+     * @param path Caminho normalizado
+     * @param descendants Se true, remove também os caminhos que começam com path + "/"
+     */
+    void invalidateDentries(const string &path, bool descendants)
+    {
+        lock_guard<mutex> guard(dentryLock);
+        dentryGeneration++;
+        dentryInvalidations += dentries.erase(path);
+        if (!descendants)
+        {
+            return;
+        }
+        string prefix = path + "/";
+        for (auto it = dentries.begin(); it != dentries.end();)
+        {
+            if (it->first.compare(0, prefix.size(), prefix) == 0)
+            {
+                it = dentries.erase(it);
+                dentryInvalidations++;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    /**
+     * @brief Resolve um caminho (/a/b/c) a partir da raiz, em qualquer profundidade
+     * Cada prefixo resolvido é guardado na cache de dentries (inclusive os inexistentes),
+     * então aberturas repetidas do mesmo caminho não percorrem os diretórios.
+     * 
+     * @param path Caminho a ser resolvido
+     * @param parentDir Recebe o bloco de índice do diretório que contém a entrada
+     * @param found Recebe a entrada encontrada
+     * @return true se o caminho existe (a raiz não possui entrada e retorna false)
+     */
+    bool resolvePath(const string &path, u_int32_t &parentDir, DirIndexEntry &found)
+    {
+        string normalized = normalizePath(path);
+        {
+            lock_guard<mutex> guard(dentryLock);
+            auto cached = dentries.find(normalized);
+            if (cached != dentries.end())
+            {
+                cached->second.exists ? dentryHits++ : dentryNegativeHits++;
+                parentDir = cached->second.parentDir;
+                found = cached->second.entry;
+                return cached->second.exists;
+            }
+        }
+
+        u_int32_t currentDir = superblock.root_dir_index;
+        string prefix;
+        size_t i = 1;
+        while (i < normalized.size())
+        {
+            size_t next = normalized.find('/', i);
+            if (next == string::npos)
+            {
+                next = normalized.size();
+            }
+            string component = normalized.substr(i, next - i);
+            prefix += "/" + component;
+            i = next + 1;
+
+            Dentry dentry;
+            bool hit;
+            uint64_t generation = 0;
+            {
+                lock_guard<mutex> guard(dentryLock);
+                auto it = dentries.find(prefix);
+                hit = it != dentries.end();
+                if (hit)
+                {
+                    dentry = it->second;
+                }
+                else
+                {
+                    dentryMisses++;
+                    generation = dentryGeneration;
+                }
+            }
+            if (!hit)
+            {
+                dentry.exists = lookupEntry(currentDir, component, dentry.entry);
+                dentry.parentDir = currentDir;
+                // Uma invalidação durante a consulta pode ter tornado o resultado obsoleto
+                lock_guard<mutex> guard(dentryLock);
+                if (generation == dentryGeneration)
+                {
+                    cacheDentry(prefix, dentry);
+                }
+            }
+
+            if (!dentry.exists)
+            {
+                return false;
+            }
+            parentDir = currentDir;
+            found = dentry.entry;
+            if (i < normalized.size() && dentry.entry.file_type != '2')
+            {
+                return false; // Componente intermediário não é um diretório
+            }
+            currentDir = dentry.entry.index_block;
+        }
+        return normalized != "/";
+    }
+
+    /**
+     * @brief Procura um arquivo
+     * Nomes com '/' são resolvidos como caminhos; nomes simples são procurados no diretório raiz
+     * e, em seguida, nos diretórios da raiz.
+     * 
+     * @param name Nome ou caminho procurado
+     * @param dirIndexBlock Recebe o bloco de índice do diretório onde o arquivo foi encontrado
+     * @param found Recebe a entrada encontrada
+     * @param fullPath Recebe o caminho normalizado do arquivo encontrado
+     * @return true se o arquivo foi encontrado
+     */
+    bool findFile(const string &name, u_int32_t &dirIndexBlock, DirIndexEntry &found, string &fullPath)
+    {
+        if (name.find('/') != string::npos)
+        {
+            fullPath = normalizePath(name);
+            return resolvePath(fullPath, dirIndexBlock, found);
+        }
+
+        dirIndexBlock = superblock.root_dir_index;
+        if (lookupEntry(dirIndexBlock, name, found))
+        {
+            fullPath = "/" + name;
+            return true;
+        }
+
+        // Verificar se o arquivo está em um diretório
+        vector<pair<string, u_int32_t>> subdirs;
+        shared_ptr<DirIndex> root = openDirIndex(superblock.root_dir_index);
+        {
+            shared_lock<shared_mutex> guard(root->lock);
+            for (const auto &item : root->names)
+            {
+                if (item.second.file_type == '2')
+                {
+                    subdirs.push_back({item.first, item.second.index_block});
+                }
+            }
+        }
+        for (const auto &subdir : subdirs)
+        {
+            if (lookupEntry(subdir.second, name, found))
+            {
+                dirIndexBlock = subdir.second;
+                fullPath = "/" + subdir.first + "/" + name;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Obtém uma entrada livre no diretório, alocando um novo bloco de entradas se necessário
+     * Um subdiretório que chega a DIR_HASH_THRESHOLD entradas passa a usar o índice por hash.
+     * Deve ser chamado com a trava exclusiva do diretório.
+     * 
+     * @param dirIndexBlock Bloco de índice do diretório
+     * @param dir Índice do diretório
+     * @param name Nome que será criado (define a folha no índice por hash)
+     * @param loc Recebe a posição da entrada livre
+     * @return true se uma entrada livre foi obtida
+     */
+    bool takeFreeSlot(u_int32_t dirIndexBlock, DirIndex &dir, const string &name, DirSlot &loc)
+    {
+        noteDir(dir);
+        if (dir.hashed)
+        {
+            return hashedSlot(dir, name, loc);
+        }
+        if (!dir.freeSlots.empty())
+        {
+            loc = dir.freeSlots.back();
+            dir.freeSlots.pop_back();
+            return true;
+        }
+        if (dirIndexBlock == superblock.root_dir_index)
+        {
+            return false; // O diretório raiz tem um único bloco de entradas
+        }
+        if (superblock.version >= 4 && dir.names.size() >= DIR_HASH_THRESHOLD && convertToHashed(dir))
+        {
+            return hashedSlot(dir, name, loc);
+        }
+
+        // Adicionar um novo bloco de entradas ao fim da cadeia de blocos de índice
+        IndexBlock ib;
+        readIndexBlock(dir.tailIndexBlock, ib);
+        u_int32_t *freePtr = find(ib.block_ptrs, ib.block_ptrs + INDEX_PTRS, 0xFFFFFFFF);
+        vector<u_int32_t> blocks;
+        if (!allocBlocks(freePtr == ib.block_ptrs + INDEX_PTRS ? 2 : 1, blocks))
+        {
+            return false;
+        }
+
+        char buffer[BLOCK_SIZE];
+        memset(buffer, 0x00, BLOCK_SIZE);
+        cache.writeMetadata(blocks[0], buffer);
+        if (freePtr != ib.block_ptrs + INDEX_PTRS)
+        {
+            *freePtr = blocks[0];
+            writeIndexBlock(dir.tailIndexBlock, ib);
+        }
+        else
+        {
+            // Bloco de índice cheio: encadear um novo bloco de índice
+            ib.indirect_ptr = blocks[1];
+            writeIndexBlock(dir.tailIndexBlock, ib);
+            IndexBlock next;
+            next.block_ptrs[0] = blocks[0];
+            writeIndexBlock(blocks[1], next);
+            dir.tailIndexBlock = blocks[1];
+        }
+        // As demais entradas do bloco novo ficam livres (a próxima criação usa a de número 1)
+        for (u_int32_t slot = entriesPerBlock(dirIndexBlock) - 1; slot > 0; slot--)
+        {
+            dir.freeSlots.push_back({blocks[0], slot});
+        }
+        loc = {blocks[0], 0};
+        return true;
+    }
+
+    /**
+     * @brief Procura um nome no diretório (no índice de nomes ou, com índice por hash, no disco)
+     * Deve ser chamado com a trava do diretório.
+     * 
+     * @param dir Índice do diretório
+     * @param name Nome procurado
+     * @param found Recebe a entrada encontrada
+     * @return true se o nome existe no diretório
+     */
+    bool dirFind(DirIndex &dir, const string &name, DirIndexEntry &found)
+    {
+        if (dir.hashed)
+        {
+            return hashedFind(dir, name, found);
+        }
+        auto it = dir.names.find(name);
+        if (it == dir.names.end())
+        {
+            return false;
+        }
+        found = it->second;
+        return true;
+    }
+
+    /**
+     * @brief Registra no índice de nomes uma entrada recém-escrita na posição obtida por takeFreeSlot
+     * Deve ser chamado com a trava exclusiva do diretório.
+     */
+    void dirAdd(DirIndex &dir, const string &name, const DirIndexEntry &entry)
+    {
+        noteDir(dir);
+        if (!dir.hashed)
+        {
+            dir.names[name] = entry;
+        }
+    }
+
+    /**
+     * @brief Retira um nome do índice de nomes e devolve a sua posição às entradas livres
+     * Deve ser chamado com a trava exclusiva do diretório; com índice por hash, a entrada vazia escrita no disco basta.
+     */
+    void dirRemove(DirIndex &dir, const string &name, DirSlot loc)
+    {
+        noteDir(dir);
+        if (!dir.hashed)
+        {
+            dir.names.erase(name);
+            dir.freeSlots.push_back(loc);
+        }
+    }
+
+    /**
+     * @brief Registra na operação em andamento um diretório cujo índice em memória vai mudar (recarregado se ela falhar)
+     * 
+     */
+    void noteDir(const DirIndex &dir)
+    {
+        if (OpUndo *op = currentOp())
+        {
+            op->dirs.push_back(dir.indexBlock);
+        }
+    }
+
+    /**
+     * @brief Copia todas as entradas do diretório
+     * Deve ser chamado com a trava do diretório.
+     * 
+     * @param dir Índice do diretório
+     * @param entries Recebe (nome, entrada) de cada arquivo
+     */
+    void dirEntries(DirIndex &dir, vector<pair<string, DirIndexEntry>> &entries)
+    {
+        if (!dir.hashed)
+        {
+            entries.assign(dir.names.begin(), dir.names.end());
+            return;
+        }
+        vector<u_int32_t> nodes, leaves;
+        readHashed(dir.indexBlock, nodes, leaves);
+        u_int32_t perBlock = entriesPerBlock(dir.indexBlock);
+        scanBlocks(leaves, [&](u_int32_t block, const char *data)
+                   {
+                       const RootDirEntry *slots = reinterpret_cast<const RootDirEntry *>(data);
+                       for (u_int32_t slot = 0; slot < perBlock; slot++)
+                       {
+                           if (slots[slot].filename[0] != '\0' && slots[slot].nameTerminated())
+                           {
+                               entries.push_back({slots[slot].name(), {{block, slot}, slots[slot].file_type, slots[slot].index_block}});
+                           }
+                       } });
+    }
+
+    /**
+     * @brief Verifica se o diretório não tem nenhuma entrada
+     * Deve ser chamado com a trava do diretório.
+     */
+    bool dirEmpty(DirIndex &dir)
+    {
+        if (!dir.hashed)
+        {
+            return dir.names.empty();
+        }
+        vector<pair<string, DirIndexEntry>> entries;
+        dirEntries(dir, entries);
+        return entries.empty();
+    }
+
+    /*
+        Índice por hash dos diretórios (versão 4): a raiz é o próprio bloco de índice do diretório, cada nó guarda
+        pares (menor hash, bloco) em ordem e as folhas são blocos de entradas comuns. Todas as entradas com o mesmo
+        hash ficam na mesma folha, e uma consulta lê um nó por nível e uma única folha.
+    */
+
+    /**
+     * @brief Desce do nó raiz até a folha que cobre um hash
+     * 
+     * @param root Nó raiz (bloco de índice do diretório)
+     * @param hash Hash do nome
+     * @param path Recebe (nó, par seguido) de cada nível, a raiz primeiro (pode ser nullptr)
+     * @return u_int32_t Folha (bloco de entradas)
+     */
+    u_int32_t hashedLeaf(u_int32_t root, uint32_t hash, vector<pair<u_int32_t, u_int32_t>> *path)
+    {
+        u_int32_t current = root;
+        for (u_int32_t depth = 0; depth < DIR_HASH_MAX_DEPTH; depth++)
+        {
+            IndexView node = viewIndexBlock(current);
+            u_int32_t count = node->block_ptrs[1];
+            if (node->indirect_ptr != INDEX_HASHED || count == 0 || count > HASH_PAIRS)
+            {
+                break;
+            }
+            // Último par com menor hash <= hash (o primeiro par cobre o início do intervalo do nó)
+            u_int32_t low = 0, high = count;
+            while (high - low > 1)
+            {
+                u_int32_t middle = (low + high) / 2;
+                if (node->block_ptrs[2 + 2 * middle] <= hash)
+                {
+                    low = middle;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            u_int32_t child = node->block_ptrs[3 + 2 * low];
+            if (child >= superblock.total_blocks)
+            {
+                break;
+            }
+            if (path != nullptr)
+            {
+                path->push_back({current, low});
+            }
+            if (node->block_ptrs[0] == 0)
+            {
+                return child;
+            }
+            current = child;
+        }
+        throw runtime_error("Índice de diretório inválido!");
+    }
+
+    /**
+     * @brief Procura um nome em um diretório com índice por hash
+     */
+    bool hashedFind(DirIndex &dir, const string &name, DirIndexEntry &found)
+    {
+        u_int32_t leaf = hashedLeaf(dir.indexBlock, nameHash(name), nullptr);
+        BlockRef block = cache.pin(leaf);
+        const RootDirEntry *slots = reinterpret_cast<const RootDirEntry *>(block.data());
+        for (u_int32_t slot = 0, perBlock = entriesPerBlock(dir.indexBlock); slot < perBlock; slot++)
+        {
+            if (slots[slot].filename[0] != '\0' && strncmp(slots[slot].filename, name.c_str(), FILENAME_SIZE) == 0)
+            {
+                found = {{leaf, slot}, slots[slot].file_type, slots[slot].index_block};
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Obtém a posição de um nome novo em um diretório com índice por hash, dividindo a folha se estiver cheia
+     * Deve ser chamado com a trava exclusiva do diretório.
+     * 
+     * @param dir Índice do diretório
+     * @param name Nome que será criado
+     * @param loc Recebe a posição livre na folha que cobre o hash do nome
+     * @return true se uma entrada livre foi obtida
+     */
+    bool hashedSlot(DirIndex &dir, const string &name, DirSlot &loc)
+    {
+        uint32_t hash = nameHash(name);
+        u_int32_t perBlock = entriesPerBlock(dir.indexBlock);
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            vector<pair<u_int32_t, u_int32_t>> path;
+            u_int32_t leaf = hashedLeaf(dir.indexBlock, hash, &path);
+            {
+                BlockRef block = cache.pin(leaf);
+                const RootDirEntry *slots = reinterpret_cast<const RootDirEntry *>(block.data());
+                for (u_int32_t slot = 0; slot < perBlock; slot++)
+                {
+                    if (slots[slot].filename[0] == '\0')
+                    {
+                        loc = {leaf, slot};
+                        return true;
+                    }
+                }
+            }
+            if (attempt > 0 || !splitHashedLeaf(path, leaf))
+            {
+                break;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Divide uma folha cheia em duas, pelo hash mediano das entradas, e registra a nova folha no nó pai
+     * Os nós cheios no caminho também são divididos; se a raiz estiver cheia, o índice ganha um nível.
+     * Nomes com o mesmo CRC-32 nunca são separados: uma folha cheia só com um hash não se divide, então um diretório
+     * aceita no máximo entriesPerBlock nomes com o mesmo hash (o seguinte falha com "Diretório cheio!").
+     * 
+     * @param path Caminho da raiz até a folha (hashedLeaf)
+     * @param leaf Folha cheia
+     * @return false se todas as entradas têm o mesmo hash ou não há blocos livres
+     */
+    bool splitHashedLeaf(vector<pair<u_int32_t, u_int32_t>> &path, u_int32_t leaf)
+    {
+        u_int32_t perBlock = entriesPerBlock(path[0].first);
+        char buffer[BLOCK_SIZE];
+        cache.readBlock(leaf, buffer);
+        RootDirEntry *slots = reinterpret_cast<RootDirEntry *>(buffer);
+        vector<pair<uint32_t, u_int32_t>> order; // (hash, posição)
+        for (u_int32_t slot = 0; slot < perBlock; slot++)
+        {
+            order.push_back({nameHash(slots[slot].name()), slot});
+        }
+        sort(order.begin(), order.end());
+
+        // Ponto de divisão mais próximo do meio em que o hash muda
+        u_int32_t split = 0;
+        for (u_int32_t distance = 0; distance < perBlock && split == 0; distance++)
+        {
+            u_int32_t up = perBlock / 2 + distance, down = perBlock / 2 - getMin(distance, perBlock / 2);
+            if (up < perBlock && order[up].first != order[up - 1].first)
+            {
+                split = up;
+            }
+            else if (down > 0 && order[down].first != order[down - 1].first)
+            {
+                split = down;
+            }
+        }
+        if (split == 0)
+        {
+            return false;
+        }
+
+        // Blocos necessários: a folha nova e um por nó cheio no caminho (dois se a raiz também estiver cheia)
+        u_int32_t needed = 1;
+        for (size_t depth = path.size(); depth-- > 0;)
+        {
+            if (viewIndexBlock(path[depth].first)->block_ptrs[1] < HASH_PAIRS)
+            {
+                break;
+            }
+            needed += depth == 0 ? 2 : 1;
+        }
+        vector<u_int32_t> blocks;
+        if (!allocBlocks(needed, blocks))
+        {
+            return false;
+        }
+
+        char moved[BLOCK_SIZE];
+        memset(moved, 0x00, BLOCK_SIZE);
+        RootDirEntry *movedSlots = reinterpret_cast<RootDirEntry *>(moved);
+        for (u_int32_t i = split; i < perBlock; i++)
+        {
+            RootDirEntry &entry = slots[order[i].second];
+            movedSlots[i - split] = entry;
+            relocateEntry(entry.index_block, {blocks[0], i - split});
+            entry = RootDirEntry();
+        }
+        cache.writeMetadata(blocks[0], moved);
+        cache.writeMetadata(leaf, buffer);
+        insertHashedPair(path, path.size() - 1, order[split].first, blocks[0], blocks, 1);
+        return true;
+    }
+
+    /**
+     * @brief Insere o par (hash, bloco) no nó de um nível do caminho, logo após o par seguido pela descida
+     * 
+     * @param path Caminho da raiz até a folha
+     * @param depth Nível do nó no caminho
+     * @param hash Menor hash do novo filho
+     * @param child Novo filho
+     * @param blocks Blocos reservados para os nós que precisarem ser divididos
+     * @param nextBlock Próximo bloco reservado ainda não usado
+     */
+    void insertHashedPair(vector<pair<u_int32_t, u_int32_t>> &path, size_t depth, uint32_t hash, u_int32_t child,
+                          const vector<u_int32_t> &blocks, size_t nextBlock)
+    {
+        u_int32_t nodeBlock = path[depth].first;
+        IndexBlock node;
+        readIndexBlock(nodeBlock, node);
+        u_int32_t count = node.block_ptrs[1];
+        if (count >= HASH_PAIRS && depth == 0)
+        {
+            // Raiz cheia: o conteúdo dela desce para um nó novo, que é dividido como qualquer outro
+            u_int32_t lower = blocks[nextBlock++];
+            writeIndexBlock(lower, node);
+            node.block_ptrs[0]++;
+            node.block_ptrs[1] = 1;
+            node.block_ptrs[2] = 0;
+            node.block_ptrs[3] = lower;
+            writeIndexBlock(nodeBlock, node);
+            path.insert(path.begin() + 1, {lower, path[0].second});
+            path[0].second = 0;
+            insertHashedPair(path, 1, hash, child, blocks, nextBlock);
+            return;
+        }
+
+        vector<pair<u_int32_t, u_int32_t>> pairs;
+        for (u_int32_t i = 0; i < count; i++)
+        {
+            pairs.push_back({node.block_ptrs[2 + 2 * i], node.block_ptrs[3 + 2 * i]});
+        }
+        pairs.insert(pairs.begin() + path[depth].second + 1, {hash, child});
+        size_t keep = pairs.size() <= HASH_PAIRS ? pairs.size() : pairs.size() / 2;
+        node.block_ptrs[1] = keep;
+        for (size_t i = 0; i < keep; i++)
+        {
+            node.block_ptrs[2 + 2 * i] = pairs[i].first;
+            node.block_ptrs[3 + 2 * i] = pairs[i].second;
+        }
+        if (keep < pairs.size())
+        {
+            // Nó cheio: a metade superior dos pares vai para um irmão, registrado no nível de cima
+            IndexBlock sibling;
+            sibling.indirect_ptr = INDEX_HASHED;
+            sibling.block_ptrs[0] = node.block_ptrs[0];
+            sibling.block_ptrs[1] = pairs.size() - keep;
+            for (size_t i = keep; i < pairs.size(); i++)
+            {
+                sibling.block_ptrs[2 + 2 * (i - keep)] = pairs[i].first;
+                sibling.block_ptrs[3 + 2 * (i - keep)] = pairs[i].second;
+            }
+            fill(node.block_ptrs + 2 + 2 * keep, node.block_ptrs + INDEX_PTRS, 0xFFFFFFFF);
+            u_int32_t siblingBlock = blocks[nextBlock++];
+            writeIndexBlock(siblingBlock, sibling);
+            writeIndexBlock(nodeBlock, node);
+            insertHashedPair(path, depth - 1, pairs[keep].first, siblingBlock, blocks, nextBlock);
+            return;
+        }
+        writeIndexBlock(nodeBlock, node);
+    }
+
+    /**
+     * @brief Lista os nós e as folhas do índice por hash de um diretório
+     * 
+     * @param root Nó raiz (bloco de índice do diretório)
+     * @param nodes Recebe os nós, a raiz primeiro
+     * @param leaves Recebe as folhas (blocos de entradas)
+     */
+    void readHashed(u_int32_t root, vector<u_int32_t> &nodes, vector<u_int32_t> &leaves)
+    {
+        vector<u_int32_t> level = {root};
+        for (u_int32_t depth = 0; !level.empty(); depth++)
+        {
+            if (depth >= DIR_HASH_MAX_DEPTH)
+            {
+                throw runtime_error("Índice de diretório inválido!");
+            }
+            vector<u_int32_t> next;
+            for (u_int32_t block : level)
+            {
+                IndexView node = viewIndexBlock(block);
+                u_int32_t count = node->block_ptrs[1];
+                if (node->indirect_ptr != INDEX_HASHED || count == 0 || count > HASH_PAIRS)
+                {
+                    throw runtime_error("Índice de diretório inválido!");
+                }
+                nodes.push_back(block);
+                for (u_int32_t i = 0; i < count; i++)
+                {
+                    u_int32_t child = node->block_ptrs[3 + 2 * i];
+                    if (child >= superblock.total_blocks)
+                    {
+                        throw runtime_error("Índice de diretório inválido!");
+                    }
+                    (node->block_ptrs[0] == 0 ? leaves : next).push_back(child);
+                }
+            }
+            level.swap(next);
+        }
+    }
+
+    /**
+     * @brief Converte um subdiretório que chegou a DIR_HASH_THRESHOLD entradas para o índice por hash
+     * As entradas, em ordem de hash, enchem folhas novas até a metade (nomes com o mesmo hash ficam na mesma folha) e
+     * os nós abaixo da raiz são montados de baixo para cima. Todos os blocos são reservados antes; o bloco de índice
+     * do diretório só vira a raiz depois de todas as entradas estarem nas folhas, e a cadeia antiga é liberada no fim.
+     * Deve ser chamado com a trava exclusiva do diretório, dentro de uma operação do diário.
+     * 
+     * @param dir Índice do diretório
+     * @return false se não há blocos livres (ou nomes demais com o mesmo hash): o diretório continua uma lista
+     */
+    bool convertToHashed(DirIndex &dir)
+    {
+        u_int32_t perBlock = entriesPerBlock(dir.indexBlock);
+        vector<pair<uint32_t, RootDirEntry>> entries; // (hash, entrada)
+        for (const auto &item : dir.names)
+        {
+            entries.push_back({nameHash(item.first), readEntry(item.second.loc)});
+        }
+        sort(entries.begin(), entries.end(), [](const pair<uint32_t, RootDirEntry> &a, const pair<uint32_t, RootDirEntry> &b)
+             { return a.first < b.first; });
+
+        // Primeira entrada de cada folha
+        vector<size_t> leafStart;
+        size_t inLeaf = 0;
+        for (size_t i = 0, group; i < entries.size(); i = group)
+        {
+            group = i + 1;
+            while (group < entries.size() && entries[group].first == entries[i].first)
+            {
+                group++;
+            }
+            if (group - i > perBlock)
+            {
+                return false;
+            }
+            if (leafStart.empty() || inLeaf + (group - i) > (perBlock + 1) / 2)
+            {
+                leafStart.push_back(i);
+                inLeaf = 0;
+            }
+            inLeaf += group - i;
+        }
+        u_int32_t needed = leafStart.size();
+        u_int32_t levels = 1;
+        for (size_t children = leafStart.size(); children > HASH_PAIRS; levels++)
+        {
+            children = (children + HASH_PAIRS - 1) / HASH_PAIRS;
+            needed += children;
+        }
+        vector<u_int32_t> chain, oldBlocks, blocks;
+        readChain(dir.indexBlock, chain, nullptr, oldBlocks);
+        if (levels > DIR_HASH_MAX_DEPTH || !allocBlocks(needed, blocks))
+        {
+            return false;
+        }
+
+        size_t next = 0;
+        vector<pair<uint32_t, u_int32_t>> children; // (menor hash, bloco) do nível em montagem
+        vector<pair<u_int32_t, DirSlot>> placed;     // (bloco de índice do arquivo, posição nova da entrada)
+        for (size_t leaf = 0; leaf < leafStart.size(); leaf++)
+        {
+            size_t end = leaf + 1 < leafStart.size() ? leafStart[leaf + 1] : entries.size();
+            char buffer[BLOCK_SIZE];
+            memset(buffer, 0x00, BLOCK_SIZE);
+            RootDirEntry *slots = reinterpret_cast<RootDirEntry *>(buffer);
+            u_int32_t block = blocks[next++];
+            for (size_t i = leafStart[leaf]; i < end; i++)
+            {
+                u_int32_t slot = i - leafStart[leaf];
+                slots[slot] = entries[i].second;
+                placed.push_back({entries[i].second.index_block, {block, slot}});
+            }
+            cache.writeMetadata(block, buffer);
+            children.push_back({leaf == 0 ? 0 : entries[leafStart[leaf]].first, block});
+        }
+
+        // Nó com os filhos [first, last) do nível em montagem
+        auto makeNode = [&](u_int32_t level, size_t first, size_t last)
+        {
+            IndexBlock node;
+            node.indirect_ptr = INDEX_HASHED;
+            node.block_ptrs[0] = level;
+            node.block_ptrs[1] = last - first;
+            for (size_t i = first; i < last; i++)
+            {
+                node.block_ptrs[2 + 2 * (i - first)] = children[i].first;
+                node.block_ptrs[3 + 2 * (i - first)] = children[i].second;
+            }
+            return node;
+        };
+        u_int32_t level = 0;
+        for (; children.size() > HASH_PAIRS; level++)
+        {
+            // Filhos repartidos por igual entre os nós do nível
+            vector<pair<uint32_t, u_int32_t>> parents;
+            size_t count = (children.size() + HASH_PAIRS - 1) / HASH_PAIRS;
+            for (size_t n = 0; n < count; n++)
+            {
+                size_t first = children.size() * n / count, last = children.size() * (n + 1) / count;
+                u_int32_t block = blocks[next++];
+                writeIndexBlock(block, makeNode(level, first, last));
+                parents.push_back({children[first].first, block});
+            }
+            children.swap(parents);
+        }
+        writeIndexBlock(dir.indexBlock, makeNode(level, 0, children.size()));
+
+        dir.hashed = true;
+        dir.names.clear();
+        dir.freeSlots.clear();
+        for (const auto &item : placed)
+        {
+            relocateEntry(item.first, item.second);
+        }
+        oldBlocks.insert(oldBlocks.end(), chain.begin() + 1, chain.end());
+        freeBlocks(oldBlocks);
+        return true;
+    }
+
+    /**
+     * @brief Atualiza a posição da entrada de um arquivo aberto que mudou de bloco no diretório
+     * Deve ser chamado com a trava exclusiva do diretório.
+     * 
+     * @param indexBlock Bloco de índice do arquivo
+     * @param loc Nova posição da entrada
+     */
+    void relocateEntry(u_int32_t indexBlock, DirSlot loc)
+    {
+        OpUndo *op = currentOp();
+        lock_guard<mutex> guard(openFilesLock);
+        auto open = inodes.find(indexBlock);
+        if (open != inodes.end())
+        {
+            if (op != nullptr)
+            {
+                op->moved.push_back({indexBlock, open->second->loc.block, open->second->loc.slot});
+            }
+            open->second->loc = loc;
+        }
+    }
+
+    // Janela de leitura antecipada: blocos lógicos lidos em segundo plano
+    struct Readahead
+    {
+        u_int32_t first = 0;     // Primeiro bloco lógico da janela
+        u_int32_t count = 0;     // Blocos na janela (0 = vazia)
+        vector<char> buffer;     // count * BLOCK_SIZE bytes
+        unique_ptr<typename DiskManager::BlockQueue> pending; // Leituras em andamento (esperadas antes de liberar buffer)
+        uint64_t generation = 0; // dataGeneration no momento da leitura
+        uint64_t writebacks = 0; // Escritas da cache no momento da leitura
+    };
+
+    // Forma do índice de um arquivo
+    enum class FileMap : uint8_t
+    {
+        CHAIN,  // Cadeia de blocos de índice (diretórios e arquivos de discos anteriores à versão 4)
+        TREE,   // Árvore com ponteiros diretos e blocos indiretos simples, duplo e triplo
+        EXTENTS, // Extensões (primeiro bloco, número de blocos) em blocos de extensões encadeados
+        INLINE  // Dados no próprio bloco de índice (arquivos de até INLINE_BYTES bytes)
+    };
+
+    // Arquivo aberto, compartilhado por todos os descritores do mesmo arquivo: a cadeia de índices
+    // fica em memória até o último fechamento. A trava é compartilhada nas leituras e exclusiva nas escritas.
+    struct Inode
+    {
+        shared_mutex lock;
+        u_int32_t parentDir;          // Bloco de índice do diretório que contém o arquivo
+        DirSlot loc;                  // Entrada do arquivo no diretório
+        u_int32_t indexBlock;         // Primeiro bloco de índice do arquivo
+        uint32_t size;                // Tamanho atual do arquivo em bytes
+        vector<u_int32_t> chain;      // Blocos de índice da cadeia (da árvore, a raiz primeiro, ou de extensões)
+        vector<IndexBlock> index;     // Conteúdo dos blocos de índice da cadeia
+        vector<uint8_t> indexDirty;   // Blocos de índice alterados desde a abertura
+        vector<u_int32_t> blocks;     // Blocos de dados, em ordem lógica
+        FileMap map = FileMap::CHAIN;
+        FileMap growsTo = FileMap::TREE; // Forma do índice quando um arquivo com dados no bloco de índice cresce
+        unordered_map<uint64_t, u_int32_t> nodes; // Bloco indireto da árvore (treeKey) -> posição em chain
+        bool sizeDirty = false;
+        u_int32_t opens = 0;          // Descritores abertos (protegido por openFilesLock)
+    };
+
+    // Arquivo aberto antes de uma operação escrever nele: tamanho, forma do índice, tamanho da cadeia e da lista de
+    // blocos, e o conteúdo anterior dos blocos de índice já existentes que ela alterou
+    struct InodeUndo
+    {
+        shared_ptr<Inode> inode;
+        uint32_t size;
+        bool sizeDirty;
+        FileMap map;
+        size_t chain;
+        size_t blocks;
+        vector<u_int32_t> positions; // Posições na cadeia dos blocos de índice alterados
+        vector<IndexBlock> index;
+        vector<uint8_t> dirty;
+    };
+
+    // Descritor de arquivo: o estado de leitura sequencial é de cada descritor
+    struct OpenFile
+    {
+        shared_ptr<Inode> inode;
+        mutex lock;                   // Serializa as leituras feitas pelo mesmo descritor
+        uint64_t nextRead = 0;        // Posição em que uma leitura sequencial continuaria
+        u_int32_t window = 0;         // Janela atual de leitura antecipada em blocos
+        Readahead ahead[2];           // Janela atual e a seguinte
+    };
+
+    unordered_map<u_int32_t, shared_ptr<OpenFile>> openFiles; // descritor -> arquivo aberto
+    unordered_map<u_int32_t, shared_ptr<Inode>> inodes;       // bloco de índice -> arquivo aberto
+    mutex openFilesLock;                                      // Protege openFiles, inodes e Inode::opens
+    u_int32_t nextHandle = 0;
+    atomic<uint64_t> dataGeneration{0}; // Incrementado a cada escrita de dados (invalida leituras antecipadas)
+    atomic<u_int32_t> readaheadMin{getMax<u_int32_t>(READAHEAD_MIN_BYTES / BLOCK_SIZE, 1)};
+    atomic<u_int32_t> readaheadMax{getMax<u_int32_t>(READAHEAD_MAX_BYTES / BLOCK_SIZE, 1)};
+    atomic<uint64_t> readaheadIssued{0};    // Janelas lidas em segundo plano
+    atomic<uint64_t> readaheadHits{0};      // Bytes entregues a partir de janelas lidas antecipadamente
+    atomic<uint64_t> readaheadDiscarded{0}; // Janelas descartadas (acesso aleatório ou dados alterados)
+
+    /**
+     * @brief Retorna o arquivo aberto de um descritor
+     * 
+     * @param handle Descritor retornado por openFile
+     */
+    shared_ptr<OpenFile> openHandle(u_int32_t handle)
+    {
+        lock_guard<mutex> guard(openFilesLock);
+        auto it = openFiles.find(handle);
+        if (it == openFiles.end())
+        {
+            throw runtime_error("Descritor de arquivo inválido!");
+        }
+        return it->second;
+    }
+
+    /**
+     * @brief Percorre a cadeia de blocos de índice de um arquivo
+     * 
+     * @param indexBlock Primeiro bloco de índice
+     * @param chain Recebe os blocos de índice da cadeia
+     * @param index Recebe o conteúdo de cada bloco de índice (pode ser nullptr)
+     * @param blocks Recebe os blocos de dados em ordem lógica
+     */
+    void readChain(u_int32_t indexBlock, vector<u_int32_t> &chain, vector<IndexBlock> *index, vector<u_int32_t> &blocks)
+    {
+        u_int32_t current = indexBlock;
+        while (current != 0xFFFFFFFF)
+        {
+            if (current >= superblock.total_blocks || chain.size() > superblock.total_blocks)
+            {
+                throw runtime_error("Cadeia de blocos de índice inválida!");
+            }
+            IndexView ib = viewIndexBlock(current);
+            chain.push_back(current);
+            for (auto ptr : ib->block_ptrs)
+            {
+                if (ptr != 0xFFFFFFFF)
+                {
+                    blocks.push_back(ptr);
+                }
+            }
+            if (index != nullptr)
+            {
+                index->push_back(*ib);
+            }
+            current = ib->indirect_ptr;
+        }
+    }
+
+    /**
+     * @brief Localiza um bloco lógico na árvore de índices de um arquivo
+     * 
+     * @param k Bloco lógico; recebe a posição dentro do nível
+     * @return u_int32_t Nível: 0 para os ponteiros diretos do bloco raiz, t para t níveis de blocos indiretos
+     */
+    static u_int32_t treeTier(uint64_t &k)
+    {
+        if (k < TREE_DIRECT)
+        {
+            return 0;
+        }
+        k -= TREE_DIRECT;
+        for (u_int32_t tier = 1; tier <= 3; tier++)
+        {
+            if (k < treeSpan(tier))
+            {
+                return tier;
+            }
+            k -= treeSpan(tier);
+        }
+        throw runtime_error("Tamanho do arquivo excede o limite de armazenamento");
+    }
+
+    /**
+     * @brief Blocos de dados alcançados por um bloco indireto com levels níveis abaixo dele (TREE_FANOUT^levels)
+     * 
+     */
+    static uint64_t treeSpan(u_int32_t levels)
+    {
+        uint64_t span = 1;
+        while (levels-- > 0)
+        {
+            span *= TREE_FANOUT;
+        }
+        return span;
+    }
+
+    /**
+     * @brief Identificador de um bloco indireto da árvore: nível, profundidade dentro do nível e posição na profundidade
+     * 
+     */
+    static uint64_t treeKey(u_int32_t tier, u_int32_t depth, uint64_t position)
+    {
+        return (uint64_t)tier << 62 | (uint64_t)depth << 60 | position;
+    }
+
+    /**
+     * @brief Retorna o bloco de dados de um bloco lógico de um arquivo com índice em árvore,
+     * lendo no máximo um bloco indireto por nível (três além do raiz)
+     * 
+     * @param root Bloco de índice raiz do arquivo
+     * @param k Bloco lógico
+     * @return u_int32_t Bloco de dados, ou 0xFFFFFFFF se o arquivo não tiver esse bloco
+     */
+    u_int32_t treeLookup(const IndexBlock &root, uint64_t k)
+    {
+        u_int32_t tier = treeTier(k);
+        if (tier == 0)
+        {
+            return root.block_ptrs[k];
+        }
+        u_int32_t ptr = root.block_ptrs[TREE_DIRECT + tier - 1];
+        for (u_int32_t depth = 0; depth < tier && ptr != 0xFFFFFFFF; depth++)
+        {
+            if (ptr >= superblock.total_blocks)
+            {
+                throw runtime_error("Árvore de blocos de índice inválida!");
+            }
+            IndexView node = viewIndexBlock(ptr);
+            ptr = node->word(k / treeSpan(tier - depth - 1) % TREE_FANOUT);
+        }
+        return ptr;
+    }
+
+    /**
+     * @brief Percorre a árvore de índices de um arquivo: os blocos indiretos de cada profundidade são lidos juntos,
+     * então o número de leituras dependentes não passa de sete, qualquer que seja o tamanho do arquivo
+     * 
+     * @param indexBlock Bloco de índice raiz
+     * @param root Conteúdo do bloco raiz
+     * @param chain Recebe os blocos de índice da árvore (a raiz primeiro)
+     * @param index Recebe o conteúdo de cada bloco de índice (pode ser nullptr)
+     * @param blocks Recebe os blocos de dados em ordem lógica
+     * @param nodes Recebe a posição em chain de cada bloco indireto (pode ser nullptr)
+     */
+    void readTree(u_int32_t indexBlock, const IndexBlock &root, vector<u_int32_t> &chain, vector<IndexBlock> *index,
+                  vector<u_int32_t> &blocks, unordered_map<uint64_t, u_int32_t> *nodes)
+    {
+        chain.push_back(indexBlock);
+        if (index != nullptr)
+        {
+            index->push_back(root);
+        }
+        for (u_int32_t k = 0; k < TREE_DIRECT; k++)
+        {
+            if (root.block_ptrs[k] != 0xFFFFFFFF)
+            {
+                blocks.push_back(root.block_ptrs[k]);
+            }
+        }
+
+        // Os níveis em ordem e, em cada profundidade, os blocos indiretos em ordem: os dados saem em ordem lógica
+        for (u_int32_t tier = 1; tier <= 3; tier++)
+        {
+            vector<u_int32_t> level;
+            vector<uint64_t> keys;
+            if (root.block_ptrs[TREE_DIRECT + tier - 1] != 0xFFFFFFFF)
+            {
+                level.push_back(root.block_ptrs[TREE_DIRECT + tier - 1]);
+                keys.push_back(0);
+            }
+            for (u_int32_t depth = 0; depth < tier && !level.empty(); depth++)
+            {
+                for (u_int32_t block : level)
+                {
+                    if (block >= superblock.total_blocks)
+                    {
+                        throw runtime_error("Árvore de blocos de índice inválida!");
+                    }
+                }
+                vector<u_int32_t> nextLevel;
+                vector<uint64_t> nextKeys;
+                size_t i = 0;
+                scanBlocks(level, [&](u_int32_t block, const char *data)
+                           {
+                               const IndexBlock *node = reinterpret_cast<const IndexBlock *>(data);
+                               uint64_t position = keys[i++];
+                               if (nodes != nullptr)
+                               {
+                                   (*nodes)[treeKey(tier, depth, position)] = chain.size();
+                               }
+                               chain.push_back(block);
+                               if (index != nullptr)
+                               {
+                                   index->push_back(*node);
+                               }
+                               for (u_int32_t w = 0; w < TREE_FANOUT; w++)
+                               {
+                                   u_int32_t ptr = node->word(w);
+                                   if (ptr == 0xFFFFFFFF)
+                                   {
+                                       continue;
+                                   }
+                                   if (depth + 1 == tier)
+                                   {
+                                       blocks.push_back(ptr);
+                                   }
+                                   else
+                                   {
+                                       nextLevel.push_back(ptr);
+                                       nextKeys.push_back(position * TREE_FANOUT + w);
+                                   }
+                               } });
+                level.swap(nextLevel);
+                keys.swap(nextKeys);
+            }
+        }
+    }
+
+    /**
+     * @brief Percorre os blocos de extensões de um arquivo
+     * 
+     * @param indexBlock Primeiro bloco de extensões
+     * @param chain Recebe os blocos de extensões
+     * @param index Recebe o conteúdo de cada bloco de extensões (pode ser nullptr)
+     * @param blocks Recebe os blocos de dados em ordem lógica
+     */
+    void readExtents(u_int32_t indexBlock, vector<u_int32_t> &chain, vector<IndexBlock> *index, vector<u_int32_t> &blocks)
+    {
+        u_int32_t current = indexBlock;
+        while (current != 0xFFFFFFFF)
+        {
+            if (current >= superblock.total_blocks || chain.size() > superblock.total_blocks)
+            {
+                throw runtime_error("Cadeia de blocos de extensões inválida!");
+            }
+            IndexView ib = viewIndexBlock(current);
+            if (ib->indirect_ptr != INDEX_EXTENTS)
+            {
+                throw runtime_error("Cadeia de blocos de extensões inválida!");
+            }
+            chain.push_back(current);
+            for (u_int32_t e = 0; e < EXTENTS; e++)
+            {
+                u_int32_t start = ib->block_ptrs[2 * e];
+                u_int32_t length = ib->block_ptrs[2 * e + 1];
+                if (start == 0xFFFFFFFF)
+                {
+                    continue;
+                }
+                if ((uint64_t)start + length > superblock.total_blocks)
+                {
+                    throw runtime_error("Extensão inválida!");
+                }
+                for (u_int32_t i = 0; i < length; i++)
+                {
+                    blocks.push_back(start + i);
+                }
+            }
+            if (index != nullptr)
+            {
+                index->push_back(*ib);
+            }
+            current = ib->block_ptrs[EXTENT_NEXT];
+        }
+    }
+
+    /**
+     * @brief Resolve os blocos lógicos [first, first + count) de um arquivo mapeado por extensões, percorrendo
+     * somente os blocos de extensões até o último bloco pedido
+     * 
+     * @param indexBlock Primeiro bloco de extensões
+     * @param first Primeiro bloco lógico
+     * @param count Número de blocos
+     * @param blocks Recebe os blocos de dados
+     */
+    void extentLookup(u_int32_t indexBlock, uint64_t first, u_int32_t count, vector<u_int32_t> &blocks)
+    {
+        uint64_t logical = 0; // Bloco lógico do início da extensão atual
+        u_int32_t current = indexBlock;
+        for (u_int32_t hops = 0; current != 0xFFFFFFFF && blocks.size() < count; hops++)
+        {
+            if (current >= superblock.total_blocks || hops > superblock.total_blocks)
+            {
+                throw runtime_error("Cadeia de blocos de extensões inválida!");
+            }
+            IndexView ib = viewIndexBlock(current);
+            for (u_int32_t e = 0; e < EXTENTS && blocks.size() < count; e++)
+            {
+                u_int32_t start = ib->block_ptrs[2 * e];
+                u_int32_t length = ib->block_ptrs[2 * e + 1];
+                if (start == 0xFFFFFFFF)
+                {
+                    continue;
+                }
+                for (uint64_t k = getMax(first, logical); k < logical + length && blocks.size() < count; k++)
+                {
+                    blocks.push_back(start + (k - logical));
+                }
+                logical += length;
+            }
+            current = ib->block_ptrs[EXTENT_NEXT];
+        }
+        if (blocks.size() < count)
+        {
+            throw runtime_error("Bloco de dados não encontrado!");
+        }
+    }
+
+    /**
+     * @brief Le o índice de um arquivo, em cadeia, em árvore, de extensões ou com os dados no bloco de índice
+     * 
+     * @param indexBlock Primeiro bloco de índice
+     * @param chain Recebe os blocos de índice
+     * @param index Recebe o conteúdo de cada bloco de índice (pode ser nullptr)
+     * @param blocks Recebe os blocos de dados em ordem lógica
+     * @param nodes Recebe a posição em chain de cada bloco indireto da árvore (pode ser nullptr)
+     * @return FileMap Forma do índice
+     */
+    FileMap readFileIndex(u_int32_t indexBlock, vector<u_int32_t> &chain, vector<IndexBlock> *index, vector<u_int32_t> &blocks,
+                          unordered_map<uint64_t, u_int32_t> *nodes)
+    {
+        if (indexBlock >= superblock.total_blocks)
+        {
+            throw runtime_error("Cadeia de blocos de índice inválida!");
+        }
+        IndexBlock root;
+        readIndexBlock(indexBlock, root);
+        if (root.indirect_ptr == INDEX_TREE)
+        {
+            readTree(indexBlock, root, chain, index, blocks, nodes);
+            return FileMap::TREE;
+        }
+        if (root.indirect_ptr == INDEX_EXTENTS)
+        {
+            readExtents(indexBlock, chain, index, blocks);
+            return FileMap::EXTENTS;
+        }
+        if (root.indirect_ptr == INDEX_HASHED)
+        {
+            // Diretório com índice por hash: os nós fazem o papel da cadeia e as folhas o dos blocos de entradas
+            readHashed(indexBlock, chain, blocks);
+            return FileMap::CHAIN;
+        }
+        if (root.indirect_ptr == INDEX_INLINE)
+        {
+            chain.push_back(indexBlock);
+            if (index != nullptr)
+            {
+                index->push_back(root);
+            }
+            return FileMap::INLINE;
+        }
+        readChain(indexBlock, chain, index, blocks);
+        return FileMap::CHAIN;
+    }
+
+    /**
+     * @brief Registra na operação em andamento o estado de um arquivo aberto antes da primeira escrita nele
+     * Deve ser chamado com a trava exclusiva do arquivo.
+     * 
+     * @param inode Arquivo aberto
+     */
+    void saveInode(const shared_ptr<Inode> &inode)
+    {
+        OpUndo *undo = currentOp();
+        if (undo == nullptr)
+        {
+            return;
+        }
+        for (InodeUndo &saved : undo->files)
+        {
+            if (saved.inode == inode)
+            {
+                return;
+            }
+        }
+        undo->files.push_back({inode, inode->size, inode->sizeDirty, inode->map, inode->chain.size(), inode->blocks.size(), {}, {}, {}});
+    }
+
+    /**
+     * @brief Devolve um arquivo aberto ao estado registrado por saveInode: a cadeia e a lista de blocos voltam ao
+     * tamanho anterior e os blocos de índice alterados, ao conteúdo anterior.
+     * Deve ser chamado com a trava exclusiva do arquivo.
+     * 
+     * @param saved Estado anterior do arquivo
+     */
+    void restoreInode(InodeUndo &saved)
+    {
+        Inode &file = *saved.inode;
+        for (size_t i = 0; i < saved.positions.size(); i++)
+        {
+            file.index[saved.positions[i]] = saved.index[i];
+            file.indexDirty[saved.positions[i]] = saved.dirty[i];
+        }
+        file.chain.resize(saved.chain);
+        file.index.resize(saved.chain);
+        file.indexDirty.resize(saved.chain);
+        file.blocks.resize(saved.blocks);
+        for (auto it = file.nodes.begin(); it != file.nodes.end();)
+        {
+            it = it->second >= saved.chain ? file.nodes.erase(it) : next(it);
+        }
+        file.map = saved.map;
+        file.size = saved.size;
+        file.sizeDirty = saved.sizeDirty;
+    }
+
+    /**
+     * @brief Guarda o conteúdo de um bloco de índice do arquivo antes de a operação em andamento alterá-lo pela
+     * primeira vez. Os blocos de índice acrescentados pela operação não precisam: a cadeia volta ao tamanho anterior.
+     * 
+     * @param file Arquivo aberto (registrado por saveInode)
+     * @param i Posição do bloco de índice na cadeia
+     */
+    void saveIndex(Inode &file, u_int32_t i)
+    {
+        OpUndo *undo = currentOp();
+        if (undo == nullptr)
+        {
+            return;
+        }
+        for (InodeUndo &saved : undo->files)
+        {
+            if (saved.inode.get() == &file)
+            {
+                if (i < saved.chain && find(saved.positions.begin(), saved.positions.end(), i) == saved.positions.end())
+                {
+                    saved.positions.push_back(i);
+                    saved.index.push_back(file.index[i]);
+                    saved.dirty.push_back(file.indexDirty[i]);
+                }
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Garante que o arquivo tenha pelo menos numBlocks blocos de dados
+     * Os novos blocos de dados são alocados em uma única sequência contígua sempre que possível,
+     * e os blocos de índice necessários são encadeados pelo indirect_ptr.
+     * Deve ser chamado com a trava exclusiva do arquivo.
+     * 
+     * @param file Arquivo aberto
+     * @param numBlocks Número de blocos de dados desejado
+     */
+    void growFile(Inode &file, u_int32_t numBlocks)
+    {
+        if (file.map == FileMap::TREE)
+        {
+            growTree(file, numBlocks);
+            return;
+        }
+        if (file.map == FileMap::EXTENTS)
+        {
+            growExtents(file, numBlocks);
+            return;
+        }
+        u_int32_t newData = numBlocks - file.blocks.size();
+        u_int32_t indexNeeded = (numBlocks + INDEX_PTRS - 1) / INDEX_PTRS;
+        u_int32_t newIndex = indexNeeded > file.chain.size() ? indexNeeded - file.chain.size() : 0;
+
+        MetadataBatch batch(*this);
+        vector<u_int32_t> dataBlocks, indexBlocks;
+        if (!allocBlocks(newData, dataBlocks) || !allocBlocks(newIndex, indexBlocks))
+        {
+            freeBlocks(dataBlocks);
+            throw runtime_error("Não há blocos disponíveis!");
+        }
+
+        for (u_int32_t i = getMin<size_t>(file.blocks.size() / INDEX_PTRS, file.chain.size() - 1); i < file.chain.size(); i++)
+        {
+            saveIndex(file, i);
+        }
+        for (u_int32_t block : indexBlocks)
+        {
+            file.index.back().indirect_ptr = block;
+            file.indexDirty.back() = 1;
+            file.chain.push_back(block);
+            file.index.push_back(IndexBlock());
+            file.indexDirty.push_back(1);
+        }
+        for (u_int32_t block : dataBlocks)
+        {
+            u_int32_t k = file.blocks.size();
+            file.index[k / INDEX_PTRS].block_ptrs[k % INDEX_PTRS] = block;
+            file.indexDirty[k / INDEX_PTRS] = 1;
+            file.blocks.push_back(block);
+        }
+    }
+
+    /**
+     * @brief Passa um arquivo com os dados no bloco de índice para a forma definitiva (árvore ou extensões): os dados
+     * vão para o primeiro bloco de dados, alocado logo após o bloco de índice sempre que possível.
+     * Deve ser chamado com a trava exclusiva do arquivo.
+     * 
+     * @param file Arquivo aberto
+     */
+    void spillInline(Inode &file)
+    {
+        // O bloco de dados é alocado e escrito antes de o índice deixar de guardar os dados: sem espaço (ou com erro
+        // de escrita), o arquivo continua inline
+        vector<u_int32_t> data;
+        if (file.size > 0)
+        {
+            if (!allocContiguous(file.indexBlock + 1, 1, data))
+            {
+                throw runtime_error("Não há blocos disponíveis!");
+            }
+            char buffer[BLOCK_SIZE];
+            memset(buffer, 0x00, BLOCK_SIZE);
+            memcpy(buffer, file.index[0].inlineData(), file.size);
+            try
+            {
+                cache.writeBlock(data[0], buffer);
+            }
+            catch (const exception &)
+            {
+                freeBlocks(data);
+                throw;
+            }
+        }
+
+        saveIndex(file, 0);
+        file.index[0] = IndexBlock();
+        file.index[0].indirect_ptr = file.growsTo == FileMap::EXTENTS ? INDEX_EXTENTS : INDEX_TREE;
+        file.indexDirty[0] = 1;
+        file.map = file.growsTo;
+        if (!data.empty())
+        {
+            if (file.map == FileMap::EXTENTS)
+            {
+                file.index[0].block_ptrs[0] = data[0];
+                file.index[0].block_ptrs[1] = 1;
+            }
+            else
+            {
+                file.index[0].word(0) = data[0];
+            }
+            file.blocks.push_back(data[0]);
+        }
+    }
+
+    /**
+     * @brief growFile para um arquivo com índice em árvore: os blocos indiretos que faltam no caminho dos novos
+     * blocos de dados são alocados juntos e ligados ao bloco de cima (raiz ou indireto de uma profundidade acima)
+     * 
+     * @param file Arquivo aberto
+     * @param numBlocks Número de blocos de dados desejado
+     */
+    void growTree(Inode &file, u_int32_t numBlocks)
+    {
+        // Um bloco indireto novo aparece no primeiro bloco de dados que ele alcança (ou no primeiro bloco acrescentado)
+        u_int32_t start = file.blocks.size();
+        vector<uint64_t> missing;
+        for (u_int32_t k = start; k < numBlocks; k++)
+        {
+            uint64_t offset = k;
+            u_int32_t tier = treeTier(offset);
+            for (u_int32_t depth = 0; depth < tier; depth++)
+            {
+                uint64_t span = treeSpan(tier - depth);
+                uint64_t key = treeKey(tier, depth, offset / span);
+                if ((k == start || offset % span == 0) && file.nodes.count(key) == 0)
+                {
+                    missing.push_back(key);
+                }
+            }
+            if (k == start)
+            {
+                // Ponteiro já ocupado na posição do primeiro bloco novo: árvore com buracos (ponteiro cortado pelo fsck)
+                auto leaf = file.nodes.find(treeKey(tier, tier - 1, offset / TREE_FANOUT));
+                u_int32_t node = tier == 0 ? 0 : (leaf == file.nodes.end() ? 0xFFFFFFFF : leaf->second);
+                if (node != 0xFFFFFFFF && file.index[node].word(tier == 0 ? offset : offset % TREE_FANOUT) != 0xFFFFFFFF)
+                {
+                    throw runtime_error("Árvore de blocos de índice inválida!");
+                }
+            }
+        }
+
+        MetadataBatch batch(*this);
+        vector<u_int32_t> dataBlocks, indexBlocks;
+        if (!allocBlocks(numBlocks - start, dataBlocks) || !allocBlocks(missing.size(), indexBlocks))
+        {
+            freeBlocks(dataBlocks);
+            throw runtime_error("Não há blocos disponíveis!");
+        }
+
+        // As chaves vêm em ordem de profundidade para cada bloco de dados: o bloco de cima já existe
+        for (size_t i = 0; i < missing.size(); i++)
+        {
+            uint64_t key = missing[i];
+            u_int32_t tier = key >> 62;
+            u_int32_t depth = (key >> 60) & 3;
+            uint64_t position = key & ((uint64_t(1) << 60) - 1);
+            u_int32_t parent = depth == 0 ? 0 : file.nodes.at(treeKey(tier, depth - 1, position / TREE_FANOUT));
+            u_int32_t word = depth == 0 ? TREE_DIRECT + tier - 1 : position % TREE_FANOUT;
+            saveIndex(file, parent);
+            file.index[parent].word(word) = indexBlocks[i];
+            file.indexDirty[parent] = 1;
+            file.nodes[key] = file.chain.size();
+            file.chain.push_back(indexBlocks[i]);
+            file.index.push_back(IndexBlock());
+            file.indexDirty.push_back(1);
+        }
+        u_int32_t lastSaved = 0xFFFFFFFF;
+        for (u_int32_t block : dataBlocks)
+        {
+            uint64_t offset = file.blocks.size();
+            u_int32_t tier = treeTier(offset);
+            u_int32_t node = tier == 0 ? 0 : file.nodes.at(treeKey(tier, tier - 1, offset / TREE_FANOUT));
+            if (node != lastSaved)
+            {
+                saveIndex(file, node);
+                lastSaved = node;
+            }
+            file.index[node].word(tier == 0 ? offset : offset % TREE_FANOUT) = block;
+            file.indexDirty[node] = 1;
+            file.blocks.push_back(block);
+        }
+    }
+
+    /**
+     * @brief growFile para um arquivo mapeado por extensões: os novos blocos continuam, sempre que possível, a última
+     * extensão do arquivo (allocContiguous), e cada sequência contígua restante vira uma extensão nova
+     * 
+     * @param file Arquivo aberto
+     * @param numBlocks Número de blocos de dados desejado
+     */
+    void growExtents(Inode &file, u_int32_t numBlocks)
+    {
+        MetadataBatch batch(*this);
+        vector<u_int32_t> dataBlocks;
+        u_int32_t goal = (file.blocks.empty() ? file.indexBlock : file.blocks.back()) + 1;
+        if (!allocContiguous(goal, numBlocks - file.blocks.size(), dataBlocks))
+        {
+            throw runtime_error("Não há blocos disponíveis!");
+        }
+
+        // Última extensão usada do último bloco de extensões (as novas vêm depois dela)
+        saveIndex(file, file.chain.size() - 1);
+        IndexBlock *last = &file.index.back();
+        u_int32_t used = EXTENTS;
+        while (used > 0 && last->block_ptrs[2 * (used - 1)] == 0xFFFFFFFF)
+        {
+            used--;
+        }
+        u_int32_t newExtents = 0;
+        bool extendsLast = used > 0 && dataBlocks[0] == last->block_ptrs[2 * (used - 1)] + last->block_ptrs[2 * (used - 1) + 1];
+        for (size_t i = 0; i < dataBlocks.size(); i++)
+        {
+            if (i == 0 ? !extendsLast : dataBlocks[i] != dataBlocks[i - 1] + 1)
+            {
+                newExtents++;
+            }
+        }
+        vector<u_int32_t> extentBlocks;
+        u_int32_t room = EXTENTS - used;
+        if (newExtents > room && !allocBlocks((newExtents - room + EXTENTS - 1) / EXTENTS, extentBlocks))
+        {
+            freeBlocks(dataBlocks);
+            throw runtime_error("Não há blocos disponíveis!");
+        }
+
+        size_t nextExtentBlock = 0;
+        for (size_t i = 0; i < dataBlocks.size(); i++)
+        {
+            if (i == 0 ? extendsLast : dataBlocks[i] == dataBlocks[i - 1] + 1)
+            {
+                last->block_ptrs[2 * (used - 1) + 1]++;
+            }
+            else
+            {
+                if (used == EXTENTS)
+                {
+                    // Bloco de extensões cheio: encadear o próximo
+                    u_int32_t block = extentBlocks[nextExtentBlock++];
+                    last->block_ptrs[EXTENT_NEXT] = block;
+                    file.indexDirty.back() = 1;
+                    file.chain.push_back(block);
+                    file.index.push_back(IndexBlock());
+                    file.index.back().indirect_ptr = INDEX_EXTENTS;
+                    file.indexDirty.push_back(1);
+                    last = &file.index.back();
+                    used = 0;
+                }
+                last->block_ptrs[2 * used] = dataBlocks[i];
+                last->block_ptrs[2 * used + 1] = 1;
+                used++;
+            }
+            file.blocks.push_back(dataBlocks[i]);
+        }
+        file.indexDirty.back() = 1;
+    }
+
+    /**
+     * @brief Decompõe a leitura de bytes de um arquivo em leituras vetoriais do disco
+     * Cada sequência de blocos fisicamente contíguos vira uma leitura: os blocos inteiros vão direto para
+     * o buffer do chamador e apenas o primeiro e o último bloco parciais usam o buffer auxiliar do plano.
+     * 
+     * @param blocks Blocos de dados do arquivo, em ordem lógica
+     * @param pos Posição inicial em bytes
+     * @param data Buffer de destino
+     * @param size Número de bytes a ler
+     * @param plan Recebe as leituras e as cópias parciais
+     */
+    void planBlocks(const vector<u_int32_t> &blocks, uint64_t pos, char *data, uint32_t size, ReadPlan &plan)
+    {
+        uint64_t end = pos + size;
+        plan.size = size;
+        if (size == 0)
+        {
+            return;
+        }
+        if ((end - 1) / BLOCK_SIZE >= blocks.size())
+        {
+            throw runtime_error("Bloco de dados não encontrado!");
+        }
+
+        // Somente o primeiro bloco lido (head) e o último (tail) podem ser parciais
+        plan.scratch.resize(2 * BLOCK_SIZE);
+        char *head = plan.scratch.data();
+        char *tail = head + BLOCK_SIZE;
+        vector<ReadPlan::DiskRead> &reads = plan.reads;
+        vector<ReadPlan::PartialCopy> &copies = plan.copies;
+        uint64_t start = pos;
+        char *dst = data;
+        while (pos < end)
+        {
+            u_int32_t k = pos / BLOCK_SIZE;
+            u_int32_t last = (end - 1) / BLOCK_SIZE;
+            u_int32_t run = 1;
+            while (k + run <= last && blocks[k + run] == blocks[k] + run)
+            {
+                run++;
+            }
+            uint64_t runEnd = getMin<uint64_t>(end, (uint64_t)(k + run) * BLOCK_SIZE);
+
+            ReadPlan::DiskRead read;
+            read.offset = (off_t)blocks[k] * BLOCK_SIZE;
+            read.iovcnt = 0;
+            u_int32_t headSkip = pos % BLOCK_SIZE;
+            bool headPartial = headSkip != 0 || runEnd - pos < BLOCK_SIZE;
+            u_int32_t tailBytes = headPartial && run == 1 ? 0 : runEnd % BLOCK_SIZE;
+            u_int32_t whole = run - (headPartial ? 1 : 0) - (tailBytes != 0 ? 1 : 0);
+
+            if (headPartial)
+            {
+                char *partial = pos == start ? head : tail;
+                read.iov[read.iovcnt++] = {partial, BLOCK_SIZE};
+                copies.push_back({dst, partial + headSkip, getMin<uint64_t>(BLOCK_SIZE - headSkip, runEnd - pos)});
+            }
+            char *wholeDst = dst + (headPartial ? BLOCK_SIZE - headSkip : 0);
+            if (whole > 0)
+            {
+                read.iov[read.iovcnt++] = {wholeDst, (size_t)whole * BLOCK_SIZE};
+            }
+            if (tailBytes != 0)
+            {
+                read.iov[read.iovcnt++] = {tail, BLOCK_SIZE};
+                copies.push_back({wholeDst + (size_t)whole * BLOCK_SIZE, tail, tailBytes});
+            }
+            reads.push_back(read);
+            dst += runEnd - pos;
+            pos = runEnd;
+        }
+    }
+
+    /**
+     * @brief Copia as partes dos blocos parciais de um plano cujas leituras já terminaram
+     * 
+     */
+    static void copyPartials(const ReadPlan &plan)
+    {
+        for (const ReadPlan::PartialCopy &copy : plan.copies)
+        {
+            memcpy(copy.dst, copy.src, copy.length);
+        }
+    }
+
+    /**
+     * @brief Le bytes de um arquivo a partir da lista de seus blocos de dados
+     * Todas as leituras do plano (uma por sequência contígua) são enviadas juntas pela fila assíncrona.
+     * 
+     * @param blocks Blocos de dados do arquivo, em ordem lógica
+     * @param pos Posição inicial em bytes
+     * @param data Buffer de destino
+     * @param size Número de bytes a ler
+     */
+    void readFileBlocks(const vector<u_int32_t> &blocks, uint64_t pos, char *data, uint32_t size)
+    {
+        ReadPlan plan;
+        planBlocks(blocks, pos, data, size, plan);
+        if (!plan.reads.empty())
+        {
+            cache.readBlocksDirect(plan.reads);
+        }
+        copyPartials(plan);
+    }
+
+    /**
+     * @brief Inicia em segundo plano a leitura dos blocos lógicos [first, first + count) de um arquivo
+     * Cada sequência contígua vira um pedido da fila assíncrona do gerenciador de disco;
+     * a cache é consultada somente quando a janela é consumida.
+     * 
+     * @param blocks Blocos de dados do arquivo, em ordem lógica
+     * @param ra Janela a ser preenchida
+     * @param first Primeiro bloco lógico
+     * @param count Número de blocos
+     */
+    void startReadahead(const vector<u_int32_t> &blocks, Readahead &ra, u_int32_t first, u_int32_t count)
+    {
+        // Sequências de blocos fisicamente contíguos: (primeiro bloco, tamanho)
+        vector<pair<u_int32_t, u_int32_t>> runs;
+        for (u_int32_t k = first; k < first + count; k++)
+        {
+            if (!runs.empty() && blocks[k] == runs.back().first + runs.back().second)
+            {
+                runs.back().second++;
+            }
+            else
+            {
+                runs.push_back({blocks[k], 1});
+            }
+        }
+
+        ra.first = first;
+        ra.count = count;
+        ra.buffer.resize((size_t)count * BLOCK_SIZE);
+        ra.generation = dataGeneration;
+        ra.writebacks = cache.writebacks;
+        ra.pending.reset(new typename DiskManager::BlockQueue(diskManager));
+        char *out = ra.buffer.data();
+        for (const auto &run : runs)
+        {
+            ra.pending->read(run.first, run.second, out);
+            out += (size_t)run.second * BLOCK_SIZE;
+        }
+        ra.pending->submit();
+        readaheadIssued++;
+    }
+
+    /**
+     * @brief Espera a leitura de uma janela terminar
+     * 
+     * @return true se a janela pode ser usada (leitura concluída e dados não alterados desde então)
+     */
+    bool finishReadahead(Readahead &ra)
+    {
+        if (ra.pending != nullptr)
+        {
+            try
+            {
+                ra.pending->drain();
+                ra.pending.reset();
+            }
+            catch (const exception &e)
+            {
+                ra.pending.reset();
+                cerr << "Erro na leitura antecipada: " << e.what() << endl;
+                return false;
+            }
+        }
+        return ra.generation == dataGeneration && ra.writebacks == cache.writebacks;
+    }
+
+    /**
+     * @brief Descarta as janelas de leitura antecipada de um descritor (com a trava do descritor)
+     * 
+     */
+    void dropReadahead(OpenFile &file)
+    {
+        for (Readahead &ra : file.ahead)
+        {
+            if (ra.count > 0)
+            {
+                finishReadahead(ra);
+                ra = Readahead();
+                readaheadDiscarded++;
+            }
+        }
+    }
+
+    // Verificação de consistência (fsck): o disco é percorrido em níveis a partir do diretório raiz. Os blocos de
+    // cada nível são ordenados, divididos entre as threads e lidos em lotes grandes (scanBlocks); cada bloco
+    // alcançado é marcado em um bitmap atômico, e uma segunda marcação do mesmo bloco é uma referência dupla.
+    enum FsckKind : uint8_t
+    {
+        FSCK_ENTRIES,   // Bloco de entradas de diretório (o do raiz é o próprio root_dir_index)
+        FSCK_DIR_INDEX, // Bloco de índice de um subdiretório
+        FSCK_FILE_INDEX, // Bloco de índice de um arquivo (em cadeia, raiz de uma árvore ou primeiro bloco de extensões)
+        FSCK_FILE_TREE, // Bloco indireto da árvore de um arquivo
+        FSCK_FILE_EXTENTS, // Bloco de extensões seguinte de um arquivo
+        FSCK_DIR_NODE   // Nó abaixo da raiz do índice por hash de um subdiretório
+    };
+
+    // Correções, aplicadas depois do percurso por uma única thread
+    enum FsckAction : uint8_t
+    {
+        FSCK_CUT,          // O ponteiro (ou o indirect_ptr) passa a 0xFFFFFFFF
+        FSCK_CLONE,        // Bloco de dados compartilhado: o arquivo passa a apontar para uma cópia
+        FSCK_ZERO,         // Ponteiro de dados inválido: o arquivo passa a apontar para um bloco zerado
+        FSCK_REMOVE_ENTRY, // A entrada de diretório é apagada
+        FSCK_TRUNCATE,     // file_size da entrada passa a value bytes
+        FSCK_CLONE_EXTENT, // Extensão com blocos compartilhados: o arquivo passa a apontar para uma cópia contígua
+        FSCK_REMOVE_PAIR   // O par do nó do índice por hash que aponta para value é retirado
+    };
+
+    struct FsckItem
+    {
+        u_int32_t block;      // Bloco a ser lido
+        FsckKind kind;
+        u_int32_t entryBlock; // Entrada do arquivo dono do bloco de índice
+        u_int32_t entrySlot;
+        u_int32_t chainPos;   // Posição do bloco de índice na cadeia (árvore: níveis abaixo do bloco indireto;
+                              // extensões: bloco de extensões anterior; índice por hash: nó pai)
+        uint32_t fileSize;    // file_size da entrada
+    };
+
+    struct FsckFix
+    {
+        u_int32_t block;   // Bloco que guarda o ponteiro ou a entrada
+        u_int32_t slot;    // Ponteiro (INDEX_PTRS = indirect_ptr) ou entrada
+        FsckAction action;
+        uint32_t value;
+    };
+
+    // Blocos de dados encontrados em um bloco da árvore (ou de extensões) de um arquivo
+    struct FsckTreeBlocks
+    {
+        uint64_t file;     // Entrada do arquivo (bloco << 32 | posição)
+        uint64_t blocks;
+        uint32_t fileSize;
+    };
+
+    // Resultado de uma thread em um nível do percurso
+    struct FsckWork
+    {
+        vector<FsckItem> next;
+        vector<FsckFix> fixes;
+        vector<FsckTreeBlocks> trees;
+        FsckReport report;
+    };
+
+    atomic<uint64_t> *fsckReachable = nullptr; // Blocos já alcançados no percurso em andamento
+
+    static void fsckNote(FsckReport &report, const string &message)
+    {
+        if (report.messages.size() < FSCK_MAX_MESSAGES)
+        {
+            report.messages.push_back(message);
+        }
+    }
+
+    static void fsckMerge(FsckReport &into, const FsckReport &from)
+    {
+        into.directories += from.directories;
+        into.files += from.files;
+        into.leakedBlocks += from.leakedBlocks;
+        into.unmarkedBlocks += from.unmarkedBlocks;
+        into.doubleAllocated += from.doubleAllocated;
+        into.invalidPointers += from.invalidPointers;
+        into.invalidEntries += from.invalidEntries;
+        into.sizeMismatches += from.sizeMismatches;
+        for (const string &message : from.messages)
+        {
+            fsckNote(into, message);
+        }
+    }
+
+    /**
+     * @brief Ponteiro para um bloco que pode pertencer a um arquivo ou diretório (fora da área reservada)
+     * 
+     */
+    bool fsckValid(u_int32_t block)
+    {
+        return block > superblock.root_dir_index + superblock.journal_blocks && block < superblock.total_blocks;
+    }
+
+    /**
+     * @brief Marca um bloco como alcançado
+     * 
+     * @return false se ele já tinha sido alcançado por outra referência
+     */
+    bool fsckClaim(u_int32_t block)
+    {
+        uint64_t bit = (uint64_t)1 << (block & 63);
+        return (fsckReachable[block >> 6].fetch_or(bit, memory_order_relaxed) & bit) == 0;
+    }
+
+    /**
+     * @brief Confere um bloco do percurso: as referências válidas ainda não alcançadas entram no próximo nível
+     * 
+     * @param item Bloco e o que ele deve conter
+     * @param data Conteúdo do bloco
+     * @param work Resultado da thread
+     */
+    void fsckVisit(const FsckItem &item, const char *data, FsckWork &work)
+    {
+        FsckReport &report = work.report;
+        if (item.kind == FSCK_ENTRIES)
+        {
+            u_int32_t perBlock = entriesPerBlock(item.block);
+            for (u_int32_t slot = 0; slot < perBlock; slot++)
+            {
+                RootDirEntry entry;
+                memcpy((void *)&entry, data + slot * ENTRY_SIZE, sizeof(RootDirEntry));
+                if (entry.filename[0] == '\0')
+                {
+                    continue;
+                }
+                string problem;
+                if (!entry.nameTerminated() || (!isRegularFile(entry.file_type) && entry.file_type != '2'))
+                {
+                    report.invalidEntries++;
+                    problem = "nome ou tipo inválido";
+                }
+                else if (!fsckValid(entry.index_block))
+                {
+                    report.invalidEntries++;
+                    problem = "bloco de índice " + to_string(entry.index_block) + " inválido";
+                }
+                else if (!fsckClaim(entry.index_block))
+                {
+                    report.doubleAllocated++;
+                    problem = "bloco de índice " + to_string(entry.index_block) + " já pertence a outro arquivo ou diretório";
+                }
+                if (!problem.empty())
+                {
+                    fsckNote(report, "Entrada " + to_string(slot) + " do bloco " + to_string(item.block) + ": " + problem);
+                    work.fixes.push_back({item.block, slot, FSCK_REMOVE_ENTRY, 0});
+                    continue;
+                }
+                bool directory = entry.file_type == '2';
+                directory ? report.directories++ : report.files++;
+                work.next.push_back({entry.index_block, directory ? FSCK_DIR_INDEX : FSCK_FILE_INDEX, item.block, slot, 0, entry.file_size});
+            }
+            return;
+        }
+
+        const IndexBlock *ib = reinterpret_cast<const IndexBlock *>(data);
+        if (item.kind == FSCK_FILE_INDEX && ib->indirect_ptr == INDEX_INLINE)
+        {
+            // Dados no próprio bloco de índice: nada a seguir, só o tamanho a conferir
+            if (item.fileSize > INLINE_BYTES)
+            {
+                report.sizeMismatches++;
+                fsckNote(report, "Entrada " + to_string(item.entrySlot) + " do bloco " + to_string(item.entryBlock) + ": tamanho " +
+                                     to_string(item.fileSize) + " maior que os " + to_string(INLINE_BYTES) + " bytes de dados do arquivo");
+                work.fixes.push_back({item.entryBlock, item.entrySlot, FSCK_TRUNCATE, INLINE_BYTES});
+            }
+            return;
+        }
+        if (item.kind == FSCK_FILE_TREE || (item.kind == FSCK_FILE_INDEX && ib->indirect_ptr == INDEX_TREE))
+        {
+            fsckVisitTree(item, ib, work);
+            return;
+        }
+        if (item.kind == FSCK_FILE_EXTENTS || (item.kind == FSCK_FILE_INDEX && ib->indirect_ptr == INDEX_EXTENTS))
+        {
+            fsckVisitExtents(item, ib, work);
+            return;
+        }
+        if (item.kind == FSCK_DIR_NODE || (item.kind == FSCK_DIR_INDEX && ib->indirect_ptr == INDEX_HASHED))
+        {
+            fsckVisitHashed(item, ib, work);
+            return;
+        }
+        bool file = item.kind == FSCK_FILE_INDEX;
+        u_int32_t dataBlocks = 0;
+        for (u_int32_t i = 0; i <= INDEX_PTRS; i++)
+        {
+            u_int32_t ptr = i < INDEX_PTRS ? ib->block_ptrs[i] : ib->indirect_ptr;
+            if (ptr == 0xFFFFFFFF)
+            {
+                continue;
+            }
+            string problem;
+            FsckAction action = FSCK_CUT;
+            if (!fsckValid(ptr))
+            {
+                report.invalidPointers++;
+                problem = " inválido";
+                action = file && i < INDEX_PTRS ? FSCK_ZERO : FSCK_CUT;
+            }
+            else if (!fsckClaim(ptr))
+            {
+                report.doubleAllocated++;
+                problem = " já pertence a outro arquivo ou diretório";
+                action = file && i < INDEX_PTRS ? FSCK_CLONE : FSCK_CUT;
+            }
+            if (!problem.empty())
+            {
+                fsckNote(report, "Bloco de índice " + to_string(item.block) + (i < INDEX_PTRS ? ", ponteiro " + to_string(i) : ", indirect_ptr") +
+                                     ": bloco " + to_string(ptr) + problem);
+                work.fixes.push_back({item.block, i, action, 0});
+                if (action != FSCK_CUT)
+                {
+                    dataBlocks++;
+                }
+                continue;
+            }
+            if (i == INDEX_PTRS)
+            {
+                work.next.push_back({ptr, item.kind, item.entryBlock, item.entrySlot, item.chainPos + 1, item.fileSize});
+                return;
+            }
+            if (file)
+            {
+                dataBlocks++;
+            }
+            else
+            {
+                work.next.push_back({ptr, FSCK_ENTRIES, 0, 0, 0, 0});
+            }
+        }
+
+        // Fim da cadeia do arquivo: o tamanho não pode passar dos blocos de dados (os blocos de índice anteriores estão cheios)
+        uint64_t capacity = ((uint64_t)item.chainPos * INDEX_PTRS + dataBlocks) * BLOCK_SIZE;
+        if (file && item.fileSize > capacity)
+        {
+            report.sizeMismatches++;
+            fsckNote(report, "Entrada " + to_string(item.entrySlot) + " do bloco " + to_string(item.entryBlock) + ": tamanho " +
+                                 to_string(item.fileSize) + " maior que os " + to_string(capacity) + " bytes de dados do arquivo");
+            work.fixes.push_back({item.entryBlock, item.entrySlot, FSCK_TRUNCATE, (uint32_t)capacity});
+        }
+    }
+
+    /**
+     * @brief Confere um bloco da árvore de índices de um arquivo (o raiz ou um bloco indireto)
+     * O tamanho do arquivo é conferido no fim do percurso, com os blocos de dados de todos os níveis.
+     * 
+     */
+    void fsckVisitTree(const FsckItem &item, const IndexBlock *ib, FsckWork &work)
+    {
+        bool root = item.kind == FSCK_FILE_INDEX;
+        u_int32_t words = root ? TREE_DIRECT + 3 : TREE_FANOUT;
+        uint64_t dataBlocks = 0;
+        for (u_int32_t i = 0; i < words; i++)
+        {
+            u_int32_t ptr = ib->word(i);
+            if (ptr == 0xFFFFFFFF)
+            {
+                continue;
+            }
+            bool data = root ? i < TREE_DIRECT : item.chainPos == 0;
+            string problem;
+            FsckAction action = FSCK_CUT;
+            if (!fsckValid(ptr))
+            {
+                work.report.invalidPointers++;
+                problem = " inválido";
+                action = data ? FSCK_ZERO : FSCK_CUT;
+            }
+            else if (!fsckClaim(ptr))
+            {
+                work.report.doubleAllocated++;
+                problem = " já pertence a outro arquivo ou diretório";
+                action = data ? FSCK_CLONE : FSCK_CUT;
+            }
+            if (!problem.empty())
+            {
+                fsckNote(work.report, "Bloco de índice " + to_string(item.block) + ", ponteiro " + to_string(i) + ": bloco " + to_string(ptr) + problem);
+                work.fixes.push_back({item.block, i, action, 0});
+                dataBlocks += action != FSCK_CUT ? 1 : 0;
+                continue;
+            }
+            if (data)
+            {
+                dataBlocks++;
+            }
+            else
+            {
+                work.next.push_back({ptr, FSCK_FILE_TREE, item.entryBlock, item.entrySlot, root ? i - TREE_DIRECT : item.chainPos - 1, item.fileSize});
+            }
+        }
+        work.trees.push_back({(uint64_t)item.entryBlock << 32 | item.entrySlot, dataBlocks, item.fileSize});
+    }
+
+    /**
+     * @brief Confere um bloco de extensões de um arquivo: cada bloco de cada extensão é marcado como alcançado
+     * O tamanho do arquivo é conferido no fim do percurso, com os blocos de dados de todos os blocos de extensões.
+     * 
+     */
+    void fsckVisitExtents(const FsckItem &item, const IndexBlock *ib, FsckWork &work)
+    {
+        FsckReport &report = work.report;
+        if (ib->indirect_ptr != INDEX_EXTENTS)
+        {
+            // O bloco anterior aponta para algo que não é um bloco de extensões
+            report.invalidPointers++;
+            fsckNote(report, "Bloco de extensões " + to_string(item.chainPos) + ", próximo bloco " + to_string(item.block) + " inválido");
+            work.fixes.push_back({item.chainPos, EXTENT_NEXT, FSCK_CUT, 0});
+            return;
+        }
+        uint64_t dataBlocks = 0;
+        for (u_int32_t e = 0; e < EXTENTS; e++)
+        {
+            u_int32_t start = ib->block_ptrs[2 * e];
+            u_int32_t length = ib->block_ptrs[2 * e + 1];
+            if (start == 0xFFFFFFFF)
+            {
+                continue;
+            }
+            if (length == 0 || !fsckValid(start) || (uint64_t)start + length > superblock.total_blocks)
+            {
+                report.invalidPointers++;
+                fsckNote(report, "Bloco de extensões " + to_string(item.block) + ", extensão " + to_string(e) + ": blocos " + to_string(start) +
+                                     " a " + to_string((uint64_t)start + length) + " inválidos");
+                work.fixes.push_back({item.block, 2 * e, FSCK_CUT, 0});
+                continue;
+            }
+            u_int32_t shared = 0;
+            for (u_int32_t i = 0; i < length; i++)
+            {
+                shared += fsckClaim(start + i) ? 0 : 1;
+            }
+            if (shared > 0)
+            {
+                report.doubleAllocated += shared;
+                fsckNote(report, "Bloco de extensões " + to_string(item.block) + ", extensão " + to_string(e) + ": " + to_string(shared) +
+                                     " blocos já pertencem a outro arquivo ou diretório");
+                work.fixes.push_back({item.block, 2 * e, FSCK_CLONE_EXTENT, 0});
+            }
+            dataBlocks += length;
+        }
+
+        u_int32_t next = ib->block_ptrs[EXTENT_NEXT];
+        if (next != 0xFFFFFFFF)
+        {
+            string problem;
+            if (!fsckValid(next))
+            {
+                report.invalidPointers++;
+                problem = " inválido";
+            }
+            else if (!fsckClaim(next))
+            {
+                report.doubleAllocated++;
+                problem = " já pertence a outro arquivo ou diretório";
+            }
+            if (problem.empty())
+            {
+                work.next.push_back({next, FSCK_FILE_EXTENTS, item.entryBlock, item.entrySlot, item.block, item.fileSize});
+            }
+            else
+            {
+                fsckNote(report, "Bloco de extensões " + to_string(item.block) + ": próximo bloco " + to_string(next) + problem);
+                work.fixes.push_back({item.block, EXTENT_NEXT, FSCK_CUT, 0});
+            }
+        }
+        work.trees.push_back({(uint64_t)item.entryBlock << 32 | item.entrySlot, dataBlocks, item.fileSize});
+    }
+
+    /**
+     * @brief Confere um nó do índice por hash de um diretório: os filhos são nós (nível acima de 0) ou folhas
+     * Um filho inválido ou já alcançado sai do nó (as entradas dele são perdidas); a ordem dos hashes não é conferida.
+     * 
+     */
+    void fsckVisitHashed(const FsckItem &item, const IndexBlock *ib, FsckWork &work)
+    {
+        FsckReport &report = work.report;
+        u_int32_t level = ib->block_ptrs[0];
+        u_int32_t count = ib->block_ptrs[1];
+        if (ib->indirect_ptr != INDEX_HASHED || count == 0 || count > HASH_PAIRS || level >= DIR_HASH_MAX_DEPTH)
+        {
+            report.invalidPointers++;
+            fsckNote(report, "Nó " + to_string(item.block) + " do índice de diretório inválido");
+            if (item.kind == FSCK_DIR_INDEX)
+            {
+                work.fixes.push_back({item.entryBlock, item.entrySlot, FSCK_REMOVE_ENTRY, 0});
+            }
+            else
+            {
+                work.fixes.push_back({item.chainPos, 0, FSCK_REMOVE_PAIR, item.block});
+            }
+            return;
+        }
+        for (u_int32_t i = 0; i < count; i++)
+        {
+            u_int32_t ptr = ib->block_ptrs[3 + 2 * i];
+            string problem;
+            if (!fsckValid(ptr))
+            {
+                report.invalidPointers++;
+                problem = " inválido";
+            }
+            else if (!fsckClaim(ptr))
+            {
+                report.doubleAllocated++;
+                problem = " já pertence a outro arquivo ou diretório";
+            }
+            if (!problem.empty())
+            {
+                fsckNote(report, "Nó " + to_string(item.block) + " do índice de diretório: bloco " + to_string(ptr) + problem);
+                work.fixes.push_back({item.block, 0, FSCK_REMOVE_PAIR, ptr});
+            }
+            else if (level == 0)
+            {
+                work.next.push_back({ptr, FSCK_ENTRIES, 0, 0, 0, 0});
+            }
+            else
+            {
+                work.next.push_back({ptr, FSCK_DIR_NODE, item.entryBlock, item.entrySlot, item.block, 0});
+            }
+        }
+    }
+
+    /**
+     * @brief Um percurso completo: marca os blocos alcançáveis e os compara, 64 bits por vez, com o bitmap
+     * 
+     * @param threads Threads do percurso
+     * @param report Recebe os problemas encontrados
+     * @param fixes Recebe as correções das referências
+     * @param leaked Recebe os blocos ocupados no bitmap sem nenhuma referência
+     * @param unmarked Recebe os blocos em uso livres no bitmap
+     */
+    void fsckPass(u_int32_t threads, FsckReport &report, vector<FsckFix> &fixes, vector<u_int32_t> &leaked, vector<u_int32_t> &unmarked)
+    {
+        size_t words = ((size_t)superblock.total_blocks + 63) / 64;
+        unique_ptr<atomic<uint64_t>[]> reachable(new atomic<uint64_t>[words]());
+        fsckReachable = reachable.get();
+        for (u_int32_t block = 0; block <= superblock.root_dir_index + superblock.journal_blocks; block++)
+        {
+            fsckClaim(block); // Superbloco, bitmap, diretório raiz e diário
+        }
+        report.directories++;
+
+        unordered_map<uint64_t, pair<uint64_t, uint32_t>> trees; // Arquivo com árvore ou extensões -> (blocos de dados, tamanho)
+        vector<FsckItem> level = {{superblock.root_dir_index, FSCK_ENTRIES, 0, 0, 0, 0}};
+        while (!level.empty())
+        {
+            // Em ordem de bloco, as leituras de cada thread viram poucas leituras grandes
+            sort(level.begin(), level.end(), [](const FsckItem &a, const FsckItem &b)
+                 { return a.block < b.block; });
+            u_int32_t workers = getMax<size_t>(1, getMin<size_t>(threads, level.size() / FSCK_MIN_ITEMS));
+            vector<FsckWork> work(workers);
+            vector<exception_ptr> errors(workers);
+            auto run = [&](u_int32_t w)
+            {
+                try
+                {
+                    size_t first = level.size() * w / workers;
+                    size_t end = level.size() * (w + 1) / workers;
+                    vector<u_int32_t> blocks;
+                    for (size_t i = first; i < end; i++)
+                    {
+                        blocks.push_back(level[i].block);
+                    }
+                    size_t next = first;
+                    scanBlocks(blocks, [&](u_int32_t, const char *data)
+                               { fsckVisit(level[next++], data, work[w]); });
+                }
+                catch (...)
+                {
+                    errors[w] = current_exception();
+                }
+            };
+            vector<thread> pool;
+            for (u_int32_t w = 1; w < workers; w++)
+            {
+                pool.emplace_back(run, w);
+            }
+            run(0);
+            for (thread &worker : pool)
+            {
+                worker.join();
+            }
+            for (exception_ptr &error : errors)
+            {
+                if (error)
+                {
+                    rethrow_exception(error);
+                }
+            }
+
+            level.clear();
+            for (FsckWork &w : work)
+            {
+                level.insert(level.end(), w.next.begin(), w.next.end());
+                fixes.insert(fixes.end(), w.fixes.begin(), w.fixes.end());
+                fsckMerge(report, w.report);
+                for (const FsckTreeBlocks &tree : w.trees)
+                {
+                    trees[tree.file].first += tree.blocks;
+                    trees[tree.file].second = tree.fileSize;
+                }
+            }
+        }
+        for (const auto &tree : trees)
+        {
+            uint64_t capacity = tree.second.first * BLOCK_SIZE;
+            if (tree.second.second > capacity)
+            {
+                u_int32_t entryBlock = tree.first >> 32;
+                u_int32_t entrySlot = tree.first & 0xFFFFFFFF;
+                report.sizeMismatches++;
+                fsckNote(report, "Entrada " + to_string(entrySlot) + " do bloco " + to_string(entryBlock) + ": tamanho " +
+                                     to_string(tree.second.second) + " maior que os " + to_string(capacity) + " bytes de dados do arquivo");
+                fixes.push_back({entryBlock, entrySlot, FSCK_TRUNCATE, (uint32_t)capacity});
+            }
+        }
+
+        const uint64_t *used = reinterpret_cast<const uint64_t *>(bitmap.data());
+        for (size_t i = 0; i < words; i++)
+        {
+            uint64_t reach = reachable[i].load(memory_order_relaxed);
+            uint64_t mask = i == words - 1 && superblock.total_blocks % 64 != 0 ? ((uint64_t)1 << (superblock.total_blocks % 64)) - 1 : ~(uint64_t)0;
+            report.reachableBlocks += __builtin_popcountll(reach);
+            for (uint64_t bits = used[i] & ~reach & mask; bits != 0; bits &= bits - 1)
+            {
+                leaked.push_back(i * 64 + __builtin_ctzll(bits));
+            }
+            for (uint64_t bits = reach & ~used[i]; bits != 0; bits &= bits - 1)
+            {
+                unmarked.push_back(i * 64 + __builtin_ctzll(bits));
+            }
+        }
+        fsckReachable = nullptr;
+        report.leakedBlocks += leaked.size();
+        report.unmarkedBlocks += unmarked.size();
+        if (!leaked.empty())
+        {
+            fsckNote(report, to_string(leaked.size()) + " blocos ocupados no bitmap sem nenhuma referência (primeiro: " + to_string(leaked[0]) + ")");
+        }
+        if (!unmarked.empty())
+        {
+            fsckNote(report, to_string(unmarked.size()) + " blocos em uso livres no bitmap (primeiro: " + to_string(unmarked[0]) + ")");
+        }
+    }
+
+    /**
+     * @brief Aplica as correções de um percurso (os metadados corrigidos passam pelo diário)
+     * 
+     */
+    void fsckRepair(const vector<FsckFix> &fixes, const vector<u_int32_t> &leaked, const vector<u_int32_t> &unmarked)
+    {
+        // Primeiro os blocos em uso: as cópias feitas abaixo não podem recebê-los
+        for (u_int32_t block : unmarked)
+        {
+            AllocShard &shard = shardOf(block);
+            lock_guard<mutex> guard(shard.lock);
+            bitmap.set(block);
+            shard.dirty = true;
+        }
+        if (!unmarked.empty())
+        {
+            freeBlocksCount -= unmarked.size();
+            superblockDirty = true;
+        }
+
+        for (const FsckFix &fix : fixes)
+        {
+            alignas(uint64_t) char buffer[BLOCK_SIZE];
+            cache.readBlock(fix.block, buffer);
+            if (fix.action == FSCK_REMOVE_ENTRY || fix.action == FSCK_TRUNCATE)
+            {
+                RootDirEntry entry;
+                memcpy((void *)&entry, buffer + fix.slot * ENTRY_SIZE, sizeof(RootDirEntry));
+                if (fix.action == FSCK_REMOVE_ENTRY)
+                {
+                    entry = RootDirEntry();
+                }
+                else
+                {
+                    entry.file_size = fix.value;
+                }
+                memcpy(buffer + fix.slot * ENTRY_SIZE, (const void *)&entry, sizeof(RootDirEntry));
+            }
+            else if (fix.action == FSCK_REMOVE_PAIR)
+            {
+                IndexBlock *ib = reinterpret_cast<IndexBlock *>(buffer);
+                u_int32_t count = getMin(ib->block_ptrs[1], HASH_PAIRS);
+                u_int32_t i = 0;
+                while (i < count && ib->block_ptrs[3 + 2 * i] != fix.value)
+                {
+                    i++;
+                }
+                if (i < count && count == 1)
+                {
+                    // O nó ficaria vazio: passa a apontar para uma única folha nova, vazia. Sem um bloco livre, vira
+                    // um índice linear vazio: na raiz, o diretório deixa de ter o índice por hash; num nó interno, o
+                    // próximo percurso o retira do nó de cima.
+                    u_int32_t block = allocBlock();
+                    if (block == 0xFFFFFFFF)
+                    {
+                        *ib = IndexBlock();
+                    }
+                    else
+                    {
+                        char empty[BLOCK_SIZE];
+                        memset(empty, 0x00, BLOCK_SIZE);
+                        cache.writeMetadata(block, empty);
+                        ib->block_ptrs[0] = 0;
+                        ib->block_ptrs[3] = block;
+                    }
+                }
+                else if (i < count)
+                {
+                    // O par anterior (ou o seguinte, se for o primeiro) passa a cobrir o intervalo do par retirado
+                    uint32_t lower = ib->block_ptrs[2 + 2 * i];
+                    copy(ib->block_ptrs + 4 + 2 * i, ib->block_ptrs + 2 + 2 * count, ib->block_ptrs + 2 + 2 * i);
+                    ib->block_ptrs[2 * count] = ib->block_ptrs[2 * count + 1] = 0xFFFFFFFF;
+                    ib->block_ptrs[1] = count - 1;
+                    if (i == 0)
+                    {
+                        ib->block_ptrs[2] = lower;
+                    }
+                }
+            }
+            else
+            {
+                IndexBlock *ib = reinterpret_cast<IndexBlock *>(buffer);
+                u_int32_t &ptr = fix.slot == INDEX_PTRS ? ib->indirect_ptr : ib->block_ptrs[fix.slot];
+                if (fix.action == FSCK_CUT)
+                {
+                    ptr = 0xFFFFFFFF;
+                }
+                else if (fix.action == FSCK_CLONE_EXTENT)
+                {
+                    // Sem uma sequência livre do mesmo tamanho, a extensão é cortada (o tamanho é corrigido no próximo percurso)
+                    u_int32_t length = ib->block_ptrs[fix.slot + 1];
+                    u_int32_t start = allocExtent(length);
+                    char copy[BLOCK_SIZE];
+                    for (u_int32_t i = 0; start != 0xFFFFFFFF && i < length; i++)
+                    {
+                        cache.readBlock(ptr + i, copy);
+                        cache.writeBlock(start + i, copy);
+                    }
+                    ptr = start;
+                }
+                else
+                {
+                    char copy[BLOCK_SIZE];
+                    memset(copy, 0x00, BLOCK_SIZE);
+                    if (fix.action == FSCK_CLONE)
+                    {
+                        cache.readBlock(ptr, copy);
+                    }
+                    // Sem um bloco livre, o ponteiro é cortado (o tamanho é corrigido no próximo percurso)
+                    u_int32_t block = allocBlock();
+                    if (block != 0xFFFFFFFF)
+                    {
+                        cache.writeBlock(block, copy);
+                    }
+                    ptr = block;
+                }
+            }
+            cache.writeMetadata(fix.block, buffer);
+        }
+
+        if (!leaked.empty())
+        {
+            releaseBlocks(leaked);
+        }
+        flushAllocMetadata();
+    }
+
+protected:
+    /**
+     * @brief Formata o disco: cria a imagem e escreve o superbloco, o bitmap, o diretório raiz e o cabeçalho do diário
+     * Os metadados iniciais ocupam os blocos 0 a root_dir_index + 1 e são escritos com um único pwritev;
+     * o restante do diário (logo após o diretório raiz) não precisa ser escrito.
+     * 
+     * @param numBlocks Número de blocos do sistema de arquivos
+     * @param allocation Forma de alocação da imagem (esparsa, pré-alocada ou zerada)
+     * @param journalBlocks Blocos do diário de metadados (JOURNAL_AUTO: 1/32 do disco, até JOURNAL_MAX_BYTES; 0: sem diário)
+     */
+    void formatDisk(u_int32_t numBlocks, ImageAllocation allocation, u_int32_t journalBlocks) override
+    {
+        if (numBlocks < 4)
+        {
+            throw runtime_error("Número de blocos insuficiente!");
+        }
+        if (journalBlocks == JOURNAL_AUTO)
+        {
+            journalBlocks = getMin<u_int32_t>(numBlocks / 32, JOURNAL_MAX_BYTES / BLOCK_SIZE);
+            journalBlocks = journalBlocks < JOURNAL_MIN_BLOCKS ? 0 : journalBlocks;
+        }
+        u_int32_t reserved = calcNumBlocksBitmap(numBlocks) + 2; // Superbloco, bitmap e diretório raiz
+        if (journalBlocks > 0 && (journalBlocks < JOURNAL_MIN_BLOCKS || journalBlocks >= numBlocks - getMin(numBlocks, reserved)))
+        {
+            throw runtime_error("Tamanho do diário de metadados inválido para o disco!");
+        }
+
+        // Inicializa o vetor de bitmap
+        bitmap.reset(numBlocks, BLOCK_SIZE * calcNumBlocksBitmap(numBlocks), BLOCK_SIZE);
+        // Inicializa o vetor de entradas de diretório raiz
+        rootDir.resize(BLOCK_SIZE / ENTRY_SIZE);
+        // Inicializa o superbloco
+        superblock.total_blocks = numBlocks;
+        superblock.block_size = __builtin_ctz(BLOCK_SIZE) - __builtin_ctz(MIN_BLOCK_SIZE);
+        superblock.bitmap_blocks = calcNumBlocksBitmap(numBlocks);
+        superblock.root_dir_index = superblock.bitmap_blocks + 1;
+        superblock.journal_start = journalBlocks > 0 ? superblock.root_dir_index + 1 : 0;
+        superblock.journal_blocks = journalBlocks;
+        superblock.free_blocks = numBlocks - superblock.root_dir_index - 1 - journalBlocks;
+
+        diskManager.create((uint64_t)numBlocks * BLOCK_SIZE, allocation);
+        bitmap.setRange(0, superblock.bitmap_start + superblock.bitmap_blocks + 1 + journalBlocks);
+        bitmap.takeDirtyBlocks();
+        setupShards();
+        freeBlocksCount = superblock.free_blocks;
+        superblock.checksum = superblockChecksum(superblock);
+
+        //Superbloco, todos os blocos do bitmap, o diretório raiz vazio e o cabeçalho do diário em uma única escrita.
+        //A sequência inicial é aleatória: restos de um diário anterior no mesmo dispositivo nunca são aceitos.
+        char superblockBuffer[BLOCK_SIZE];
+        char rootBuffer[BLOCK_SIZE];
+        char journalBuffer[BLOCK_SIZE];
+        memset(superblockBuffer, 0x00, BLOCK_SIZE);
+        memcpy(superblockBuffer, (const void *)&superblock, sizeof(Superblock));
+        memset(rootBuffer, 0x00, BLOCK_SIZE);
+        memset(journalBuffer, 0x00, BLOCK_SIZE);
+        journalSequence = random_device()();
+        JournalRecord header(JOURNAL_HEADER, journalSequence, journalBlocks);
+        header.checksum = crc32(&header, sizeof(JournalRecord));
+        memcpy(journalBuffer, (const void *)&header, sizeof(JournalRecord));
+        iovec iov[4] = {
+            {superblockBuffer, BLOCK_SIZE},
+            {bitmap.data(), (size_t)superblock.bitmap_blocks * BLOCK_SIZE},
+            {rootBuffer, BLOCK_SIZE},
+            {journalBuffer, BLOCK_SIZE}};
+        diskManager.writeBlocksv(0, iov, journalBlocks > 0 ? 4 : 3);
+        startJournal();
 
         cout << "Sistema de arquivos criado com sucesso!" << endl;
+    }
+
+    /**
+     * @brief Le o superbloco direto do disco e o valida
+     * 
+     */
+    void readSuperblock()
+    {
+        char buffer[BLOCK_SIZE];
+        diskManager.readBlock(0, buffer);
+        memcpy((void *)&superblock, buffer, sizeof(Superblock));
+        checkSuperblock(superblock);
+        if (superblock.version < 3)
+        {
+            superblock.journal_start = 0;
+            superblock.journal_blocks = 0;
+        }
+    }
+
+    /**
+     * @brief Monta um disco já formatado: valida o superbloco, reaplica o diário de metadados,
+     * carrega o bitmap inteiro com uma única leitura e indexa o diretório raiz
+     * 
+     */
+    void loadDisk() override
+    {
+        uint64_t imageSize = diskManager.size();
+        if (imageSize < BLOCK_SIZE)
+        {
+            throw runtime_error("O disco não contém um sistema de arquivos válido!");
+        }
+        readSuperblock();
+        if (decodeBlockSize(superblock.block_size) != BLOCK_SIZE)
+        {
+            throw runtime_error("Tamanho de bloco do superbloco diferente do esperado!");
+        }
+        if (superblock.total_blocks < 4 || (uint64_t)superblock.total_blocks * BLOCK_SIZE > imageSize ||
+            superblock.bitmap_start != 1 || superblock.bitmap_blocks != calcNumBlocksBitmap(superblock.total_blocks) ||
+            superblock.root_dir_index != superblock.bitmap_blocks + 1 ||
+            (superblock.journal_blocks > 0 && (superblock.journal_start != superblock.root_dir_index + 1 ||
+                                               superblock.journal_blocks < JOURNAL_MIN_BLOCKS ||
+                                               (uint64_t)superblock.journal_start + superblock.journal_blocks > superblock.total_blocks)))
+        {
+            throw runtime_error("Geometria do superbloco inconsistente com o disco!");
+        }
+
+        // Desligamento sem commit ou queda: reaplicar as transações completas antes de ler qualquer metadado
+        if (superblock.journal_blocks > 0)
+        {
+            journalReplayed = replayJournal();
+            if (journalReplayed > 0)
+            {
+                cerr << "Aviso: " << journalReplayed << " transações do diário reaplicadas" << endl;
+                readSuperblock();
+            }
+        }
+        startJournal();
+
+        bitmap.reset(superblock.total_blocks, BLOCK_SIZE * superblock.bitmap_blocks, BLOCK_SIZE);
+        diskManager.readBlocks(superblock.bitmap_start, superblock.bitmap_blocks, bitmap.data());
+        uint32_t freeBlocks = bitmap.recount();
+        setupShards();
+        freeBlocksCount = freeBlocks;
+        if (freeBlocks != superblock.free_blocks)
+        {
+            // Desligamento sem sincronizar: o bitmap é a referência
+            cerr << "Aviso: free_blocks do superbloco (" << superblock.free_blocks << ") corrigido para " << freeBlocks << endl;
+            superblockDirty = true;
+            flushAllocMetadata();
+        }
+        rootDir.resize(BLOCK_SIZE / ENTRY_SIZE);
+        openDirIndex(superblock.root_dir_index);
+    }
+
+public:
+    /**
+     * @brief Construtor do sistema de arquivos (não acessa o disco; use FileSystem::mkfs ou FileSystem::mount)
+     * 
+     * @param path Caminho do disco
+     * @param backend Forma de acesso ao disco (pread/pwrite ou mmap)
+     * @param cacheBlocks Capacidade da cache de blocos (ignorada no modo MMAP)
+     */
+    SizedFileSystem(string &path, DiskBackend backend = DiskBackend::PREAD, u_int32_t cacheBlocks = CACHE_CAPACITY)
+        : diskManager(path, backend), cache(diskManager, backend == DiskBackend::MMAP ? 0 : cacheBlocks)
+    {
+    }
+
+    ~SizedFileSystem()
+    {
+        // Fechar os arquivos que ficaram abertos para não perder os índices em memória
+        while (!openFiles.empty())
+        {
+            try
+            {
+                closeFile(openFiles.begin()->first);
+            }
+            catch (const exception &e)
+            {
+                cerr << "Erro ao fechar o arquivo: " << e.what() << endl;
+            }
+        }
+        try
+        {
+            // Nenhuma outra thread usa o sistema de arquivos: devolver todos os caches de alocação
+            reclaimCaches(true);
+            superblockDirty = true;
+            if (journalActive)
+            {
+                // Desmontagem limpa: com tudo escrito no lugar, a próxima montagem não precisa reaplicar nada
+                commitJournal();
+                checkpointJournal();
+                diskManager.sync();
+                resetJournal();
+                diskManager.sync();
+            }
+            else
+            {
+                flushAllocMetadata();
+            }
+        }
+        catch (const exception &e)
+        {
+            cerr << "Erro ao escrever os metadados: " << e.what() << endl;
+        }
+    }
+
+    /**
+     * @brief Tamanho do bloco em bytes
+     * 
+     */
+    u_int32_t blockSize() const override
+    {
+        return BLOCK_SIZE;
+    }
+
+    /**
+     * @brief Descarrega os blocos sujos da cache e sincroniza o disco
+     * Com o diário, os metadados vão em um commit em grupo: chamadas concorrentes compartilham o mesmo fdatasync.
+     * 
+     */
+    void sync() override
+    {
+        // As alocações feitas pelos caches das threads não escrevem o superbloco: escrevê-lo agora
+        reclaimCaches(false);
+        cacheEpoch++;
+        superblockDirty = true;
+        if (journalActive)
+        {
+            commitJournal();
+            return;
+        }
+        flushAllocMetadata();
+        cache.sync();
+    }
+
+    /**
+     * @brief Aloca um bloco livre no disco
+     * 
+     * @return Retornao ponteiro do bloco alocado
+     */
+    u_int32_t allocBlock() override
+    {
+        return allocExtent(1);
+    }
+
+    /**
+     * @brief Aloca n blocos livres contíguos no disco
+     * Pedidos de até ALLOC_CACHE_BLOCKS blocos são atendidos pelo cache de alocação da thread.
+     * Nos demais, o bitmap em memória é a referência; a busca é feita 64 blocos por vez a partir do último bloco alocado,
+     * começando na partição da thread. Uma sequência não atravessa o limite entre partições.
+     * 
+     * @param n Número de blocos contíguos
+     * @return u_int32_t Primeiro bloco alocado, ou 0xFFFFFFFF se não houver uma sequência livre
+     */
+    u_int32_t allocExtent(u_int32_t n) override
+    {
+        u_int32_t start;
+        if (n > 0 && n <= ALLOC_CACHE_BLOCKS && takeCached(n, start))
+        {
+            noteAllocated(start, n);
+            return start;
+        }
+        if (n == 0 || !reserveBlocks(n))
+        {
+            cacheEpoch++; // Blocos parados nos caches de outras threads voltam na próxima alocação delas
+            return 0xFFFFFFFF; // Retorna erro se não houver blocos livres
+        }
+
+        start = BITMAP_NONE;
+        u_int32_t home = homeShard();
+        for (u_int32_t i = 0; i < numShards && start == BITMAP_NONE; i++)
+        {
+            AllocShard &shard = shards[(home + i) % numShards];
+            lock_guard<mutex> guard(shard.lock);
+            start = bitmap.allocExtentIn(n, shard.first, shard.end, shard.cursor);
+            if (start != BITMAP_NONE)
+            {
+                shard.dirty = true;
+            }
+        }
+        if (start == BITMAP_NONE)
+        {
+            freeBlocksCount += n;
+            return 0xFFFFFFFF;
+        }
+        superblockDirty = true;
+        noteAllocated(start, n);
+
+        flushAllocMetadata();
+        return start;
+    }
+
+    /**
+     * @brief Aloca count blocos em lote, preferindo sequências contíguas.
+     * Lotes de até ALLOC_CACHE_BLOCKS blocos saem contíguos do cache de alocação da thread.
+     * Nos demais, os blocos são reservados do total livre antes da busca e procurados primeiro na partição da thread.
+     * O bitmap e o superbloco são escritos uma única vez ao final do lote.
+     * 
+     * @param count Número de blocos a alocar
+     * @param out Recebe os blocos alocados (em ordem de alocação)
+     * @return true se todos os blocos foram alocados, false se não há blocos livres suficientes (nada é alocado)
+     */
+    bool allocBlocks(u_int32_t count, vector<u_int32_t> &out) override
+    {
+        u_int32_t start;
+        if (count > 0 && count <= ALLOC_CACHE_BLOCKS && takeCached(count, start))
+        {
+            for (u_int32_t i = 0; i < count; i++)
+            {
+                out.push_back(start + i);
+            }
+            noteAllocated(start, count);
+            return true;
+        }
+        if (!reserveBlocks(count))
+        {
+            cacheEpoch++; // Blocos parados nos caches de outras threads voltam na próxima alocação delas
+            return false;
+        }
+
+        out.reserve(out.size() + count);
+        u_int32_t remaining = count;
+        u_int32_t current = homeShard();
+        u_int32_t idle = 0; // Partições seguidas sem nenhum bloco livre
+        while (remaining > 0 && idle < numShards)
+        {
+            AllocShard &shard = shards[current];
+            u_int32_t taken = 0;
+            {
+                lock_guard<mutex> guard(shard.lock);
+                while (remaining > 0)
+                {
+                    u_int32_t length;
+                    u_int32_t start = bitmap.allocRunIn(remaining, shard.first, shard.end, shard.cursor, length);
+                    if (start == BITMAP_NONE)
+                    {
+                        break;
+                    }
+                    for (u_int32_t i = 0; i < length; i++)
+                    {
+                        out.push_back(start + i);
+                    }
+                    remaining -= length;
+                    taken += length;
+                }
+            }
+            if (taken > 0)
+            {
+                shard.dirty = true;
+                idle = 0;
+            }
+            else
+            {
+                idle++;
+            }
+            current = (current + 1) % numShards;
+        }
+        superblockDirty = true;
+
+        if (remaining > 0)
+        {
+            // A contagem e o bitmap discordam (ou blocos foram liberados em uma partição já percorrida): desfazer o lote
+            freeBlocksCount += remaining;
+            vector<u_int32_t> partial(out.end() - (count - remaining), out.end());
+            out.resize(out.size() - partial.size());
+            releaseBlocks(partial);
+            return false;
+        }
+        if (OpUndo *op = currentOp())
+        {
+            op->allocated.insert(op->allocated.end(), out.end() - count, out.end());
+        }
+
+        flushAllocMetadata();
+        return true;
+    }
+
+    /**
+     * @brief Registra na operação em andamento os blocos alocados (liberados de novo se ela falhar)
+     * 
+     */
+    void noteAllocated(u_int32_t start, u_int32_t count)
+    {
+        if (OpUndo *op = currentOp())
+        {
+            for (u_int32_t i = 0; i < count; i++)
+            {
+                op->allocated.push_back(start + i);
+            }
+        }
+    }
 
+    /**
+     * @brief Aloca count blocos começando, se possível, exatamente em goal (continuação da última extensão de um
+     * arquivo): primeiro pelo cache da thread, depois pelos blocos livres a partir de goal no bitmap; o restante vem de
+     * uma sequência contígua (allocExtent) ou, com o disco fragmentado, das maiores sequências disponíveis (allocBlocks).
+     * 
+     * @param goal Bloco desejado para o início (0xFFFFFFFF: qualquer um)
+     * @param count Número de blocos a alocar
+     * @param out Recebe os blocos alocados (em ordem de alocação)
+     * @return true se todos os blocos foram alocados, false se não há blocos livres suficientes (nada é alocado)
+     */
+    bool allocContiguous(u_int32_t goal, u_int32_t count, vector<u_int32_t> &out)
+    {
+        MetadataBatch batch(*this);
+        size_t first = out.size();
+        u_int32_t remaining = count;
+        if (goal < superblock.total_blocks && remaining > 0)
+        {
+            AllocCache &local = threadCache();
+            if (local.next == goal && local.next < local.end && local.epoch == cacheEpoch.load(memory_order_relaxed))
+            {
+                u_int32_t length = getMin(remaining, local.end - local.next);
+                for (u_int32_t i = 0; i < length; i++)
+                {
+                    out.push_back(goal + i);
+                }
+                local.next += length;
+                local.available.store(local.end - local.next, memory_order_relaxed);
+                noteAllocated(goal, length);
+                goal += length;
+                remaining -= length;
+            }
+        }
+        if (goal < superblock.total_blocks && remaining > 0 && reserveBlocks(remaining))
+        {
+            AllocShard &shard = shardOf(goal);
+            u_int32_t length;
+            {
+                lock_guard<mutex> guard(shard.lock);
+                length = bitmap.freeRunLength(goal, getMin(remaining, shard.end - goal));
+                if (length > 0)
+                {
+                    bitmap.setRange(goal, length);
+                    shard.dirty = true;
+                }
+            }
+            freeBlocksCount += remaining - length;
+            if (length > 0)
+            {
+                superblockDirty = true;
+                noteAllocated(goal, length);
+            }
+            for (u_int32_t i = 0; i < length; i++)
+            {
+                out.push_back(goal + i);
+            }
+            remaining -= length;
+        }
+        if (remaining > 0)
+        {
+            u_int32_t start = allocExtent(remaining);
+            if (start != 0xFFFFFFFF)
+            {
+                for (u_int32_t i = 0; i < remaining; i++)
+                {
+                    out.push_back(start + i);
+                }
+            }
+            else if (!allocBlocks(remaining, out))
+            {
+                vector<u_int32_t> taken(out.begin() + first, out.end());
+                out.resize(first);
+                if (OpUndo *op = currentOp())
+                {
+                    op->allocated.resize(op->allocated.size() - taken.size());
+                }
+                releaseBlocks(taken);
+                return false;
+            }
+        }
+        return true;
     }
 
     /**
-     * @brief Aloca um bloco livre no disco
+     * @brief Libera blocos em lote. Dentro de uma operação com o diário, os blocos só ficam livres quando ela termina
+     * (se ela falhar, continuam com o conteúdo que os metadados restaurados apontam).
      * 
-     * @return Retornao ponteiro do bloco alocado
+     * @param blocks Blocos a serem liberados
      */
-    u_int32_t allocBlock()
+    void freeBlocks(const vector<u_int32_t> &blocks) override
     {
-
-        if (superblock.free_blocks == 0)
+        for (u_int32_t blockIndex : blocks)
         {
-            return 0xFFFFFFFF; // Retorna erro se não houver blocos livres
+            if (blockIndex >= superblock.total_blocks)
+            {
+                throw runtime_error("Bloco Inválido!");
+            }
         }
-        char buffer[BLOCK_SIZE];
-
-        diskManager.readBlock(superblock.bitmap_start, (char*)bitmap.data());
-
-        for (u_int32_t i = 0; i < superblock.total_blocks; i++)
-        { // Começa do bloco 1
-            if (!(bitmap[i / 8] & (1 << (i % 8))))
-            {                                  // Se o bloco estiver livre
-                bitmap[i / 8] |= 1 << (i % 8); // Marcar o bloco como ocupado
-                superblock.free_blocks--;
+        if (OpUndo *op = currentOp())
+        {
+            op->freed.insert(op->freed.end(), blocks.begin(), blocks.end());
+            return;
+        }
+        releaseBlocks(blocks);
+    }
 
-                diskManager.writeBlock(superblock.bitmap_start, (char *)bitmap.data());
-                diskManager.writeBlock(0, (char *)&superblock);
-                return i; // Retorna o bloco alocado
+    /**
+     * @brief Libera blocos em lote imediatamente, escrevendo o bitmap e o superbloco uma única vez.
+     * Blocos consecutivos da mesma partição são liberados com uma única aquisição da trava.
+     * 
+     * @param blocks Blocos a serem liberados
+     */
+    void releaseBlocks(const vector<u_int32_t> &blocks)
+    {
+        revokeFreed(blocks);
+        uint32_t released = 0;
+        size_t next = 0;
+        while (next < blocks.size())
+        {
+            AllocShard &shard = shardOf(blocks[next]);
+            lock_guard<mutex> guard(shard.lock);
+            for (; next < blocks.size() && blocks[next] >= shard.first && blocks[next] < shard.end; next++)
+            {
+                if (bitmap.test(blocks[next]))
+                {
+                    bitmap.clear(blocks[next]);
+                    released++;
+                }
             }
+            shard.dirty = true;
+        }
+        if (released > 0)
+        {
+            freeBlocksCount += released;
+            superblockDirty = true;
         }
 
-        return 0xFFFFFFFF; // Retorna erro se não houver blocos livres
+        flushAllocMetadata();
     }
 
     /**
@@ -301,532 +5830,997 @@ public:
      * 
      * @param blockIndex indice do bloco a ser liberado
      */
-    void freeBlock(u_int32_t blockIndex)
+    void freeBlock(u_int32_t blockIndex) override
     {
         if (blockIndex >= superblock.total_blocks)
         {
             throw runtime_error("Bloco Inválido!");
         }
+        if (OpUndo *op = currentOp())
+        {
+            op->freed.push_back(blockIndex);
+            return;
+        }
 
-        diskManager.readBlock(superblock.bitmap_start, (char *)bitmap.data());
-
-        bitmap[blockIndex / 8] &= ~(1 << (blockIndex % 8));
-        superblock.free_blocks++;
-  
-        diskManager.writeBlock(superblock.bitmap_start, (char *)bitmap.data());
+        revokeFreed({blockIndex});
+        AllocShard &shard = shardOf(blockIndex);
+        {
+            lock_guard<mutex> guard(shard.lock);
+            if (!bitmap.test(blockIndex))
+            {
+                return; // Bloco já está livre: não alterar a contagem de blocos livres
+            }
+            bitmap.clear(blockIndex);
+            shard.dirty = true;
+        }
+        freeBlocksCount++;
+        superblockDirty = true;
 
-        // Atualiza o superbloco no disco
-        diskManager.writeBlock(0, (char *)&superblock);
+        // Atualiza o bitmap e o superbloco no disco
+        flushAllocMetadata();
     }
-
     
     /**
      * @brief Create a File object
      * 
      * @param filename O nome do arquivo ou pasta a ser criada.
-     * @param filetype Indica o tipo do arquivo (2: pasta, 1: arquivo).
-     * @param parentDir Caminho do diretório pai (deixar vazio para criar no diretório atual).
+     * @param filetype Indica o tipo do arquivo (2: pasta, 1: arquivo, 3: arquivo mapeado por extensões).
+     * @param parentDir Caminho do diretório pai, em qualquer profundidade (ex: "/a/b"; "./" para a raiz).
      */
-    void createFile(string &filename, char filetype, const string &parentDir = "./")
+    void createFile(string &filename, char filetype, const string &parentDir) override
     {
-        if (filename.size() > FILENAME_SIZE)
+        if (filename.empty() || filename.size() >= FILENAME_SIZE)
         {
             throw runtime_error("Nome do arquivo muito grande!");
         }
+        if (filetype == '3' && superblock.version < 4)
+        {
+            throw runtime_error("Arquivos mapeados por extensões exigem a versão 4 do disco!");
+        }
+
+        JournalOp op(*this);
+        shared_lock<shared_mutex> namespaceGuard(namespaceLock);
+        string parentPath = normalizePath(parentDir);
+        u_int32_t dirIndexBlock = superblock.root_dir_index;
+        if (parentPath != "/")
+        {
+            cout << "Parent Dir: " << parentPath << endl;
+            u_int32_t grandParent;
+            DirIndexEntry parent;
+            if (!resolvePath(parentPath, grandParent, parent) || parent.file_type != '2')
+            {
+                cout << "Diretório não encontrado!" << endl;
+                return;
+            }
+            dirIndexBlock = parent.index_block;
+        }
+
+        shared_ptr<DirIndex> dirRef = openDirIndex(dirIndexBlock);
+        DirIndex &dir = *dirRef;
+        unique_lock<shared_mutex> dirGuard(dir.lock);
+        if (dir.removed)
+        {
+            cout << "Diretório não encontrado!" << endl;
+            return;
+        }
+        DirIndexEntry existing;
+        if (dirFind(dir, filename, existing))
+        {
+            throw runtime_error("Arquivo já existe!");
+        }
+
+        // As alocações abaixo escrevem o bitmap e o superbloco uma única vez
+        MetadataBatch batch(*this);
+
+        // A entrada primeiro: um novo bloco de entradas não fica entre o primeiro bloco de dados e os seguintes
+        DirSlot loc;
+        if (!takeFreeSlot(dirIndexBlock, dir, filename, loc))
+        {
+            cout << ("Diretório cheio!") << endl;
+            return;
+        }
 
-        uint32_t index_block = allocBlock();
-        if (index_block == 0xFFFFFFFF)
+        // Bloco de índice do arquivo e seu primeiro bloco de dados. Arquivos novos (versão 4) começam com os dados
+        // no próprio bloco de índice e só passam para a árvore (ou extensões, com o tipo 3) ao crescer além de
+        // INLINE_BYTES; diretórios (e discos de versões anteriores) continuam com a cadeia
+        bool inlineData = isRegularFile(filetype) && superblock.version >= 4;
+        vector<u_int32_t> blocks;
+        if (!allocBlocks(inlineData ? 1 : 2, blocks))
         {
+            dirRemove(dir, filename, loc);
             throw runtime_error("Não há blocos disponíveis!");
         }
 
         RootDirEntry newEntry;
-        strncpy(newEntry.filename, filename.c_str(), FILENAME_SIZE);
-        newEntry.filename[FILENAME_SIZE] = '\0';
+        strncpy(newEntry.filename, filename.c_str(), FILENAME_SIZE - 1);
         newEntry.file_type = filetype;
-        newEntry.index_block = index_block;
+        newEntry.index_block = blocks[0];
 
+        IndexBlock ib;
+        if (inlineData)
+        {
+            memset(ib.inlineData(), 0x00, INLINE_BYTES);
+            ib.indirect_ptr = INDEX_INLINE;
+        }
+        else
+        {
+            ib.block_ptrs[0] = blocks[1];
+        }
+        writeIndexBlock(newEntry.index_block, ib);
+        if (filetype == '2')
+        {
+            // O primeiro bloco de um diretório guarda entradas: precisa começar vazio
+            char buffer[BLOCK_SIZE];
+            memset(buffer, 0x00, BLOCK_SIZE);
+            cache.writeMetadata(blocks[1], buffer);
+            // Descartar o índice de um diretório apagado que usava o mesmo bloco de índice
+            lock_guard<mutex> guard(dirIndexesLock);
+            dirIndexes.erase(newEntry.index_block);
+            dirIndexesEpoch++;
+        }
+        writeEntry(loc, newEntry);
+        dirAdd(dir, filename, {loc, filetype, newEntry.index_block});
+        // Remove uma possível entrada negativa do novo caminho
+        invalidateDentries((parentPath == "/" ? "" : parentPath) + "/" + filename, false);
+        cout << "Arquivo criado com sucesso!" << endl;
+    }
+
+    /**
+     * @brief Le um arquivo do disco
+     * 
+     * @param filename Nome do arquivo a ser lido
+     * @param filetype Tipo do arquivo a ser lido
+     * @param index_block indice do bloco a ser lido
+     */
+    void readFile(string &filename, char *filetype, u_int32_t *index_block) override
+    {
+        u_int32_t dirIndexBlock;
+        DirIndexEntry found;
+        string fullPath;
+        if (findFile(filename, dirIndexBlock, found, fullPath))
+        {
+            *filetype = found.file_type;
+            *index_block = found.index_block;
+            return;
+        }
+
+        cout << ("Arquivo não encontrado!") << endl;
+    }
+
+    /**
+     * @brief Retorna o índice do bloco de um arquivo
+     *  Não funciona corretamente
+     * @param filename Nome do arquivo
+     * @return u_int32_t 
+     */
+    u_int32_t getFileBlockIndex(string &filename) override
+    {
+        u_int32_t dirIndexBlock;
+        DirIndexEntry found;
+        string fullPath;
+        if (findFile(filename, dirIndexBlock, found, fullPath))
+        {
+            return found.index_block;
+        }
 
+        cout << ("Arquivo não encontrado!") << endl;
+        return 0xFFFFFFFF;
+    }
 
-        if (parentDir == "./")
+    /**
+     * @brief Retorna o índice do bloco de dados de um arquivo
+     * Com o índice em árvore, no máximo quatro blocos de índice são lidos; uma cadeia (de blocos de índice ou de
+     * extensões) é percorrida até o bloco que contém o ponteiro.
+     * @param index_block Primeiro bloco de índice do arquivo
+     * @param block_offset Bloco lógico
+     * @return u_int32_t 
+     */
+    u_int32_t getFileDataBlockIndex(u_int32_t index_block, u_int32_t block_offset) override
+    {
+        IndexView ib = viewIndexBlock(index_block);
+        if (ib->indirect_ptr == INDEX_TREE)
         {
-            diskManager.readBlock(superblock.root_dir_index, (char *)rootDir.data());
-            for (auto &entry : rootDir)
+            u_int32_t block = treeLookup(*ib, block_offset);
+            if (block == 0xFFFFFFFF)
             {
-                if (entry.filename[0] == '\0')
-                {
-                    entry = newEntry;
-                    IndexBlock ib;
-                    for (auto &block_ptr : ib.block_ptrs)
-                    {
+                throw runtime_error("Bloco de dados não encontrado!");
+            }
+            return block;
+        }
+        if (ib->indirect_ptr == INDEX_INLINE)
+        {
+            if (block_offset != 0)
+            {
+                throw runtime_error("Bloco de dados não encontrado!");
+            }
+            return index_block; // Os dados estão no próprio bloco de índice
+        }
+        if (ib->indirect_ptr == INDEX_EXTENTS)
+        {
+            vector<u_int32_t> block;
+            extentLookup(index_block, block_offset, 1, block);
+            return block[0];
+        }
 
-                        if (block_ptr == 0xFFFFFFFF)
-                        {
-                            block_ptr = allocBlock();
-                            cout << "Block Ptr: " << block_ptr << endl;
-                            diskManager.writeBlock(entry.index_block, (char *)&ib);
-                            diskManager.writeBlock(superblock.root_dir_index, (char *)rootDir.data());
-                            cout << "Arquivo criado com sucesso!" << endl;
-                            return;
-                        }
-                    }
-                    
-                }
+        while (block_offset >= INDEX_PTRS)
+        {
+            if (ib->indirect_ptr == 0xFFFFFFFF || ib->indirect_ptr >= superblock.total_blocks)
+            {
+                throw runtime_error("Bloco de dados não encontrado!");
             }
+            block_offset -= INDEX_PTRS;
+            ib = viewIndexBlock(ib->indirect_ptr);
         }
-        else
+        return ib->block_ptrs[block_offset];
+    }
+
+    /**
+     * @brief Deleta um arquivo do disco
+     * 
+     * @param filename Nome do arquivo
+     */
+    void deleteFile(string &filename) override
+    {
+        cout << "Deletando arquivo: " << filename << endl;
+
+        JournalOp op(*this);
+        shared_lock<shared_mutex> namespaceGuard(namespaceLock);
+        u_int32_t dirIndexBlock;
+        DirIndexEntry found;
+        string fullPath;
+        shared_ptr<DirIndex> dir;
+        unique_lock<shared_mutex> dirGuard;
+        if (findFile(filename, dirIndexBlock, found, fullPath))
         {
-            cout << "Parent Dir: " << parentDir << endl;
-            IndexBlock ib;
-            
-            diskManager.readBlock(superblock.root_dir_index, (char *)rootDir.data());
+            dir = openDirIndex(dirIndexBlock);
+            dirGuard = unique_lock<shared_mutex>(dir->lock);
+        }
+        if (!dir || !relockEntry(*dir, fullPath, found))
+        {
+            cout << ("Arquivo não encontrado!") << endl;
+            return;
+        }
 
-            for (auto &entry : rootDir)
+        // Um diretório fica travado até ser removido, para que nada seja criado nele nesse meio tempo
+        shared_ptr<DirIndex> child;
+        unique_lock<shared_mutex> childGuard;
+        if (found.file_type == '2')
+        {
+            child = openDirIndex(found.index_block);
+            childGuard = unique_lock<shared_mutex>(child->lock);
+            if (!dirEmpty(*child))
             {
-                if (entry.file_type == '2' && strcmp(entry.filename, parentDir.c_str()) == 0)
-                {
-                    cout << "Index Block: " << entry.index_block << endl;
-                    char buffer[BLOCK_SIZE];
-                    diskManager.readBlock(entry.index_block, (char *)&buffer);
+                cout << "Diretório não está vazio!" << endl;
+                return;
+            }
+        }
 
-                    cout << "Buffer: " << endl;
-                    for (int i = 0; i < BLOCK_SIZE; ++i)
-                    {
-                        cout << hex << (int)buffer[i] << " ";
-                    }
+        {
+            lock_guard<mutex> guard(openFilesLock);
+            if (inodes.count(found.index_block) > 0)
+            {
+                cout << "Arquivo está aberto!" << endl;
+                return;
+            }
+        }
 
-                    cout << endl;
+        // Liberar os blocos de dados e os blocos de índice
+        vector<u_int32_t> chain, blocks;
+        readFileIndex(found.index_block, chain, nullptr, blocks, nullptr);
+        blocks.insert(blocks.end(), chain.begin(), chain.end());
+        freeBlocks(blocks);
 
+        // Remover a entrada do diretório
+        RootDirEntry entry = readEntry(found.loc);
+        string name = entry.name();
+        entry.filename[0] = '\0';
+        entry.index_block = 0xFFFFFFFF;
+        writeEntry(found.loc, entry);
 
+        dirRemove(*dir, name, found.loc);
+        if (child)
+        {
+            // O índice fica no mapa marcado como removido até o bloco ser reutilizado por outro diretório:
+            // resoluções de caminho concorrentes que ainda apontem para ele não o reconstroem a partir de blocos livres
+            child->removed = true;
+        }
+        invalidateDentries(fullPath, found.file_type == '2');
+        cout << "Arquivo deletado com sucesso!" << endl;
+    }
 
-                    for (auto &block_ptr : ib.block_ptrs)
-                    {
-                        cout << "Block Ptr: " << block_ptr << endl;
-                        if (block_ptr != 0xFFFFFFFF)
-                        {
-                            RootDirEntry dirEntry;
-                            diskManager.readBlock(block_ptr, (char *)&dirEntry);
-                            if (strcmp(dirEntry.filename, parentDir.c_str()) == 0)
-                            {
-                                diskManager.readBlock(dirEntry.index_block, (char *)&ib);
-                                for (auto &block_ptr : ib.block_ptrs)
-                                {
-                                    if (block_ptr == 0xFFFFFFFF)
-                                    {
-                                        
-                                        block_ptr = allocBlock();
-                                        diskManager.writeBlock(dirEntry.index_block, (char *)&ib);
-                                        diskManager.writeBlock(superblock.root_dir_index, (char *)rootDir.data());
-                                        cout << "Arquivo criado com sucesso!" << endl;
-                                        return;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
+    /**
+     * @brief Renomeia ou move um arquivo/diretório
+     * 
+     * @param oldPath Caminho atual
+     * @param newPath Novo caminho (o diretório pai deve existir)
+     */
+    void renameFile(const string &oldPath, const string &newPath) override
+    {
+        // Nenhuma outra operação sobre caminhos ou entradas de diretório acontece durante a renomeação
+        JournalOp op(*this);
+        unique_lock<shared_mutex> namespaceGuard(namespaceLock);
+        u_int32_t oldDir;
+        DirIndexEntry found;
+        string from;
+        if (!findFile(oldPath, oldDir, found, from))
+        {
+            cout << ("Arquivo não encontrado!") << endl;
+            return;
+        }
+
+        string to = normalizePath(newPath);
+        size_t cut = to.rfind('/');
+        string parentPath = cut == 0 ? "/" : to.substr(0, cut);
+        string newName = to.substr(cut + 1);
+        if (newName.empty() || newName.size() >= FILENAME_SIZE)
+        {
+            throw runtime_error("Nome do arquivo muito grande!");
+        }
+        if (to == from || to.compare(0, from.size() + 1, from + "/") == 0)
+        {
+            throw runtime_error("Destino inválido!");
+        }
+
+        u_int32_t newDir = superblock.root_dir_index;
+        if (parentPath != "/")
+        {
+            u_int32_t grandParent;
+            DirIndexEntry parent;
+            if (!resolvePath(parentPath, grandParent, parent) || parent.file_type != '2')
+            {
+                cout << "Diretório não encontrado!" << endl;
+                return;
             }
+            newDir = parent.index_block;
+        }
+
+        // As travas dos diretórios ainda são necessárias para as consultas que não usam namespaceLock
+        shared_ptr<DirIndex> targetRef = openDirIndex(newDir);
+        shared_ptr<DirIndex> sourceRef = openDirIndex(oldDir);
+        DirIndex &target = *targetRef;
+        DirIndex &source = *sourceRef;
+        unique_lock<shared_mutex> targetGuard(target.lock);
+        unique_lock<shared_mutex> sourceGuard(source.lock, defer_lock);
+        if (sourceRef != targetRef)
+        {
+            sourceGuard.lock();
+        }
+        DirIndexEntry existing;
+        if (dirFind(target, newName, existing))
+        {
+            throw runtime_error("Arquivo já existe!");
+        }
 
+        MetadataBatch batch(*this);
+        DirSlot loc;
+        if (!takeFreeSlot(newDir, target, newName, loc))
+        {
             cout << ("Diretório cheio!") << endl;
+            return;
+        }
+        if (source.hashed)
+        {
+            // A posição resolvida pode ser antiga: a divisão de uma folha do índice por hash move entradas
+            dirFind(source, from.substr(from.rfind('/') + 1), found);
+        }
+
+        // Escrever a entrada no destino e liberar a posição de origem
+        RootDirEntry entry = readEntry(found.loc);
+        string oldName = entry.name();
+        memset(entry.filename, 0, FILENAME_SIZE);
+        strncpy(entry.filename, newName.c_str(), FILENAME_SIZE - 1);
+        writeEntry(loc, entry);
+
+        RootDirEntry empty = readEntry(found.loc);
+        empty.filename[0] = '\0';
+        empty.index_block = 0xFFFFFFFF;
+        writeEntry(found.loc, empty);
+
+        dirRemove(source, oldName, found.loc);
+        dirAdd(target, newName, {loc, found.file_type, found.index_block});
+        {
+            lock_guard<mutex> guard(openFilesLock);
+            auto open = inodes.find(found.index_block);
+            if (open != inodes.end())
+            {
+                open->second->parentDir = newDir;
+                open->second->loc = loc;
+            }
         }
+
+        invalidateDentries(from, found.file_type == '2');
+        invalidateDentries(to, true);
+        cout << "Arquivo renomeado com sucesso!" << endl;
     }
 
     /**
-     * @brief Le um arquivo do disco
+     * @brief Busca por um arquivo no disco
      * 
-     * @param filename Nome do arquivo a ser lido
-     * @param filetype Tipo do arquivo a ser lido
-     * @param index_block indice do bloco a ser lido
+     * @param filename Nome do arquivi a ser buscado
+     */
+    void searchFile(string &filename) override
+    {
+        // Buscar o indice do arquivo
+        u_int32_t indexBlock = getFileBlockIndex(filename);
+
+        // Ler os dados do arquivo
+        char fileType;
+        u_int32_t indexBlock2;
+        readFile(filename, &fileType, &indexBlock2);
+        cout << "Arquivo: " << filename << " File Type: " << fileTypeName(fileType) << ", Index Block: " << indexBlock2 << endl;
+    }
+
+    /**
+     * @brief Abre um arquivo para leitura e escrita
+     * 
+     * @param filename Nome ou caminho do arquivo
+     * @return u_int32_t Descritor do arquivo aberto, ou 0xFFFFFFFF se não encontrado
+     */
+    u_int32_t openFile(const string &filename) override
+    {
+        shared_lock<shared_mutex> namespaceGuard(namespaceLock);
+        u_int32_t dirIndexBlock;
+        DirIndexEntry found;
+        string fullPath;
+        shared_ptr<DirIndex> dir;
+        shared_lock<shared_mutex> dirGuard;
+        if (findFile(filename, dirIndexBlock, found, fullPath))
+        {
+            // A trava do diretório impede que o arquivo seja apagado antes de ser registrado como aberto
+            dir = openDirIndex(dirIndexBlock);
+            dirGuard = shared_lock<shared_mutex>(dir->lock);
+        }
+        if (!dir || !relockEntry(*dir, fullPath, found) || !isRegularFile(found.file_type))
+        {
+            cout << ("Arquivo não encontrado!") << endl;
+            return 0xFFFFFFFF;
+        }
+
+        shared_ptr<Inode> inode;
+        {
+            lock_guard<mutex> guard(openFilesLock);
+            auto it = inodes.find(found.index_block);
+            if (it != inodes.end())
+            {
+                inode = it->second;
+                inode->opens++;
+            }
+        }
+        if (!inode)
+        {
+            shared_ptr<Inode> created = make_shared<Inode>();
+            created->parentDir = dirIndexBlock;
+            created->loc = found.loc;
+            created->indexBlock = found.index_block;
+            created->size = readEntry(found.loc).file_size;
+            created->map = readFileIndex(created->indexBlock, created->chain, &created->index, created->blocks, &created->nodes);
+            created->growsTo = found.file_type == '3' ? FileMap::EXTENTS : FileMap::TREE;
+            created->indexDirty.assign(created->chain.size(), 0);
+
+            // Outro descritor do mesmo arquivo pode ter sido aberto enquanto a cadeia era lida
+            lock_guard<mutex> guard(openFilesLock);
+            inode = inodes.emplace(found.index_block, created).first->second;
+            inode->opens++;
+        }
+
+        shared_ptr<OpenFile> file = make_shared<OpenFile>();
+        file->inode = inode;
+        lock_guard<mutex> guard(openFilesLock);
+        u_int32_t handle = nextHandle++;
+        openFiles.emplace(handle, file);
+        return handle;
+    }
+
+    /**
+     * @brief Escreve dados em um arquivo aberto a partir de um deslocamento
+     * Blocos inteiros fisicamente contíguos são escritos com uma única operação no disco;
+     * apenas o primeiro e o último bloco parciais passam pela cache.
+     * 
+     * @param handle Descritor retornado por openFile
+     * @param offset Deslocamento em bytes dentro do arquivo
+     * @param data Dados a serem escritos
+     * @param size Tamanho dos dados em bytes
+     * @return uint32_t Número de bytes escritos
+     */
+    uint32_t writeFile(u_int32_t handle, uint32_t offset, const char *data, uint32_t size) override
+    {
+        JournalOp op(*this);
+        shared_ptr<OpenFile> open = openHandle(handle);
+        unique_lock<shared_mutex> inodeGuard(open->inode->lock);
+        saveInode(open->inode);
+        try
+        {
+            return writeInode(*open->inode, offset, data, size);
+        }
+        catch (...)
+        {
+            // A operação vai ser desfeita: o arquivo volta ao estado anterior ainda com a trava, para que outra
+            // escrita nele não continue a partir dos blocos que voltam a ficar livres
+            vector<InodeUndo> &files = op.undo.files;
+            auto saved = find_if(files.begin(), files.end(), [&](const InodeUndo &file)
+                                 { return file.inode == open->inode; });
+            if (op.outer && saved != files.end())
+            {
+                restoreInode(*saved);
+                files.erase(saved);
+            }
+            throw;
+        }
+    }
+
+    /**
+     * @brief Escreve dados em um arquivo aberto (com a trava exclusiva do arquivo)
+     * 
+     * @param file Arquivo aberto
+     * @param offset Deslocamento em bytes dentro do arquivo
+     * @param data Dados a serem escritos
+     * @param size Tamanho dos dados em bytes
+     * @return uint32_t Número de bytes escritos
      */
-    void readFile(string &filename, char *filetype, u_int32_t *index_block)
+    uint32_t writeInode(Inode &file, uint32_t offset, const char *data, uint32_t size)
     {
+        if (size == 0)
+        {
+            return 0;
+        }
+        dataGeneration++;
+        uint64_t end = (uint64_t)offset + size;
+        if (end > 0xFFFFFFFF)
+        {
+            throw runtime_error("Tamanho do arquivo excede o limite de armazenamento");
+        }
 
-        diskManager.readBlock(superblock.root_dir_index, (char *)rootDir.data());
+        // Preencher com zeros o espaço entre o fim atual e o início da escrita
+        if (offset > file.size)
+        {
+            while (file.size < offset)
+            {
+                writeInode(file, file.size, zeroBuffer, getMin<uint32_t>(offset - file.size, sizeof(zeroBuffer)));
+            }
+        }
 
-        for (auto &entry : rootDir)
+        // Arquivo pequeno: os dados ficam no bloco de índice, gravado no fechamento com o tamanho
+        if (file.map == FileMap::INLINE)
         {
-            if (strcmp(entry.filename, filename.c_str()) == 0)
+            if (end <= INLINE_BYTES)
             {
-                *filetype = entry.file_type;
-                *index_block = entry.index_block;
-                return;
+                saveIndex(file, 0);
+                memcpy(file.index[0].inlineData() + offset, data, size);
+                file.indexDirty[0] = 1;
+                if (end > file.size)
+                {
+                    file.size = end;
+                    file.sizeDirty = true;
+                }
+                return size;
             }
+            spillInline(file);
         }
 
-        // Verificar se o arquivo está em um diretório
-        IndexBlock ib;
-        for (auto &entry : rootDir)
+        u_int32_t numBlocks = (end + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (numBlocks > file.blocks.size())
+        {
+            growFile(file, numBlocks);
+        }
+
+        uint64_t pos = offset;
+        while (pos < end)
         {
-            if (entry.file_type == '2')
+            u_int32_t k = pos / BLOCK_SIZE;
+            u_int32_t inBlock = pos % BLOCK_SIZE;
+            const char *src = data + (pos - offset);
+
+            if (inBlock != 0 || end - pos < BLOCK_SIZE)
             {
-                diskManager.readBlock(entry.index_block, (char *)&ib);
-                for (auto &block_ptr : ib.block_ptrs)
+                // Bloco parcial: ler, alterar e escrever (o que passa do fim atual vira zero)
+                u_int32_t n = getMin<uint64_t>(BLOCK_SIZE - inBlock, end - pos);
+                uint64_t blockStart = (uint64_t)k * BLOCK_SIZE;
+                char buffer[BLOCK_SIZE];
+                if (blockStart >= file.size)
+                {
+                    memset(buffer, 0x00, BLOCK_SIZE);
+                }
+                else
                 {
-                    if (block_ptr != 0xFFFFFFFF)
+                    cache.readBlock(file.blocks[k], buffer);
+                    if (file.size - blockStart < BLOCK_SIZE)
                     {
-                        RootDirEntry dirEntry;
-                        diskManager.readBlock(block_ptr, (char *)&dirEntry);
-                        if (strcmp(dirEntry.filename, filename.c_str()) == 0)
-                        {
-                            *filetype = dirEntry.file_type;
-                            *index_block = dirEntry.index_block;
-                            return;
-                        }
+                        memset(buffer + (file.size - blockStart), 0x00, BLOCK_SIZE - (file.size - blockStart));
                     }
                 }
+                memcpy(buffer + inBlock, src, n);
+                cache.writeBlock(file.blocks[k], buffer);
+                pos += n;
+                continue;
+            }
+
+            // Blocos inteiros: juntar os que são fisicamente contíguos em uma única escrita
+            u_int32_t run = 1;
+            while (pos + (uint64_t)(run + 1) * BLOCK_SIZE <= end && file.blocks[k + run] == file.blocks[k] + run)
+            {
+                run++;
             }
+            cache.writeBlocksDirect(file.blocks[k], run, src);
+            pos += (uint64_t)run * BLOCK_SIZE;
         }
 
-        cout << ("Arquivo não encontrado!") << endl;
+        if (end > file.size)
+        {
+            file.size = end;
+            file.sizeDirty = true;
+        }
+        return size;
     }
 
     /**
-     * @brief Retorna o índice do bloco de um arquivo
-     *  Não funciona corretamente
-     * @param filename Nome do arquivo
-     * @return u_int32_t 
+     * @brief Fecha um arquivo aberto, gravando os blocos de índice alterados e o tamanho do arquivo
+     * 
+     * @param handle Descritor retornado por openFile
      */
-    u_int32_t getFileBlockIndex(string &filename)
+    void closeFile(u_int32_t handle) override
     {
-        diskManager.readBlock(superblock.root_dir_index, (char *)rootDir.data());
-
-        for (auto &entry : rootDir)
+        shared_ptr<OpenFile> open;
+        bool last;
         {
-            if (strcmp(entry.filename, filename.c_str()) == 0)
+            lock_guard<mutex> guard(openFilesLock);
+            auto it = openFiles.find(handle);
+            if (it == openFiles.end())
             {
-                return entry.index_block;
+                throw runtime_error("Descritor de arquivo inválido!");
             }
+            open = it->second;
+            openFiles.erase(it);
+            last = --open->inode->opens == 0;
+        }
+        {
+            lock_guard<mutex> guard(open->lock);
+            dropReadahead(*open);
+        }
+        if (!last)
+        {
+            return;
         }
 
-        // Verificar se o arquivo está em um diretório
-        IndexBlock ib;
-        for (auto &entry : rootDir)
+        // Último descritor: gravar os índices e o tamanho. O arquivo continua registrado como aberto
+        // até o fim da gravação, então não pode ser apagado nesse meio tempo.
+        Inode &file = *open->inode;
+        try
         {
-            if (entry.file_type == '2')
+            JournalOp op(*this);
+            shared_lock<shared_mutex> namespaceGuard(namespaceLock);
+            shared_ptr<DirIndex> dir = openDirIndex(file.parentDir);
+            unique_lock<shared_mutex> dirGuard(dir->lock);
+            unique_lock<shared_mutex> inodeGuard(file.lock);
+            for (u_int32_t i = 0; i < file.chain.size(); i++)
             {
-                cout << "Entry: " << entry.filename << endl;
-                cout << "Index Block: " << hex << entry.index_block * BLOCK_SIZE<< endl;
-                IndexBlock ib;
-                diskManager.readBlock(entry.index_block, (char *) &ib);
-
-                for (auto &block_ptr : ib.block_ptrs)
+                if (file.indexDirty[i])
                 {
-                    if (block_ptr != 0xFFFFFFFF)
-                    {
-                        RootDirEntry dirEntry;
-                        diskManager.readBlock(block_ptr, (char *)&dirEntry);
-                        if (strcmp(dirEntry.filename, filename.c_str()) == 0)
-                        {
-                            return dirEntry.index_block;
-                        }
-                    }
+                    writeIndexBlock(file.chain[i], file.index[i]);
+                    file.indexDirty[i] = 0;
                 }
-
-                
-
+            }
+            if (file.sizeDirty)
+            {
+                RootDirEntry entry = readEntry(file.loc);
+                entry.file_size = file.size;
+                writeEntry(file.loc, entry);
+                file.sizeDirty = false;
             }
         }
-
-        cout << ("Arquivo não encontrado!") << endl;
-        return 0xFFFFFFFF;
+        catch (...)
+        {
+            lock_guard<mutex> guard(openFilesLock);
+            if (file.opens == 0)
+            {
+                inodes.erase(file.indexBlock);
+            }
+            throw;
+        }
+        lock_guard<mutex> guard(openFilesLock);
+        if (file.opens == 0) // Pode ter sido reaberto durante a gravação
+        {
+            inodes.erase(file.indexBlock);
+        }
     }
 
     /**
-     * @brief Retorna o índice do bloco de dados de um arquivo
-     * Não funciona corretamente
-     * @param index_block 
-     * @param block_offset 
-     * @return u_int32_t 
+     * @brief Escreve em um arquivo a partir do início
+     * 
+     * @param filename Nome ou caminho do arquivo
+     * @param data Dados a serem escritod no arquivo
+     * @param size Tamanho do dados em bytes a serem escritos
      */
-    u_int32_t getFileDataBlockIndex(u_int32_t index_block, u_int32_t block_offset)
+    void writeFile(const string &filename, const char *data, uint32_t size) override
     {
-        IndexBlock ib;
-        diskManager.readBlock(index_block, (char *)&ib);
-
-        if (block_offset < ib.block_ptrs.size())
-        {
-            return ib.block_ptrs[block_offset];
-        }
-
-        block_offset -= ib.block_ptrs.size();
-        if (ib.indirect_ptr == 0xFFFFFFFF)
+        try
         {
-            throw runtime_error("Bloco de dados não encontrado!");
+            u_int32_t handle = openFile(filename);
+            if (handle == 0xFFFFFFFF)
+            {
+                return;
+            }
+            try
+            {
+                writeFile(handle, 0, data, size);
+            }
+            catch (...)
+            {
+                closeFile(handle);
+                throw;
+            }
+            closeFile(handle);
+            cout << "Arquivo escrito com sucesso!" << endl;
         }
-
-        diskManager.readBlock(ib.indirect_ptr, (char *)&ib);
-        if (block_offset < ib.block_ptrs.size())
+        catch (const exception &e)
         {
-            return ib.block_ptrs[block_offset];
+            cerr << e.what() << endl;
         }
-
-        throw runtime_error("Bloco de dados não encontrado!");
     }
 
     /**
-     * @brief Deleta um arquivo do disco
+     * @brief Le um arquivo aberto a partir de um deslocamento
+     * Leituras sequenciais são atendidas por janelas lidas em segundo plano: enquanto o chamador
+     * consome uma janela, a seguinte já está sendo lida. A janela começa em readaheadMin blocos e dobra
+     * a cada janela consumida por inteiro, até readaheadMax; um acesso fora de sequência volta ao mínimo.
      * 
-     * @param filename Nome do arquivo
+     * @param handle Descritor retornado por openFile
+     * @param offset Deslocamento em bytes dentro do arquivo
+     * @param data Buffer de destino
+     * @param size Número de bytes a ler
+     * @return uint32_t Número de bytes lidos (menor que size no fim do arquivo)
      */
-    void deleteFile(string &filename)
+    uint32_t readFileAt(u_int32_t handle, uint32_t offset, char *data, uint32_t size) override
     {
-        cout << "Deletando arquivo: " << filename << endl;
-        // Pegar o bloco de índice do arquivo
-        u_int32_t indexBlock = getFileBlockIndex(filename);
-
-        // Liberar o bloco de índice
-        freeBlock(indexBlock);
+        shared_ptr<OpenFile> open = openHandle(handle);
+        OpenFile &file = *open;
+        lock_guard<mutex> fileGuard(file.lock);
+        Inode &inode = *file.inode;
+        shared_lock<shared_mutex> inodeGuard(inode.lock);
+        if (offset >= inode.size || size == 0)
+        {
+            return 0;
+        }
+        size = getMin<uint64_t>(size, inode.size - offset);
+        uint64_t pos = offset;
+        uint64_t end = pos + size;
+        if (inode.map == FileMap::INLINE)
+        {
+            memcpy(data, inode.index[0].inlineData() + offset, size);
+            file.nextRead = end;
+            return size;
+        }
 
-        // Liberar do diretório raiz
-        diskManager.readBlock(superblock.root_dir_index, (char *)rootDir.data());
+        bool sequential = offset == file.nextRead;
+        if (!sequential)
+        {
+            dropReadahead(file);
+            file.window = 0;
+        }
 
-        for (auto &entry : rootDir)
+        // Consumir as janelas já lidas antecipadamente
+        while (pos < end && file.ahead[0].count > 0)
         {
-            if (strcmp(entry.filename, filename.c_str()) == 0)
+            Readahead &ra = file.ahead[0];
+            uint64_t raStart = (uint64_t)ra.first * BLOCK_SIZE;
+            uint64_t raEnd = raStart + (uint64_t)ra.count * BLOCK_SIZE;
+            if (!finishReadahead(ra) || pos < raStart || pos >= raEnd)
             {
-                entry.filename[0] = '\0';
-                char buffer[BLOCK_SIZE];
-                //Limpar buffer
-                memset(buffer, 0x00, BLOCK_SIZE);
-                //Escrever o diretório raiz no disco
-                memcpy(buffer, rootDir.data(), rootDir.size());
-                diskManager.writeBlock(superblock.root_dir_index, buffer);
-                cout << "Arquivo deletado com sucesso!" << endl;
-                return;
+                dropReadahead(file);
+                break;
+            }
+
+            uint64_t stop = getMin<uint64_t>(end, raEnd);
+            readaheadHits += stop - pos;
+            while (pos < stop)
+            {
+                u_int32_t k = pos / BLOCK_SIZE;
+                u_int32_t inBlock = pos % BLOCK_SIZE;
+                u_int32_t n = getMin<uint64_t>(BLOCK_SIZE - inBlock, stop - pos);
+                // Um quadro da cache pode ser mais novo que o bloco lido do disco
+                if (!cache.readCached(inode.blocks[k], inBlock, n, data + (pos - offset)))
+                {
+                    memcpy(data + (pos - offset), ra.buffer.data() + (size_t)(k - ra.first) * BLOCK_SIZE + inBlock, n);
+                }
+                pos += n;
+            }
+
+            if (pos >= raEnd)
+            {
+                // Janela consumida por inteiro: a próxima passa a ser a atual e a janela cresce
+                ra = move(file.ahead[1]);
+                file.ahead[1] = Readahead();
+                file.window = getMin<u_int32_t>(file.window * 2, readaheadMax);
             }
         }
 
-        if (indexBlock == 0xFFFFFFFF)
+        // O que não estava nas janelas é lido agora
+        if (pos < end)
         {
-            cout << ("Arquivo não encontrado!") << endl;
+            readFileBlocks(inode.blocks, pos, data + (pos - offset), end - pos);
         }
+        file.nextRead = end;
 
-        // Problema na hora de deletar os dados do arquivo (ponteiros)
-
-        // //Liberar os blocos de dados
-        // IndexBlock ib;
-        // diskManager.readBlock(indexBlock, (char *)&ib);
-
-        // cout << "Index Block: " << ib << endl;
-
-        // for (auto &block_ptr : ib.block_ptrs)
-        // {
-        //     if (block_ptr != 0xFFFFFFFF)
-        //     {
-        //         freeBlock(block_ptr);
-        //     }
-        // }
-
-        // if (ib.indirect_ptr != 0xFFFFFFFF)
-        // {
-        //     diskManager.readBlock(ib.indirect_ptr, (char *)&ib);
-        //     for (auto &block_ptr : ib.block_ptrs)
-        //     {
-        //         if (block_ptr != 0xFFFFFFFF)
-        //         {
-        //             freeBlock(block_ptr);
-        //         }
-        //     }
-        //     freeBlock(ib.indirect_ptr);
-        // }
-
-        // //Remover a entrada do arquivo do diretório raiz
-        // diskManager.readBlock(superblock.root_dir_index, (char *)rootDir.data());
-
-        // for (auto &entry : rootDir)
-        // {
-        //     if (strcmp(entry.filename, filename.c_str()) == 0)
-        //     {
-        //         entry.filename[0] = '\0';
-        //         diskManager.writeBlock(superblock.root_dir_index, (char *)rootDir.data());
-        //         cout << "Arquivo deletado com sucesso!" << endl;
-        //         return;
-        //     }
-        // }
-
-        // // Verificar se o arquivo está em um diretório
-        // IndexBlock ib2;
-        // for (auto &entry : rootDir)
-        // {
-        //     if (entry.file_type == '2')
-        //     {
-        //         diskManager.readBlock(entry.index_block, (char *)&ib2);
-        //         for (auto &block_ptr : ib2.block_ptrs)
-        //         {
-        //             if (block_ptr != 0xFFFFFFFF)
-        //             {
-        //                 RootDirEntry dirEntry;
-        //                 diskManager.readBlock(block_ptr, (char *)&dirEntry);
-        //                 if (strcmp(dirEntry.filename, filename.c_str()) == 0)
-        //                 {
-        //                     dirEntry.filename[0] = '\0';
-        //                     diskManager.writeBlock(block_ptr, (char *)&dirEntry);
-        //                     cout << "Arquivo deletado com sucesso!" << endl;
-        //                     return;
-        //                 }
-        //             }
-        //         }
-        //     }
-        // }
+        // Leitura sequencial: manter até duas janelas em andamento à frente da posição de leitura
+        if (!sequential || readaheadMax == 0)
+        {
+            return size;
+        }
+        u_int32_t fileBlocks = ((uint64_t)inode.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (file.window == 0)
+        {
+            file.window = readaheadMin;
+        }
+        u_int32_t next = end / BLOCK_SIZE;
+        for (Readahead &ra : file.ahead)
+        {
+            if (ra.count > 0)
+            {
+                next = ra.first + ra.count;
+                continue;
+            }
+            u_int32_t count = next < fileBlocks ? getMin<u_int32_t>(file.window, fileBlocks - next) : 0;
+            if (count == 0)
+            {
+                break;
+            }
+            startReadahead(inode.blocks, ra, next, count);
+            next += count;
+        }
+        return size;
     }
 
     /**
-     * @brief Busca por um arquivo no disco
+     * @brief Configura a janela de leitura antecipada
      * 
-     * @param filename Nome do arquivi a ser buscado
+     * @param minBlocks Janela inicial em blocos
+     * @param maxBlocks Janela máxima em blocos (0 desativa a leitura antecipada)
      */
-    void searchFile(string &filename)
+    void setReadahead(u_int32_t minBlocks, u_int32_t maxBlocks) override
     {
-        // Buscar o indice do arquivo
-        u_int32_t indexBlock = getFileBlockIndex(filename);
-
-        // Ler os dados do arquivo
-        char fileType;
-        u_int32_t indexBlock2;
-        readFile(filename, &fileType, &indexBlock2);
-        cout << "Arquivo: " << filename << " File Type: " << (fileType == '1' ? "Arquivo" : (fileType == '2' ? "Diretório" : "Tipo Desconhecido")) << ", Index Block: " << indexBlock2 << endl;
+        readaheadMax = maxBlocks;
+        readaheadMin = getMin<u_int32_t>(minBlocks > 0 ? minBlocks : 1, maxBlocks > 0 ? maxBlocks : 1);
+        lock_guard<mutex> guard(openFilesLock);
+        for (auto &open : openFiles)
+        {
+            lock_guard<mutex> fileGuard(open.second->lock);
+            dropReadahead(*open.second);
+            open.second->window = 0;
+        }
     }
 
-    // TODO: fazer essa merda funcionar
     /**
-     * @brief Escreve em um arquivo (NÃO FUNCIONA)
+     * @brief Prepara a leitura de um arquivo aberto sem acessar os blocos de dados: o chamador faz as leituras
+     * do plano (por exemplo, com uma fila assíncrona própria) e depois chama finishRead.
+     * A leitura antecipada do descritor não é usada. Os blocos do arquivo não são liberados enquanto
+     * ele estiver aberto, mas uma escrita concorrente pode ou não aparecer no resultado.
      * 
-     * @param filename Nome do arquivo
-     * @param data Dados a serem escritod no arquivo
-     * @param size Tamanho do dados em bytes a serem escritos
+     * @param handle Descritor do arquivo
+     * @param offset Posição inicial em bytes
+     * @param data Buffer de destino (precisa existir até finishRead)
+     * @param size Número de bytes a ler
+     * @param plan Recebe as leituras do disco
+     * @return uint32_t Bytes que a leitura devolverá (limitado ao tamanho do arquivo)
      */
-    void writeFile(const string &filename, const char *data, uint32_t size)
+    uint32_t planRead(u_int32_t handle, uint32_t offset, char *data, uint32_t size, ReadPlan &plan) override
     {
-        try
+        shared_ptr<OpenFile> open = openHandle(handle);
+        Inode &inode = *open->inode;
+        shared_lock<shared_mutex> inodeGuard(inode.lock);
+        if (offset >= inode.size || size == 0)
         {
-            // Abre o gerenciador de disco
-            IndexBlock rootIndexBlock;
-
-            // Pegar a partir do próximo bloco após o diretorio raiz
-            diskManager.readBlock(superblock.root_dir_index + 1, reinterpret_cast<char *>(&rootIndexBlock));
-
-            // Definir o tamanho do bloco de ponteiros
-            uint32_t block_ptrs_size = BLOCK_SIZE / sizeof(uint32_t);
-
-            // Verificar quantos ponteiros serão necessários para armazenar o arquivo
-            uint32_t num_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
-
-            // Redefinir o tamanho do bloco de ponteiros
-            if (size > block_ptrs_size * BLOCK_SIZE)
-            {
-                throw runtime_error("Tamanho do arquivo excede o limite de armazenamento");
-            }
-
-            // Recriar vetor de ponteiros
-            rootIndexBlock.block_ptrs.resize(block_ptrs_size, 0xFFFFFFFF);
-
-            // Definir ponteiro indireto
-            rootIndexBlock.indirect_ptr = 0xFFFFFFFF;
-
-            // Verificar quantos blocos de dados serão necessários
-            uint32_t num_data_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
-
-            // Definir o bloco de dados atual
-            uint32_t current_data_block = allocBlock();
-
-            // cout << "Current Data Block: " << current_data_block << endl;
-
-            // Exibir as informações do bloco de índice
-            cout << "Index Block: " << superblock.root_dir_index << endl;
-            cout << "Direct Pointers: " << rootIndexBlock.block_ptrs.size();
-            cout << "Indirect Pointer: " << rootIndexBlock.indirect_ptr << endl;
+            plan.size = 0;
+            return 0;
         }
-        catch (const exception &e)
+        size = getMin<uint64_t>(size, inode.size - offset);
+        if (inode.map == FileMap::INLINE)
         {
-            cerr << e.what() << endl;
+            // Os dados já estão em memória: nenhuma leitura do disco
+            memcpy(data, inode.index[0].inlineData() + offset, size);
+            plan.size = size;
+            return size;
         }
+        planBlocks(inode.blocks, offset, data, size, plan);
+        return size;
     }
 
     /**
-     * @brief Le um arquivo do disco
+     * @brief Conclui uma leitura preparada com planRead, depois que todas as suas leituras terminaram
+     * Blocos que estão na cache (possivelmente mais novos que o disco) substituem o que foi lido.
      * 
-     * @param index_block indice do bloco do arquivo
-     * @param block_offset 
-     * @param data 
-     * @param size 
+     * @param plan Plano cujas leituras terminaram
      */
-    void readFile(uint32_t index_block, uint32_t block_offset, char *data, uint32_t size)
+    void finishRead(ReadPlan &plan) override
     {
+        if (!plan.reads.empty())
+        {
+            cache.overlayCached(plan.reads);
+        }
+        copyPartials(plan);
+    }
 
-        IndexBlock ib;
-        diskManager.readBlock(index_block, reinterpret_cast<char *>(&ib));
-
-        uint32_t current_block_offset = block_offset;
+    /**
+     * @brief Motor de E/S assíncrona do disco, para quem faz as leituras de um ReadPlan
+     * 
+     * @return AsyncIo* Motor, ou nullptr no modo MMAP
+     */
+    AsyncIo *asyncIo() override
+    {
+        return diskManager.async();
+    }
 
-        // Função auxiliar para ler dados de um bloco de índice
-        auto readFromIndexBlock = [&](IndexBlock &ib, uint32_t &current_block_offset, char *&data, uint32_t &size)
+    /**
+     * @brief Le um arquivo do disco
+     * Com o índice em árvore, somente os blocos lidos são resolvidos; com extensões, somente os blocos de extensões
+     * até o último bloco lido; uma cadeia de blocos de índice é resolvida por inteiro antes da leitura. Os dados de
+     * um arquivo pequeno saem do próprio bloco de índice.
+     * 
+     * @param index_block indice do bloco do arquivo
+     * @param block_offset Primeiro bloco lógico a ser lido
+     * @param data Buffer de destino com pelo menos size bytes
+     * @param size Número de bytes a ler
+     */
+    void readFile(uint32_t index_block, uint32_t block_offset, char *data, uint32_t size) override
+    {
+        vector<u_int32_t> chain, blocks;
+        IndexBlock root;
+        readIndexBlock(index_block, root);
+        if (root.indirect_ptr == INDEX_TREE)
         {
-            for (uint32_t i = current_block_offset; i < ib.block_ptrs.size(); i++)
+            for (u_int32_t k = 0; k < ((uint64_t)size + BLOCK_SIZE - 1) / BLOCK_SIZE; k++)
             {
-                if (size == 0)
+                u_int32_t block = treeLookup(root, (uint64_t)block_offset + k);
+                if (block == 0xFFFFFFFF)
                 {
-                    break;
+                    throw runtime_error("Bloco de dados não encontrado!");
                 }
-
-                // Lê os dados do bloco de dados
-                uint32_t read_size = getMin<uint32_t>(size, BLOCK_SIZE);
-                diskManager.readBlock(ib.block_ptrs[i], data);
-                size -= read_size;
-                data += read_size;
-                current_block_offset++;
+                blocks.push_back(block);
             }
-        };
-
-        // Lê dos ponteiros diretos do bloco de índice atual
-        readFromIndexBlock(ib, current_block_offset, data, size);
-
-        // Se ainda houver dados para ler, usa ponteiros indiretos
-        while (size > 0)
+            readFileBlocks(blocks, 0, data, size);
+            return;
+        }
+        if (root.indirect_ptr == INDEX_EXTENTS)
         {
-            // Lê o bloco de índice indireto
-            IndexBlock indirect_ib;
-            diskManager.readBlock(ib.indirect_ptr, reinterpret_cast<char *>(&indirect_ib));
-
-            // Lê dos ponteiros diretos do bloco de índice indireto
-            readFromIndexBlock(indirect_ib, current_block_offset, data, size);
+            extentLookup(index_block, block_offset, ((uint64_t)size + BLOCK_SIZE - 1) / BLOCK_SIZE, blocks);
+            readFileBlocks(blocks, 0, data, size);
+            return;
+        }
+        if (root.indirect_ptr == INDEX_INLINE)
+        {
+            // O único "bloco de dados" é o próprio bloco de índice; o que passa de INLINE_BYTES é zero
+            if (block_offset != 0 || size > BLOCK_SIZE)
+            {
+                throw runtime_error("Bloco de dados não encontrado!");
+            }
+            memcpy(data, root.inlineData(), getMin(size, INLINE_BYTES));
+            memset(data + getMin(size, INLINE_BYTES), 0x00, size - getMin(size, INLINE_BYTES));
+            return;
         }
+        readChain(index_block, chain, nullptr, blocks);
+        readFileBlocks(blocks, (uint64_t)block_offset * BLOCK_SIZE, data, size);
     }
 
     /**
      * @brief Lista os arquivos do disco recursivamente
-     *  Funciona parcialmente
+     * 
      */
-    void listFilesRecursively()
+    void listFilesRecursively() override
     {
-        // Começar listando os arquivos no diretório raiz
-        diskManager.readBlock(superblock.root_dir_index, reinterpret_cast<char *>(rootDir.data()));
-        for (const auto &entry : rootDir)
-        {
-            if (entry.filename[0] != '\0')
-            {
-                string fullPath = "/" + string(entry.filename);
-                cout << "Filename: " << fullPath << ", Type: " << (entry.file_type == '1' ? "Arquivo" : (entry.file_type == '2' ? "Diretório" : "Tipo Desconhecido")) << ", Index Block: " << entry.index_block << endl;
-                // if (entry.file_type == '2') // Se for um diretório, listar recursivamente
-                // {
-                //     cout << "Entrando no diretório: " << fullPath << endl;
-                //     listFilesInDirectory(entry.index_block, fullPath);
-                // }
-            }
-        }
+        // Começar listando os arquivos no diretório raiz e descer em cada subdiretório
+        listFilesInDirectory(superblock.root_dir_index, "");
     }
 
-    // Ao listar os blocos livres estao aparecendo mais do que deviam, pois o superbloco deiz uma coisa e o listFreeBlocks diz outra
+    // O superbloco e o bitmap divergem quando há blocos marcados sem dono (ex.: caches de alocação de uma montagem
+    // que caiu) ou reservados pelos caches das threads: fsck reconcilia os dois
     /**
      * @brief Lista os blocos livres do disco
      * 
      */
-    void listFreeBlocks()
+    void listFreeBlocks() override
     {
-        diskManager.readBlock(superblock.bitmap_start, reinterpret_cast<char *>(bitmap.data()));
        cout<<"Blocos livres: ";
         for (uint32_t i = 0; i < superblock.total_blocks; i++)
         {
-            if (!(bitmap[i / 8] & (1 << (i % 8))) && i != 0)
+            if (!diskBitmapTest(i) && i != 0)
             {
                 cout << dec << i << " | ";
             }
@@ -838,15 +6832,171 @@ public:
      * @brief Lista os conteudos do superbloco do disco
      * 
      */
-    void listSuperblock()
+    void listSuperblock() override
+    {
+        BlockRef block = cache.pin(0);
+        const Superblock *diskSuperblock = reinterpret_cast<const Superblock *>(block.data());
+
+        cout << dec << "Total Blocks: " << diskSuperblock->total_blocks << endl;
+        cout << "Block Size: " << decodeBlockSize(diskSuperblock->block_size) << endl;
+        cout << "Bitmap Blocks: " << diskSuperblock->bitmap_blocks << endl;
+        cout << "Root Directory Index: " << diskSuperblock->root_dir_index << endl;
+        cout << "Free Blocks: " << diskSuperblock->free_blocks << endl;
+        cout << "Version: " << diskSuperblock->version << endl;
+        if (diskSuperblock->version >= 3)
+        {
+            cout << "Journal Start: " << diskSuperblock->journal_start << endl;
+            cout << "Journal Blocks: " << diskSuperblock->journal_blocks << endl;
+        }
+    }
+
+    /**
+     * @brief Lista as estatísticas da cache de blocos
+     * 
+     */
+    void listCacheStats() override
+    {
+        cout << dec << "Cache Hits: " << cache.hits << endl;
+        cout << "Cache Misses: " << cache.misses << endl;
+        cout << "Cache Evictions: " << cache.evictions << endl;
+        cout << "Cache Writebacks: " << cache.writebacks << endl;
+    }
+
+    /**
+     * @brief Lista as estatísticas da cache de dentries
+     * 
+     */
+    void listDentryStats() override
+    {
+        lock_guard<mutex> guard(dentryLock);
+        cout << dec << "Dentry Entries: " << dentries.size() << endl;
+        cout << "Dentry Hits: " << dentryHits << endl;
+        cout << "Dentry Negative Hits: " << dentryNegativeHits << endl;
+        cout << "Dentry Misses: " << dentryMisses << endl;
+        cout << "Dentry Invalidations: " << dentryInvalidations << endl;
+    }
+
+    /**
+     * @brief Lista as estatísticas da leitura antecipada
+     * 
+     */
+    void listReadaheadStats() override
+    {
+        cout << dec << "Readahead Windows: " << readaheadIssued << endl;
+        cout << "Readahead Bytes Served: " << readaheadHits << endl;
+        cout << "Readahead Discarded: " << readaheadDiscarded << endl;
+    }
+
+    /**
+     * @brief Contadores do diário de metadados
+     * 
+     */
+    JournalStats journalStats() override
+    {
+        JournalStats stats;
+        stats.commits = journalCommits;
+        stats.blocks = journalBlocksLogged;
+        stats.groupedSyncs = journalGroupedSyncs;
+        stats.overflows = journalOverflows + cache.spills;
+        stats.checkpoints = journalCheckpoints;
+        stats.replayed = journalReplayed;
+        return stats;
+    }
+
+    /**
+     * @brief Lista as estatísticas do diário de metadados
+     * 
+     */
+    void listJournalStats() override
     {
-        cout << &superblock << endl;
-        diskManager.readBlock(0, reinterpret_cast<char *>(&superblock));
+        JournalStats stats = journalStats();
+        cout << dec << "Journal Commits: " << stats.commits << endl;
+        cout << "Journal Blocks Logged: " << stats.blocks << endl;
+        cout << "Journal Grouped Syncs: " << stats.groupedSyncs << endl;
+        cout << "Journal Overflows: " << stats.overflows << endl;
+        cout << "Journal Checkpoints: " << stats.checkpoints << endl;
+        cout << "Journal Transactions Replayed: " << stats.replayed << endl;
+    }
+
+    /**
+     * @brief Verifica a consistência do sistema de arquivos (fsck): percorre em paralelo todos os diretórios e
+     * cadeias de blocos de índice, compara os blocos alcançáveis com o bitmap e, se indicado, corrige os problemas.
+     * Os blocos reservados pelos caches de alocação das threads voltam ao bitmap antes da comparação; os que ficaram
+     * presos em caches de uma montagem que caiu aparecem como blocos sem referência.
+     * Deve ser chamado sem arquivos abertos e sem nenhuma outra thread usando o sistema de arquivos.
+     * 
+     * @param threads Threads do percurso (0: uma por processador)
+     * @param repair Se true, escreve as correções: blocos sem referência são liberados, blocos em uso são marcados no
+     * bitmap, blocos de dados compartilhados são copiados e as demais referências inválidas são removidas
+     * @return FsckReport Problemas encontrados (no primeiro percurso e nos seguintes, feitos depois de cada correção)
+     */
+    FsckReport fsck(u_int32_t threads, bool repair) override
+    {
+        FsckReport report;
+        {
+            JournalOp op(*this);
+            unique_lock<shared_mutex> namespaceGuard(namespaceLock);
+            {
+                lock_guard<mutex> guard(openFilesLock);
+                if (!openFiles.empty())
+                {
+                    throw runtime_error("Feche os arquivos abertos antes de verificar o sistema de arquivos!");
+                }
+            }
+            threads = threads > 0 ? threads : getMax<u_int32_t>(1, thread::hardware_concurrency());
+            {
+                BlockRef block = cache.pin(0);
+                report.freeBlocksRecorded = reinterpret_cast<const Superblock *>(block.data())->free_blocks;
+            }
+
+            // Uma correção pode deixar blocos sem referência (cadeias cortadas, entradas removidas): percorrer de novo
+            for (u_int32_t pass = 0; pass < 4; pass++)
+            {
+                reclaimCaches(true);
+                FsckReport found;
+                vector<FsckFix> fixes;
+                vector<u_int32_t> leaked, unmarked;
+                fsckPass(threads, found, fixes, leaked, unmarked);
+                report.passes++;
+                report.directories = found.directories;
+                report.files = found.files;
+                report.reachableBlocks = found.reachableBlocks;
+                found.directories = found.files = 0;
+                fsckMerge(report, found);
+                report.clean = fixes.empty() && leaked.empty() && unmarked.empty();
+                if (report.clean || !repair)
+                {
+                    break;
+                }
+                fsckRepair(fixes, leaked, unmarked);
+                report.repaired = true;
+            }
 
-        cout << "Total Blocks: " << superblock.total_blocks << endl;
-        cout << "Bitmap Blocks: " << superblock.bitmap_blocks << endl;
-        cout << "Root Directory Index: " << superblock.root_dir_index << endl;
-        cout << "Free Blocks: " << superblock.free_blocks << endl;
+            if (report.repaired)
+            {
+                // Índices de nomes e caminhos resolvidos podem citar entradas removidas
+                {
+                    lock_guard<mutex> guard(dirIndexesLock);
+                    dirIndexes.clear();
+                    dirIndexesEpoch++;
+                }
+                lock_guard<mutex> guard(dentryLock);
+                dentryGeneration++;
+                dentries.clear();
+            }
+            report.freeBlocksActual = freeBlocksCount;
+            if (repair && report.freeBlocksActual != report.freeBlocksRecorded)
+            {
+                superblockDirty = true;
+                flushAllocMetadata();
+                report.repaired = true;
+            }
+        }
+        if (report.repaired)
+        {
+            sync();
+        }
+        return report;
     }
 
     /**
@@ -854,20 +7004,19 @@ public:
      * 
      * @param index_block 
      */
-    void listIndexBlock(uint32_t index_block)
+    void listIndexBlock(uint32_t index_block) override
     {
 
-        IndexBlock ib;
-        diskManager.readBlock(index_block, reinterpret_cast<char *>(&ib));
+        IndexView ib = viewIndexBlock(index_block);
 
         cout << "Index Block: " << index_block << endl;
         cout << "Direct Pointers: ";
-        for (const auto &ptr : ib.block_ptrs)
+        for (const auto &ptr : ib->block_ptrs)
         {
             cout << ptr << " ";
         }
         cout << endl;
-        cout << "Indirect Pointer: " << ib.indirect_ptr << endl;
+        cout << "Indirect Pointer: " << ib->indirect_ptr << endl;
     }
 
     /**
@@ -875,11 +7024,11 @@ public:
      * 
      * @param data_block 
      */
-    void listDataBlock(uint32_t data_block)
+    void listDataBlock(uint32_t data_block) override
     {
 
         char data[BLOCK_SIZE];
-        diskManager.readBlock(data_block, data);
+        cache.readBlock(data_block, data);
 
         cout << "Data Block: " << data_block << endl;
         cout << "Data: " << data << endl;
@@ -889,30 +7038,34 @@ public:
      * @brief Lista o bitmap
      * 
      */
-    void listBitmap()
+    void listBitmap() override
     {
 
-        diskManager.readBlock(superblock.bitmap_start, reinterpret_cast<char *>(bitmap.data()));
-
         for (uint32_t i = 0; i < superblock.total_blocks; i++)
         {
-            cout << ((bitmap[i / 8] & (1 << (i % 8))) ? "1" : "0");
+            cout << (diskBitmapTest(i) ? "1" : "0");
         }
 
         cout << endl;
+
+        // Resumo por grupo (cada grupo corresponde a um bloco do bitmap)
+        for (uint32_t group = 0; group < bitmap.numGroups(); group++)
+        {
+            cout << dec << "Grupo " << group << " (bloco " << superblock.bitmap_start + group << "): " << bitmap.freeInGroup(group) << " livres" << endl;
+        }
     }
 
     /**
      * @brief Lista todo o disco
      * 
      */
-    void listDisk()
+    void listDisk() override
     {
 
         for (uint32_t i = 0; i < superblock.total_blocks; i++)
         {
             char data[BLOCK_SIZE];
-            diskManager.readBlock(i, data);
+            cache.readBlock(i, data);
 
             cout << "Block: " << i << endl;
 
@@ -929,13 +7082,13 @@ public:
      * @brief Lista o disco em hexadecimal
      * 
      */
-    void listDiskHex()
+    void listDiskHex() override
     {
 
         for (uint32_t i = 0; i < superblock.total_blocks; i++)
         {
             char data[BLOCK_SIZE];
-            diskManager.readBlock(i, data);
+            cache.readBlock(i, data);
 
             cout << "Block: " << i << endl;
             cout << "Data: ";
@@ -948,3 +7101,82 @@ public:
     }
 };
 
+/**
+ * @brief Cria a implementação correspondente ao tamanho de bloco, sem acessar o disco
+ * 
+ */
+inline unique_ptr<FileSystem> FileSystem::instantiate(u_int32_t blockSize, string &path, DiskBackend backend, u_int32_t cacheBlocks)
+{
+    switch (blockSize)
+    {
+    case 512:
+        return unique_ptr<FileSystem>(new SizedFileSystem<512>(path, backend, cacheBlocks));
+    case 1024:
+        return unique_ptr<FileSystem>(new SizedFileSystem<1024>(path, backend, cacheBlocks));
+    case 2048:
+        return unique_ptr<FileSystem>(new SizedFileSystem<2048>(path, backend, cacheBlocks));
+    case 4096:
+        return unique_ptr<FileSystem>(new SizedFileSystem<4096>(path, backend, cacheBlocks));
+    case 8192:
+        return unique_ptr<FileSystem>(new SizedFileSystem<8192>(path, backend, cacheBlocks));
+    case 16384:
+        return unique_ptr<FileSystem>(new SizedFileSystem<16384>(path, backend, cacheBlocks));
+    case 32768:
+        return unique_ptr<FileSystem>(new SizedFileSystem<32768>(path, backend, cacheBlocks));
+    case 65536:
+        return unique_ptr<FileSystem>(new SizedFileSystem<65536>(path, backend, cacheBlocks));
+    default:
+        throw runtime_error("Tamanho de bloco inválido: use uma potência de 2 entre 512 e 65536 bytes!");
+    }
+}
+
+/**
+ * @brief Formata um disco com o tamanho de bloco escolhido
+ * 
+ * @param path Caminho do disco
+ * @param numBlocks Número de blocos do sistema de arquivos
+ * @param blockSize Tamanho do bloco em bytes (potência de 2 entre 512 B e 64 KiB)
+ * @param backend Forma de acesso ao disco (pread/pwrite ou mmap)
+ * @param cacheBlocks Capacidade da cache de blocos (ignorada no modo MMAP)
+ * @param allocation Forma de alocação da imagem (esparsa por padrão)
+ * @param journalBlocks Blocos do diário de metadados (JOURNAL_AUTO escolhe pelo tamanho do disco; 0 formata sem diário)
+ * @return unique_ptr<FileSystem> Sistema de arquivos formatado
+ */
+inline unique_ptr<FileSystem> FileSystem::mkfs(string &path, u_int32_t numBlocks, u_int32_t blockSize, DiskBackend backend, u_int32_t cacheBlocks,
+                                               ImageAllocation allocation, u_int32_t journalBlocks)
+{
+    unique_ptr<FileSystem> fs = instantiate(blockSize, path, backend, cacheBlocks);
+    fs->formatDisk(numBlocks, allocation, journalBlocks);
+    return fs;
+}
+
+/**
+ * @brief Monta um disco já formatado, sem reformatá-lo
+ * O tamanho do bloco é lido do superbloco.
+ * 
+ * @param path Caminho do disco
+ * @param backend Forma de acesso ao disco (pread/pwrite ou mmap)
+ * @param cacheBlocks Capacidade da cache de blocos (ignorada no modo MMAP)
+ * @return unique_ptr<FileSystem> Sistema de arquivos montado
+ */
+inline unique_ptr<FileSystem> FileSystem::mount(string &path, DiskBackend backend, u_int32_t cacheBlocks)
+{
+    // O superbloco cabe no menor bloco possível: basta ler o início do disco para descobrir o tamanho do bloco
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw runtime_error("Erro ao abrir o disco: " + string(strerror(errno)));
+    }
+    Superblock sb;
+    ssize_t n = ::pread(fd, &sb, sizeof(Superblock), 0);
+    ::close(fd);
+    if (n != (ssize_t)sizeof(Superblock))
+    {
+        throw runtime_error("O disco não contém um sistema de arquivos válido!");
+    }
+    checkSuperblock(sb);
+
+    unique_ptr<FileSystem> fs = instantiate(decodeBlockSize(sb.block_size), path, backend, cacheBlocks);
+    fs->loadDisk();
+    return fs;
+}
@@ -0,0 +1,1019 @@
+// Benchmark multithread do sistema de arquivos: leituras paralelas de arquivos diferentes, profundidade da fila de E/S
+// assíncrona, blocos isolados por backend (comparados ao acesso original com fstream), alocação de blocos, enchimento
+// de uma imagem, estresse de metadados, metadados duráveis (diário com commit em grupo), leituras aleatórias resolvidas
+// pelo índice em árvore para vários tamanhos de arquivo, arquivos mapeados por extensões comparados ao índice em
+// árvore, criação de muitos arquivos pequenos (com os dados no bloco de índice ou não), diretórios grandes, consultas
+// pelo nome em diretórios de 10 mil e 100 mil entradas e formatação de imagens de 1 GiB e 100 GiB
+#include <thread>
+#include <chrono>
+#include <random>
+#include <memory>
+#include "FileSystem.h"
+
+using namespace std;
+
+static FILE *report = stdout; // Relatório (as operações do sistema de arquivos escrevem mensagens no stdout)
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Conteúdo de referência: o pedaço c do arquivo f começa em pattern + patternOffset(f, c)
+static vector<char> pattern;
+
+static uint32_t patternOffset(uint32_t file, uint64_t chunk)
+{
+    return (file * 131 + chunk * 17) % 4096;
+}
+
+/**
+ * @brief Lê o superbloco direto da imagem (depois de uma desmontagem: com o diário, sync não escreve os metadados no lugar)
+ *
+ */
+static Superblock readSuperblock(const string &path)
+{
+    Superblock sb;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0 || ::pread(fd, &sb, sizeof(sb), 0) != (ssize_t)sizeof(sb))
+    {
+        throw runtime_error("Erro ao ler o superbloco da imagem");
+    }
+    ::close(fd);
+    return sb;
+}
+
+/**
+ * @brief Cria os arquivos /dados/f0 .. /dados/f(files-1) com fileBytes bytes cada
+ * (o diretório raiz guarda poucas entradas com blocos pequenos)
+ *
+ */
+static void writeFiles(FileSystem &fs, uint32_t files, uint32_t fileBytes, uint32_t chunk)
+{
+    string dir = "dados";
+    fs.createFile(dir, '2');
+    for (uint32_t f = 0; f < files; f++)
+    {
+        string name = "f" + to_string(f);
+        fs.createFile(name, '1', "/dados");
+        u_int32_t handle = fs.openFile("/dados/" + name);
+        for (uint64_t pos = 0; pos < fileBytes; pos += chunk)
+        {
+            uint32_t n = getMin<uint64_t>(chunk, fileBytes - pos);
+            fs.writeFile(handle, pos, pattern.data() + patternOffset(f, pos / chunk), n);
+        }
+        fs.closeFile(handle);
+    }
+    fs.sync();
+}
+
+/**
+ * @brief Cada thread lê por inteiro os arquivos que lhe cabem (f % threads == t), verificando o conteúdo
+ *
+ * @return double Vazão total em MB/s
+ */
+static double parallelRead(FileSystem &fs, uint32_t threads, uint32_t files, uint32_t fileBytes, uint32_t chunk, bool &ok)
+{
+    atomic<bool> valid{true};
+    vector<thread> workers;
+    double start = now();
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+                                 vector<char> buffer(chunk);
+                                 try
+                                 {
+                                     for (uint32_t f = t; f < files; f += threads)
+                                     {
+                                         u_int32_t handle = fs.openFile("/dados/f" + to_string(f));
+                                         for (uint64_t pos = 0; pos < fileBytes; pos += chunk)
+                                         {
+                                             uint32_t n = fs.readFileAt(handle, pos, buffer.data(), chunk);
+                                             if (n != getMin<uint64_t>(chunk, fileBytes - pos) ||
+                                                 memcmp(buffer.data(), pattern.data() + patternOffset(f, pos / chunk), n) != 0)
+                                             {
+                                                 valid = false;
+                                             }
+                                         }
+                                         fs.closeFile(handle);
+                                     }
+                                 }
+                                 catch (const exception &e)
+                                 {
+                                     cerr << e.what() << endl;
+                                     valid = false;
+                                 } });
+    }
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+    double elapsed = now() - start;
+    ok &= valid;
+    return (double)files * fileBytes / elapsed / 1e6;
+}
+
+/**
+ * @brief Uma thread do estresse: cria, escreve, fecha, renomeia, reabre, relê e apaga um arquivo por rodada,
+ * alternando entre o próprio diretório e o diretório compartilhado
+ *
+ */
+static void stressThread(FileSystem &fs, uint32_t t, uint32_t rounds, atomic<uint64_t> &operations, atomic<bool> &valid)
+{
+    string own = "/estresse/t" + to_string(t);
+    vector<char> buffer;
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        string dir = i % 2 == 0 ? own : string("/estresse/shared");
+        string name = "s" + to_string(t) + "_" + to_string(i);
+        string path = dir + "/" + name;
+        string moved = own + "/m" + to_string(t) + "_" + to_string(i);
+        uint32_t size = 1 + (i * 7919 + t * 104729) % 65536;
+
+        fs.createFile(name, '1', dir);
+        u_int32_t handle = fs.openFile(path);
+        if (handle == 0xFFFFFFFF)
+        {
+            valid = false;
+            continue;
+        }
+        fs.writeFile(handle, 0, pattern.data() + patternOffset(t, i), size);
+        fs.closeFile(handle);
+
+        fs.renameFile(path, moved);
+        buffer.assign(size + 1, 0);
+        handle = fs.openFile(moved);
+        if (handle == 0xFFFFFFFF)
+        {
+            valid = false;
+            continue;
+        }
+        if (fs.readFileAt(handle, 0, buffer.data(), size + 1) != size ||
+            memcmp(buffer.data(), pattern.data() + patternOffset(t, i), size) != 0)
+        {
+            valid = false;
+        }
+        fs.closeFile(handle);
+        fs.deleteFile(moved);
+        operations += 7;
+    }
+}
+
+/**
+ * @brief Estresse de metadados: cada thread cria, escreve, relê, renomeia e apaga arquivos
+ * no próprio diretório e em um diretório compartilhado por todas as threads
+ *
+ * @return double Operações por segundo
+ */
+static double stress(FileSystem &fs, uint32_t threads, uint32_t rounds, bool &ok)
+{
+    atomic<bool> valid{true};
+    atomic<uint64_t> operations{0};
+    vector<thread> workers;
+    double start = now();
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+                                 try
+                                 {
+                                     stressThread(fs, t, rounds, operations, valid);
+                                 }
+                                 catch (const exception &e)
+                                 {
+                                     cerr << e.what() << endl;
+                                     valid = false;
+                                 } });
+    }
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+    double elapsed = now() - start;
+    ok &= valid;
+    return operations / elapsed;
+}
+
+/**
+ * @brief Leituras aleatórias de um bloco na imagem com uma fila assíncrona de profundidade depth.
+ * A cache de páginas do kernel é descartada antes (posix_fadvise), para que as leituras cheguem ao dispositivo.
+ *
+ * @param engine Motor da fila (o ativo é devolvido, pois sem io_uring o pool de threads é usado)
+ * @return double Leituras por segundo
+ */
+static double queueDepth(const string &path, AsyncEngine &engine, u_int32_t depth, u_int32_t blockSize, u_int32_t numBlocks, u_int32_t reads)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw runtime_error("Erro ao abrir a imagem: " + string(strerror(errno)));
+    }
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    double elapsed;
+    {
+        AsyncIo io(fd, engine);
+        engine = io.activeEngine();
+        IoQueue queue(io, depth);
+        vector<char> buffers((size_t)depth * blockSize);
+        vector<u_int32_t> freeBuffers;
+        for (u_int32_t i = 0; i < depth; i++)
+        {
+            freeBuffers.push_back(i);
+        }
+        vector<u_int32_t> bufferOf(reads);
+        mt19937 rng(depth);
+        double start = now();
+        for (u_int32_t i = 0; i < reads; i++)
+        {
+            if (freeBuffers.empty())
+            {
+                freeBuffers.push_back(bufferOf[queue.wait()]);
+            }
+            u_int32_t buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+            iovec iov = {buffers.data() + (size_t)buffer * blockSize, blockSize};
+            bufferOf[queue.read((off_t)(rng() % numBlocks) * blockSize, &iov, 1)] = buffer;
+        }
+        queue.drain();
+        elapsed = now() - start;
+    }
+    ::close(fd);
+    return reads / elapsed;
+}
+
+/**
+ * @brief Transfere um bloco da imagem como o DiskManager original: abre o arquivo, posiciona, copia o bloco por um buffer
+ * alocado a cada chamada e fecha
+ *
+ */
+static void fstreamBlock(const string &path, u_int32_t block, u_int32_t blockSize, char *data, bool write)
+{
+    fstream disk(path, ios::in | ios::out | ios::binary);
+    if (!disk.is_open())
+    {
+        throw runtime_error("Erro ao abrir a imagem");
+    }
+    unique_ptr<char[]> buffer(new char[blockSize]);
+    if (write)
+    {
+        memcpy(buffer.get(), data, blockSize);
+        disk.seekp((uint64_t)block * blockSize);
+        disk.write(buffer.get(), blockSize);
+    }
+    else
+    {
+        disk.seekg((uint64_t)block * blockSize);
+        disk.read(buffer.get(), blockSize);
+        memcpy(data, buffer.get(), blockSize);
+    }
+    disk.close();
+}
+
+/**
+ * @brief Escreve e depois lê ops blocos escolhidos ao acaso de um arquivo de fileBlocks blocos, um bloco por chamada e
+ * sem cache de blocos. Com legacy, cada bloco é transferido como no DiskManager original (fstreamBlock); senão, pelo
+ * descritor do arquivo aberto, com o backend indicado.
+ *
+ * @param readRate Recebe os blocos lidos por segundo
+ * @return double Blocos escritos por segundo
+ */
+static double blockRate(string &path, u_int32_t blockSize, DiskBackend backend, bool legacy, uint32_t fileBlocks,
+                        uint32_t ops, double &readRate, bool &ok)
+{
+    unique_ptr<FileSystem> fs = FileSystem::mkfs(path, fileBlocks * 17 / 16 + 65536, blockSize, backend, 0);
+    string name = "b";
+    fs->createFile(name, '1');
+    u_int32_t handle = fs->openFile("/b");
+    for (u_int32_t k = 0; k < fileBlocks; k++)
+    {
+        fs->writeFile(handle, k * blockSize, pattern.data() + patternOffset(0, k), blockSize);
+    }
+    fs->closeFile(handle);
+    char type;
+    u_int32_t indexBlock;
+    fs->readFile(name, &type, &indexBlock);
+    vector<u_int32_t> physical(legacy ? fileBlocks : 0);
+    for (u_int32_t k = 0; k < physical.size(); k++)
+    {
+        physical[k] = fs->getFileDataBlockIndex(indexBlock, k);
+    }
+    handle = fs->openFile("/b");
+
+    mt19937 rng(fileBlocks);
+    vector<char> buffer(blockSize);
+    double start = now();
+    for (uint32_t i = 0; i < ops; i++)
+    {
+        u_int32_t k = rng() % fileBlocks;
+        const char *data = pattern.data() + patternOffset(0, k);
+        if (legacy)
+        {
+            memcpy(buffer.data(), data, blockSize);
+            fstreamBlock(path, physical[k], blockSize, buffer.data(), true);
+        }
+        else
+        {
+            fs->writeFile(handle, k * blockSize, data, blockSize);
+        }
+    }
+    double writeRate = ops / (now() - start);
+
+    start = now();
+    for (uint32_t i = 0; i < ops; i++)
+    {
+        u_int32_t k = rng() % fileBlocks;
+        if (legacy)
+        {
+            fstreamBlock(path, physical[k], blockSize, buffer.data(), false);
+        }
+        else if (fs->readFileAt(handle, k * blockSize, buffer.data(), blockSize) != blockSize)
+        {
+            ok = false;
+        }
+        if (memcmp(buffer.data(), pattern.data() + patternOffset(0, k), blockSize) != 0)
+        {
+            ok = false;
+        }
+    }
+    readRate = ops / (now() - start);
+    fs->closeFile(handle);
+    return writeRate;
+}
+
+/**
+ * @brief Cada thread aloca blocos um a um (como quem escreve acrescentando ao fim de um arquivo) e os libera no fim
+ *
+ * @return double Alocações por segundo
+ */
+static double allocate(FileSystem &fs, uint32_t threads, uint32_t perThread, bool &ok)
+{
+    atomic<bool> valid{true};
+    vector<thread> workers;
+    double start = now();
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&]()
+                             {
+                                 vector<u_int32_t> blocks;
+                                 blocks.reserve(perThread);
+                                 try
+                                 {
+                                     for (uint32_t i = 0; i < perThread; i++)
+                                     {
+                                         blocks.push_back(fs.allocBlock());
+                                     }
+                                 }
+                                 catch (const exception &e)
+                                 {
+                                     cerr << e.what() << endl;
+                                     valid = false;
+                                 }
+                                 fs.freeBlocks(blocks); });
+    }
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+    double elapsed = now() - start;
+    ok &= valid;
+    return (double)threads * perThread / elapsed;
+}
+
+/**
+ * @brief Enche uma imagem nova de numBlocks blocos alocando perCall blocos por chamada até o disco acabar
+ * (o caso em que a busca next-fit percorre o bitmap inteiro), incluindo a desmontagem
+ *
+ * @param allocated Recebe o número de blocos alocados
+ * @return double Chamadas de alocação por segundo
+ */
+static double fillImage(string &path, u_int32_t blockSize, u_int32_t numBlocks, u_int32_t perCall, uint32_t &allocated, bool &ok)
+{
+    FileSystem::mkfs(path, numBlocks, blockSize).reset();
+    uint32_t freeBefore = readSuperblock(path).free_blocks;
+    unique_ptr<FileSystem> fs = FileSystem::mount(path);
+    uint32_t calls = 0;
+    allocated = 0;
+    double start = now();
+    while ((perCall == 1 ? fs->allocBlock() : fs->allocExtent(perCall)) != 0xFFFFFFFF)
+    {
+        calls++;
+        allocated += perCall;
+    }
+    fs.reset(); // A desmontagem grava o bitmap
+    double elapsed = now() - start;
+
+    // Os blocos alocados ficam marcados no bitmap gravado; com um bloco por chamada, nenhum sobra
+    uint32_t freeAfter = readSuperblock(path).free_blocks;
+    if (freeBefore - freeAfter != allocated || (perCall == 1 && freeAfter != 0))
+    {
+        fprintf(report, "Blocos livres antes %u, depois %u, alocados %u\n", freeBefore, freeAfter, allocated);
+        ok = false;
+    }
+    return calls / elapsed;
+}
+
+/**
+ * @brief Cada thread cria arquivos no próprio diretório e torna cada criação durável com sync
+ * (como um servidor de e-mail ou um banco de dados que precisa confirmar cada operação)
+ *
+ * @return double Criações duráveis por segundo
+ */
+static double durableCreate(FileSystem &fs, uint32_t threads, uint32_t perThread, uint32_t round, bool &ok)
+{
+    atomic<bool> valid{true};
+    vector<thread> workers;
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        string dir = "r" + to_string(round) + "t" + to_string(t);
+        fs.createFile(dir, '2');
+    }
+    double start = now();
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+                                 string dir = "/r" + to_string(round) + "t" + to_string(t);
+                                 try
+                                 {
+                                     for (uint32_t i = 0; i < perThread; i++)
+                                     {
+                                         string name = "f" + to_string(i);
+                                         fs.createFile(name, '1', dir);
+                                         fs.sync();
+                                     }
+                                 }
+                                 catch (const exception &e)
+                                 {
+                                     cerr << e.what() << endl;
+                                     valid = false;
+                                 } });
+    }
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+    double elapsed = now() - start;
+    ok &= valid;
+    return (double)threads * perThread / elapsed;
+}
+
+/**
+ * @brief Descarta as páginas da imagem, para que as leituras cheguem ao dispositivo
+ *
+ */
+static void dropPageCache(const string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+/**
+ * @brief Cria um arquivo de fileBytes bytes em uma imagem nova e, depois de montá-la de novo (cache vazia), mede a
+ * abertura do arquivo (que carrega o índice inteiro) e leituras aleatórias de um bloco sem descritor aberto, em que
+ * cada leitura resolve o bloco pelo índice
+ *
+ * @param openUs Recebe o tempo de abertura em microssegundos
+ * @param p99Us Recebe o percentil 99 da latência de leitura em microssegundos
+ * @return double Latência média de leitura em microssegundos
+ */
+static double indexedRead(string &path, u_int32_t blockSize, uint32_t fileBytes, uint32_t chunk, uint32_t reads,
+                          double &openUs, double &p99Us, bool &ok)
+{
+    u_int32_t numBlocks = (uint64_t)fileBytes / blockSize * 17 / 16 + 65536;
+    string name = "a";
+    u_int32_t indexBlock;
+    {
+        unique_ptr<FileSystem> fs = FileSystem::mkfs(path, numBlocks, blockSize);
+        fs->createFile(name, '1');
+        u_int32_t handle = fs->openFile("/a");
+        for (uint64_t pos = 0; pos < fileBytes; pos += chunk)
+        {
+            fs->writeFile(handle, pos, pattern.data() + patternOffset(0, pos / chunk), getMin<uint64_t>(chunk, fileBytes - pos));
+        }
+        fs->closeFile(handle);
+        char type;
+        fs->readFile(name, &type, &indexBlock);
+    }
+
+    dropPageCache(path);
+    unique_ptr<FileSystem> fs = FileSystem::mount(path);
+    double start = now();
+    fs->closeFile(fs->openFile("/a"));
+    openUs = (now() - start) * 1e6;
+
+    dropPageCache(path);
+    mt19937 rng(fileBytes);
+    vector<char> buffer(blockSize);
+    vector<double> latencies;
+    u_int32_t fileBlocks = fileBytes / blockSize;
+    for (uint32_t i = 0; i < reads; i++)
+    {
+        u_int32_t k = rng() % fileBlocks;
+        start = now();
+        fs->readFile(indexBlock, k, buffer.data(), blockSize);
+        latencies.push_back(now() - start);
+        uint64_t pos = (uint64_t)k * blockSize;
+        if (memcmp(buffer.data(), pattern.data() + patternOffset(0, pos / chunk) + pos % chunk, blockSize) != 0)
+        {
+            ok = false;
+        }
+    }
+    double total = 0;
+    for (double latency : latencies)
+    {
+        total += latency;
+    }
+    sort(latencies.begin(), latencies.end());
+    p99Us = latencies[latencies.size() * 99 / 100] * 1e6;
+    return total / reads * 1e6;
+}
+
+/**
+ * @brief Escreve sequencialmente um arquivo de fileBytes bytes do tipo fileType em uma imagem nova e, depois de montá-la
+ * de novo (cache vazia e cache de páginas descartada), lê o arquivo inteiro em pedaços de chunk bytes
+ *
+ * @param fileType '1' (índice em árvore) ou '3' (extensões)
+ * @param metadataBlocks Recebe os blocos ocupados pelo arquivo além dos blocos de dados
+ * @param readMBps Recebe a vazão de leitura em MB/s
+ * @return double Vazão de escrita em MB/s
+ */
+static double mappedStream(string &path, u_int32_t blockSize, char fileType, uint32_t fileBytes, uint32_t chunk,
+                           uint32_t &metadataBlocks, double &readMBps, bool &ok)
+{
+    u_int32_t numBlocks = (uint64_t)fileBytes / blockSize * 17 / 16 + 65536;
+    FileSystem::mkfs(path, numBlocks, blockSize).reset();
+    uint32_t freeBefore = readSuperblock(path).free_blocks;
+
+    string name = "a";
+    unique_ptr<FileSystem> fs = FileSystem::mount(path);
+    double start = now();
+    fs->createFile(name, fileType);
+    u_int32_t handle = fs->openFile("/a");
+    for (uint64_t pos = 0; pos < fileBytes; pos += chunk)
+    {
+        fs->writeFile(handle, pos, pattern.data() + patternOffset(0, pos / chunk), getMin<uint64_t>(chunk, fileBytes - pos));
+    }
+    fs->closeFile(handle);
+    fs.reset();
+    double writeMBps = fileBytes / (now() - start) / 1e6;
+    metadataBlocks = freeBefore - readSuperblock(path).free_blocks - (fileBytes + blockSize - 1) / blockSize;
+
+    dropPageCache(path);
+    fs = FileSystem::mount(path);
+    vector<char> buffer(chunk);
+    start = now();
+    handle = fs->openFile("/a");
+    for (uint64_t pos = 0; pos < fileBytes; pos += chunk)
+    {
+        uint32_t size = getMin<uint64_t>(chunk, fileBytes - pos);
+        if (fs->readFileAt(handle, pos, buffer.data(), size) != size ||
+            memcmp(buffer.data(), pattern.data() + patternOffset(0, pos / chunk), size) != 0)
+        {
+            ok = false;
+        }
+    }
+    fs->closeFile(handle);
+    readMBps = fileBytes / (now() - start) / 1e6;
+    return writeMBps;
+}
+
+/**
+ * @brief Cria files arquivos de fileBytes bytes (em dirs diretórios) em uma imagem nova e, depois de montá-la de novo
+ * (cache vazia e cache de páginas descartada), lê 2000 deles sem descritor aberto, a partir do bloco de índice
+ *
+ * @param blocksPerFile Recebe os blocos ocupados por arquivo (entrada de diretório, índice e dados; inclui os diretórios)
+ * @param readUs Recebe a latência média de leitura de um arquivo em microssegundos
+ * @return double Criações (criar, escrever, fechar) por segundo
+ */
+static double smallFiles(string &path, u_int32_t blockSize, uint32_t fileBytes, uint32_t files, uint32_t dirs,
+                         double &blocksPerFile, double &readUs, bool &ok)
+{
+    u_int32_t numBlocks = files * 4 + 65536;
+    FileSystem::mkfs(path, numBlocks, blockSize).reset();
+    uint32_t freeBefore = readSuperblock(path).free_blocks;
+
+    unique_ptr<FileSystem> fs = FileSystem::mount(path);
+    string top = "p";
+    fs->createFile(top, '2');
+    for (uint32_t d = 0; d < dirs; d++)
+    {
+        string dir = to_string(d);
+        fs->createFile(dir, '2', "/p");
+    }
+    vector<u_int32_t> indexBlocks(files);
+    double start = now();
+    for (uint32_t i = 0; i < files; i++)
+    {
+        string name = "f" + to_string(i);
+        string dir = "/p/" + to_string(i % dirs);
+        fs->createFile(name, '1', dir);
+        u_int32_t handle = fs->openFile(dir + "/" + name);
+        fs->writeFile(handle, 0, pattern.data() + patternOffset(i, 0), fileBytes);
+        fs->closeFile(handle);
+    }
+    double createRate = files / (now() - start);
+    for (uint32_t i = 0; i < files; i++)
+    {
+        string name = "/p/" + to_string(i % dirs) + "/f" + to_string(i);
+        char type;
+        fs->readFile(name, &type, &indexBlocks[i]);
+    }
+    fs.reset();
+    blocksPerFile = (double)(freeBefore - readSuperblock(path).free_blocks) / files;
+
+    dropPageCache(path);
+    fs = FileSystem::mount(path);
+    mt19937 rng(files);
+    vector<char> buffer(fileBytes);
+    start = now();
+    for (uint32_t r = 0; r < 2000; r++)
+    {
+        uint32_t i = rng() % files;
+        fs->readFile(indexBlocks[i], 0, buffer.data(), fileBytes);
+        if (memcmp(buffer.data(), pattern.data() + patternOffset(i, 0), fileBytes) != 0)
+        {
+            ok = false;
+        }
+    }
+    readUs = (now() - start) / 2000 * 1e6;
+    return createRate;
+}
+
+/**
+ * @brief Cria files arquivos vazios em um único diretório de uma imagem nova e, depois de montá-la de novo (cache
+ * vazia e cache de páginas descartada), abre e fecha 2000 deles escolhidos ao acaso pelo caminho
+ *
+ * @param firstUs Recebe a latência da primeira abertura (inclui a carga do índice do diretório) em microssegundos
+ * @param lookupUs Recebe a latência média das aberturas seguintes em microssegundos
+ * @return double Criações por segundo
+ */
+static double largeDirectory(string &path, u_int32_t blockSize, uint32_t files, double &firstUs, double &lookupUs, bool &ok)
+{
+    FileSystem::mkfs(path, files * 2 + 65536, blockSize).reset();
+    unique_ptr<FileSystem> fs = FileSystem::mount(path);
+    string dir = "d";
+    fs->createFile(dir, '2');
+    double start = now();
+    for (uint32_t i = 0; i < files; i++)
+    {
+        string name = "f" + to_string(i);
+        fs->createFile(name, '1', "/d");
+    }
+    double createRate = files / (now() - start);
+    fs.reset();
+
+    dropPageCache(path);
+    fs = FileSystem::mount(path);
+    mt19937 rng(files);
+    firstUs = 0;
+    lookupUs = 0;
+    start = now();
+    for (uint32_t r = 0; r <= 2000; r++)
+    {
+        u_int32_t handle = fs->openFile("/d/f" + to_string(rng() % files));
+        if (handle == 0xFFFFFFFF)
+        {
+            ok = false;
+        }
+        else
+        {
+            fs->closeFile(handle);
+        }
+        if (r == 0)
+        {
+            firstUs = (now() - start) * 1e6;
+            start = now();
+        }
+    }
+    lookupUs = (now() - start) / 2000 * 1e6;
+    return createRate;
+}
+
+/**
+ * @brief Cria files arquivos vazios em um único diretório e, depois de montar a imagem de novo (cache vazia e cache
+ * de páginas descartada), procura cada um pelo nome simples, que vai direto ao índice do diretório (sem a cache de
+ * dentries), duas vezes: a primeira passada lê os blocos do índice, a segunda os encontra na cache de blocos
+ *
+ * @param warmUs Recebe a latência média da segunda passada em microssegundos
+ * @return double Latência média da primeira passada em microssegundos
+ */
+static double dirLookups(string &path, u_int32_t blockSize, uint32_t files, double &warmUs, bool &ok)
+{
+    FileSystem::mkfs(path, files * 2 + 65536, blockSize).reset();
+    unique_ptr<FileSystem> fs = FileSystem::mount(path);
+    string dir = "d";
+    fs->createFile(dir, '2');
+    for (uint32_t i = 0; i < files; i++)
+    {
+        string name = "f" + to_string(i);
+        fs->createFile(name, '1', "/d");
+    }
+    fs.reset();
+
+    dropPageCache(path);
+    fs = FileSystem::mount(path);
+    vector<string> names(files);
+    for (uint32_t i = 0; i < files; i++)
+    {
+        names[i] = "f" + to_string((uint64_t)i * 7919 % files); // Ordem espalhada pelo diretório
+    }
+    vector<u_int32_t> indexBlocks(files);
+    double coldUs = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        double start = now();
+        for (uint32_t i = 0; i < files; i++)
+        {
+            u_int32_t indexBlock = fs->getFileBlockIndex(names[i]);
+            if (indexBlock == 0xFFFFFFFF || (pass == 1 && indexBlock != indexBlocks[i]))
+            {
+                ok = false;
+            }
+            indexBlocks[i] = indexBlock;
+        }
+        (pass == 0 ? coldUs : warmUs) = (now() - start) / files * 1e6;
+    }
+    return coldUs;
+}
+
+/**
+ * @brief Formata uma imagem de gib GiB e mede só o mkfs (criação da imagem, metadados e desmontagem)
+ *
+ * @param error Recebe a mensagem de erro se a formatação falhar (por exemplo, sem espaço para reservar a imagem)
+ * @return double Tempo de formatação em milissegundos
+ */
+static double formatTime(string &path, u_int32_t blockSize, uint32_t gib, ImageAllocation allocation, string &error)
+{
+    ::unlink(path.c_str());
+    double start = now();
+    try
+    {
+        FileSystem::mkfs(path, (uint64_t)gib << 30 >> __builtin_ctz(blockSize), blockSize, DiskBackend::PREAD, CACHE_CAPACITY,
+                         allocation)
+            .reset();
+    }
+    catch (const exception &e)
+    {
+        error = e.what();
+    }
+    double elapsed = now() - start;
+
+    // Sem espaço para a reserva, o mkfs só avisa e deixa a imagem esparsa
+    struct stat st;
+    if (error.empty() && allocation != ImageAllocation::SPARSE && ::stat(path.c_str(), &st) == 0 &&
+        (uint64_t)st.st_blocks * 512 < (uint64_t)st.st_size)
+    {
+        error = "a imagem ficou esparsa";
+    }
+    ::unlink(path.c_str());
+    return elapsed * 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "Uso: " << argv[0] << " <caminho_do_disco> [threads_max] [tamanho_do_bloco] [MiB_por_arquivo]" << endl;
+        return EXIT_FAILURE;
+    }
+    string diskPath = argv[1];
+    uint32_t maxThreads = argc > 2 ? stoul(argv[2]) : 8;
+    u_int32_t blockSize = argc > 3 ? stoul(argv[3]) : 4096;
+    uint32_t fileBytes = (argc > 4 ? stoul(argv[4]) : 16) << 20;
+    uint32_t chunk = 1 << 20;
+    uint32_t files = maxThreads;
+
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    setvbuf(report, nullptr, _IOLBF, 0);
+    if (freopen("/dev/null", "w", stdout) == nullptr)
+    {
+        cerr << "Erro ao redirecionar o stdout" << endl;
+    }
+
+    pattern.resize(chunk + 4096);
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        pattern[i] = (char)(i * 2654435761u >> 13);
+    }
+
+    bool ok = true;
+    try
+    {
+        uint64_t dataBlocks = (uint64_t)files * ((fileBytes + blockSize - 1) / blockSize);
+        u_int32_t numBlocks = dataBlocks + dataBlocks / 64 + (uint64_t)maxThreads * 256 + 65536 + 4096;
+        unique_ptr<FileSystem> fs = FileSystem::mkfs(diskPath, numBlocks, blockSize);
+        writeFiles(*fs, files, fileBytes, chunk);
+
+        fprintf(report, "Leitura paralela: %u arquivos de %u MiB, blocos de %u bytes\n", files, fileBytes >> 20, blockSize);
+        for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            double mbps = parallelRead(*fs, threads, files, fileBytes, chunk, ok);
+            fprintf(report, "  %2u threads: %8.1f MB/s\n", threads, mbps);
+        }
+
+        fs.reset();
+        uint32_t freeBefore = readSuperblock(diskPath).free_blocks;
+        fs = FileSystem::mount(diskPath);
+        string stressDir = "estresse";
+        fs->createFile(stressDir, '2');
+        vector<string> dirs = {"shared"};
+        for (uint32_t t = 0; t < maxThreads; t++)
+        {
+            dirs.push_back("t" + to_string(t));
+        }
+        for (string &dir : dirs)
+        {
+            fs->createFile(dir, '2', "/estresse");
+        }
+
+        fprintf(report, "Fila de E/S assíncrona: leituras aleatórias de %u bytes na imagem (cache de páginas descartada)\n", blockSize);
+        for (AsyncEngine engine : {AsyncEngine::IO_URING, AsyncEngine::THREAD_POOL})
+        {
+            for (uint32_t depth = 1; depth <= 64; depth *= 4)
+            {
+                AsyncEngine active = engine;
+                double iops = queueDepth(diskPath, active, depth, blockSize, numBlocks, 20000);
+                fprintf(report, "  %-11s profundidade %2u: %9.0f leituras/s %8.1f MB/s\n", active == AsyncEngine::IO_URING ? "io_uring" : "pool", depth, iops, iops * blockSize / 1e6);
+            }
+        }
+
+        // Antes do descritor único, cada bloco custava abrir, posicionar e fechar a imagem
+        fprintf(report, "Blocos isolados de %u bytes (um por chamada, escolhidos ao acaso, sem cache de blocos)\n", blockSize);
+        string blockPath = diskPath + ".blocks";
+        for (int method = 0; method < 3; method++)
+        {
+            double readRate;
+            double writeRate = blockRate(blockPath, blockSize, method == 2 ? DiskBackend::MMAP : DiskBackend::PREAD, method == 0,
+                                         16384, 20000, readRate, ok);
+            fprintf(report, "  %-25s: escrita %9.0f blocos/s, leitura %9.0f blocos/s\n",
+                    method == 0 ? "fstream por bloco (antes)" : (method == 1 ? "pread/pwrite" : "mmap"), writeRate, readRate);
+        }
+        ::unlink(blockPath.c_str());
+
+        fprintf(report, "Alocação de blocos (um por chamada, liberados ao fim)\n");
+        for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            double allocs = allocate(*fs, threads, 4096 / threads * 16, ok);
+            fprintf(report, "  %2u threads: %8.0f alocações/s\n", threads, allocs);
+        }
+
+        fprintf(report, "Enchimento de uma imagem de %u blocos (até o disco acabar)\n", 1u << 20);
+        string fillPath = diskPath + ".fill";
+        for (u_int32_t perCall : {1u, 64u})
+        {
+            uint32_t allocated;
+            double calls = fillImage(fillPath, blockSize, 1u << 20, perCall, allocated, ok);
+            fprintf(report, "  %2u blocos por chamada: %9.0f alocações/s %10.0f blocos/s (%u blocos alocados)\n", perCall, calls,
+                    calls * perCall, allocated);
+        }
+        ::unlink(fillPath.c_str());
+
+        fprintf(report, "Estresse de metadados (criar, escrever, fechar, renomear, abrir, ler, apagar)\n");
+        for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            double ops = stress(*fs, threads, 2000 / threads, ok);
+            fprintf(report, "  %2u threads: %8.0f ops/s\n", threads, ops);
+        }
+
+        // Todos os arquivos do estresse foram apagados: sem os diretórios, nenhum bloco pode ter vazado
+        for (string &dir : dirs)
+        {
+            string path = "/estresse/" + dir;
+            fs->deleteFile(path);
+        }
+        fs->deleteFile(stressDir);
+        fs.reset();
+        uint32_t freeAfter = readSuperblock(diskPath).free_blocks;
+        if (freeAfter != freeBefore)
+        {
+            fprintf(report, "Blocos livres antes %u, depois %u\n", freeBefore, freeAfter);
+            ok = false;
+        }
+        fs = FileSystem::mount(diskPath);
+        fs.reset();
+
+        // Imagens pequenas, uma com o diário (padrão) e outra sem: sem o diário, cada sync escreve os metadados
+        // no lugar e espera o próprio fdatasync
+        fprintf(report, "Metadados duráveis (criar + sync por operação, um diretório por thread)\n");
+        string durablePath = diskPath + ".meta";
+        for (u_int32_t journalBlocks : {JOURNAL_AUTO, 0u})
+        {
+            unique_ptr<FileSystem> durable = FileSystem::mkfs(durablePath, 65536 + maxThreads * 4096, blockSize, DiskBackend::PREAD,
+                                                              CACHE_CAPACITY, ImageAllocation::SPARSE, journalBlocks);
+            for (uint32_t threads = 1, round = 0; threads <= maxThreads; threads *= 2, round++)
+            {
+                JournalStats before = durable->journalStats();
+                uint32_t perThread = getMax<uint32_t>(1, 512 / threads);
+                double ops = durableCreate(*durable, threads, perThread, round, ok);
+                JournalStats after = durable->journalStats();
+                fprintf(report, "  %-11s %2u threads: %8.0f criações/s %6.2f commits/criação\n", journalBlocks == 0 ? "sem diário" : "diário", threads, ops,
+                        (double)(after.commits - before.commits) / (threads * perThread));
+            }
+        }
+        ::unlink(durablePath.c_str());
+
+        // O custo de resolver um bloco não depende do tamanho do arquivo: no máximo quatro blocos de índice
+        fprintf(report, "Leitura aleatória por tamanho de arquivo (um bloco por leitura, resolvido pelo índice em árvore)\n");
+        string indexPath = diskPath + ".index";
+        for (uint32_t mib = 1; mib <= 256; mib *= 4)
+        {
+            double openUs, p99Us;
+            double readUs = indexedRead(indexPath, blockSize, mib << 20, chunk, 2000, openUs, p99Us, ok);
+            fprintf(report, "  %3u MiB: abertura %9.1f us, leitura %7.1f us/bloco (p99 %7.1f us)\n", mib, openUs, readUs, p99Us);
+        }
+        ::unlink(indexPath.c_str());
+
+        // Um arquivo escrito em sequência vira poucas extensões: os metadados não crescem com o tamanho do arquivo
+        fprintf(report, "Mapeamento por extensões vs índice em árvore (escrita sequencial, leitura com a cache de páginas descartada)\n");
+        string mappedPath = diskPath + ".map";
+        for (uint32_t mib = 16; mib <= 256; mib *= 4)
+        {
+            for (char fileType : {'1', '3'})
+            {
+                uint32_t metadataBlocks;
+                double readMBps;
+                double writeMBps = mappedStream(mappedPath, blockSize, fileType, mib << 20, chunk, metadataBlocks, readMBps, ok);
+                fprintf(report, "  %3u MiB %-9s: %6u blocos de metadados, escrita %8.1f MB/s, leitura %8.1f MB/s\n", mib,
+                        fileType == '1' ? "árvore" : "extensões", metadataBlocks, writeMBps, readMBps);
+            }
+        }
+        ::unlink(mappedPath.c_str());
+
+        // Até INLINE_BYTES, os dados ficam no bloco de índice: um bloco a menos por arquivo e uma leitura por arquivo
+        fprintf(report, "Criação de 100000 arquivos pequenos em 100 diretórios (leitura fria sem descritor)\n");
+        string smallPath = diskPath + ".small";
+        for (uint32_t fileBytes : {200u, blockSize})
+        {
+            double blocksPerFile, readUs;
+            double creates = smallFiles(smallPath, blockSize, fileBytes, 100000, 100, blocksPerFile, readUs, ok);
+            fprintf(report, "  %5u bytes (%s): %8.0f criações/s, %4.2f blocos/arquivo, leitura %7.1f us/arquivo\n", fileBytes,
+                    fileBytes <= blockSize - 4 ? "no bloco de índice" : "bloco de dados", creates, blocksPerFile, readUs);
+        }
+        ::unlink(smallPath.c_str());
+
+        // A partir de DIR_HASH_THRESHOLD entradas, o diretório passa ao índice por hash: a abertura fria lê um nó por
+        // nível e uma folha, em vez de carregar todas as entradas do diretório
+        fprintf(report, "Diretório único com muitos arquivos (abertura fria pelo caminho)\n");
+        string dirPath = diskPath + ".dir";
+        for (uint32_t files = 100; files <= 100000; files *= 10)
+        {
+            double firstUs = 0, lookupUs = 0;
+            double creates = largeDirectory(dirPath, blockSize, files, firstUs, lookupUs, ok);
+            fprintf(report, "  %6u arquivos (%s): %8.0f criações/s, primeira abertura %9.1f us, seguintes %7.1f us\n", files,
+                    files < DIR_HASH_THRESHOLD ? "lista" : "hash", creates, firstUs, lookupUs);
+        }
+        ::unlink(dirPath.c_str());
+
+        // Sem a cache de dentries, cada consulta pelo nome desce do índice do diretório até a folha do nome
+        fprintf(report, "Consulta pelo nome em diretórios grandes (índice do diretório, todos os nomes em ordem espalhada)\n");
+        string lookupPath = diskPath + ".lookup";
+        for (uint32_t files = 10000; files <= 100000; files *= 10)
+        {
+            double warmUs = 0;
+            double coldUs = dirLookups(lookupPath, blockSize, files, warmUs, ok);
+            fprintf(report, "  %6u arquivos: primeira passada %7.2f us/consulta, segunda %7.2f us/consulta\n", files, coldUs, warmUs);
+        }
+        ::unlink(lookupPath.c_str());
+
+        // Só a imagem esparsa independe do tamanho; a reserva e a zeragem precisam de espaço livre no armazenamento
+        fprintf(report, "Formatação (mkfs)\n");
+        string formatPath = diskPath + ".mkfs";
+        for (uint32_t gib : {1u, 100u})
+        {
+            for (ImageAllocation allocation : {ImageAllocation::SPARSE, ImageAllocation::PREALLOCATE, ImageAllocation::ZERO})
+            {
+                string error;
+                double ms = formatTime(formatPath, blockSize, gib, allocation, error);
+                const char *name = allocation == ImageAllocation::SPARSE        ? "esparsa"
+                                   : allocation == ImageAllocation::PREALLOCATE ? "reservada"
+                                                                                : "zerada";
+                if (error.empty())
+                {
+                    fprintf(report, "  %3u GiB %-9s: %10.1f ms\n", gib, name, ms);
+                }
+                else
+                {
+                    fprintf(report, "  %3u GiB %-9s: falhou (%s)\n", gib, name, error.c_str());
+                }
+            }
+        }
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << endl;
+        ok = false;
+    }
+
+    fprintf(report, "%s\n", ok ? "Resultado: OK" : "Resultado: FALHA");
+    return ok ? 0 : EXIT_FAILURE;
+}
+
+/*
+    Compilar: g++ -o benchmark benchmark.cpp -std=c++17 -O2 -pthread
+    Executar: ./benchmark <caminho_do_disco> [threads_max] [tamanho_do_bloco] [MiB_por_arquivo]
+*/
@@ -4,9 +4,15 @@
 #include <string>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 #include <cstdint>
+#include <type_traits>
+#include <array>
+#include <cstddef>
 
-#define BLOCK_SIZE 512 //Tamanho do bloco em bytes
+#define MIN_BLOCK_SIZE 512 //Menor tamanho de bloco suportado em bytes
+#define MAX_BLOCK_SIZE 65536 //Maior tamanho de bloco suportado em bytes
+#define DEFAULT_BLOCK_SIZE 512 //Tamanho de bloco padrão em bytes
 
 using namespace std;
 
@@ -19,6 +25,12 @@ using namespace std;
 #define FREE_BLOCKS 4
 #define SUPERBLOCK_NUMBER 4
 #define VERSION 4
+#define MAGIC_SIZE 4
+#define CHECKSUM_SIZE 4
+
+#define FS_MAGIC 0x534F4653 //Identifica o sistema de arquivos ("SOFS")
+#define FS_VERSION 4 //Versão atual do formato do disco (3: diário de metadados, 4: índice de arquivos em árvore)
+#define FS_MIN_VERSION 2 //Versão mais antiga que ainda pode ser montada (2: sem diário)
 
 
 #define ENTRY_SIZE 64 //Tamanhos do arquivos (64 bytes)
@@ -45,29 +57,155 @@ struct Superblock{
     uint32_t block_size; //log2(tamanho do bloco) - log2(512).
     uint32_t superblock_number; //Numero do bloco que contem o superbloco
     uint32_t version; //Versão do sistema de arquivos
+    uint32_t magic; //Identificador do sistema de arquivos (FS_MAGIC).
+    uint32_t checksum; //CRC-32 do superbloco, calculado com este campo zerado.
+    uint32_t journal_start; //Primeiro bloco do diário de metadados (versão 3).
+    uint32_t journal_blocks; //Blocos do diário de metadados (0 = sem diário).
 
     Superblock(): total_blocks(0), bitmap_start(1), bitmap_blocks(0), root_dir_index(0),
-    free_blocks(0), block_size(BLOCK_SIZE), superblock_number(0), version(1) {}
+    free_blocks(0), block_size(0), superblock_number(0), version(FS_VERSION), magic(FS_MAGIC), checksum(0),
+    journal_start(0), journal_blocks(0) {}
 
 };
 
 // Entrada do diretório raiz
 struct RootDirEntry{
     char filename[FILENAME_SIZE]; //Nome do arquivo/diretório.
-    char  file_type; //Tipo de arquivo (0 para desconhecido e 1 para arquivo e 2 diretório).
+    char  file_type; //Tipo de arquivo (0 para desconhecido, 1 para arquivo, 2 diretório e 3 arquivo mapeado por extensões).
     uint32_t index_block; //Número do bloco de índice associado ao arquivo/diretório.
     uint32_t file_size; //Tamanho do arquivo em bytes.
 
     RootDirEntry(): file_type(0), index_block(0xFFFFFFFF), file_size(0) {
         memset(filename, 0, FILENAME_SIZE);
     }
+
+    //Nome lido do disco, limitado ao campo (uma entrada corrompida pode não ter o \0)
+    string name() const { return string(filename, strnlen(filename, FILENAME_SIZE)); }
+    //O nome termina dentro do campo (as entradas sem o \0 não são carregadas e o fsck as remove)
+    bool nameTerminated() const { return memchr(filename, '\0', FILENAME_SIZE) != nullptr; }
 };
 
-struct IndexBlock {
-    vector<uint32_t> block_ptrs;
-    uint32_t indirect_ptr;
+#define INDEX_TREE 0xFFFFFFFE //indirect_ptr do bloco de índice raiz de um arquivo com índice em árvore (versão 4)
+#define INDEX_EXTENTS 0xFFFFFFFD //indirect_ptr dos blocos de extensões de um arquivo mapeado por extensões (versão 4)
+#define INDEX_INLINE 0xFFFFFFFC //indirect_ptr do bloco de índice de um arquivo pequeno com os dados no próprio bloco (versão 4)
+#define INDEX_HASHED 0xFFFFFFFB //indirect_ptr dos nós do índice por hash de um subdiretório grande (versão 4)
+
+// Bloco de índice com o layout exato do disco: pode ser lido no lugar a partir da cache ou da imagem mapeada.
+// Em uma cadeia (diretórios e arquivos de versões anteriores), indirect_ptr aponta para o próximo bloco de índice.
+// Em uma árvore (arquivos a partir da versão 4), o bloco raiz tem TREE_DIRECT ponteiros diretos seguidos dos
+// ponteiros para os blocos indiretos simples, duplo e triplo, e indirect_ptr = INDEX_TREE; cada bloco indireto
+// usa todas as suas WORDS palavras como ponteiros (para blocos de dados ou para blocos indiretos do nível abaixo).
+// Em um bloco de extensões (file_type 3), os ponteiros formam EXTENTS pares (primeiro bloco, número de blocos),
+// block_ptrs[EXTENT_NEXT] aponta para o próximo bloco de extensões e indirect_ptr = INDEX_EXTENTS.
+// Um arquivo de até INLINE_BYTES bytes guarda os dados no lugar dos ponteiros, com indirect_ptr = INDEX_INLINE.
+// Em um nó do índice por hash de um diretório, block_ptrs[0] é o nível do nó (0: aponta para blocos de entradas),
+// block_ptrs[1] o número de pares e, a partir de block_ptrs[2], até HASH_PAIRS pares (menor hash, bloco) em ordem
+// crescente de hash; indirect_ptr = INDEX_HASHED.
+template <uint32_t BLOCK_SIZE>
+struct IndexBlockLayout {
+    static constexpr uint32_t PTRS = BLOCK_SIZE / sizeof(uint32_t) - 1; //Ponteiros diretos em um bloco de índice
+    static constexpr uint32_t WORDS = PTRS + 1; //Ponteiros em um bloco indireto da árvore
+    static constexpr uint32_t TREE_DIRECT = PTRS - 3; //Ponteiros diretos no bloco raiz da árvore
+    static constexpr uint32_t EXTENTS = (PTRS - 1) / 2; //Extensões em um bloco de extensões
+    static constexpr uint32_t EXTENT_NEXT = PTRS - 1; //Ponteiro para o próximo bloco de extensões
+    static constexpr uint32_t INLINE_BYTES = PTRS * sizeof(uint32_t); //Dados de um arquivo guardados no bloco de índice
+    static constexpr uint32_t HASH_PAIRS = (PTRS - 2) / 2; //Pares (hash, bloco) em um nó do índice de um diretório
 
-    IndexBlock() : indirect_ptr(0xFFFFFFFF) {
-        block_ptrs.resize((BLOCK_SIZE / sizeof(uint32_t)) - 1, 0xFFFFFFFF);
+    uint32_t block_ptrs[PTRS]; //Ponteiros para os blocos de dados (0xFFFFFFFF = livre).
+    uint32_t indirect_ptr; //Ponteiro para o próximo bloco de índice.
+
+    IndexBlockLayout() : indirect_ptr(0xFFFFFFFF) {
+        fill(block_ptrs, block_ptrs + PTRS, 0xFFFFFFFF);
     }
-};
\ No newline at end of file
+
+    //Palavra i do bloco (i == PTRS é o indirect_ptr)
+    uint32_t &word(uint32_t i) { return i < PTRS ? block_ptrs[i] : indirect_ptr; }
+    uint32_t word(uint32_t i) const { return i < PTRS ? block_ptrs[i] : indirect_ptr; }
+
+    //Dados de um arquivo com indirect_ptr = INDEX_INLINE
+    char *inlineData() { return reinterpret_cast<char *>(block_ptrs); }
+    const char *inlineData() const { return reinterpret_cast<const char *>(block_ptrs); }
+};
+
+// Registro do diário de metadados: início de um bloco do diário. O primeiro bloco do diário é o cabeçalho;
+// cada transação é uma sequência de descritores (seguidos dos blocos que descrevem), revogações e um commit.
+#define JOURNAL_MAGIC 0x4C4E524A //Identifica os blocos de controle do diário ("JRNL")
+#define JOURNAL_HEADER 1 //Cabeçalho: sequence é a próxima transação esperada, count o tamanho do diário
+#define JOURNAL_DESCRIPTOR 2 //count blocos de destino (após o registro), cujas cópias vêm logo em seguida
+#define JOURNAL_REVOKE 3 //count blocos liberados: cópias deles em transações anteriores não são reaplicadas
+#define JOURNAL_COMMIT 4 //Fim da transação: count blocos anteriores, checksum = CRC-32 do conteúdo deles
+
+struct JournalRecord{
+    uint32_t magic; //JOURNAL_MAGIC.
+    uint32_t type; //JOURNAL_HEADER, JOURNAL_DESCRIPTOR, JOURNAL_REVOKE ou JOURNAL_COMMIT.
+    uint32_t sequence; //Número da transação.
+    uint32_t count; //Depende do tipo.
+    uint32_t checksum; //Cabeçalho: CRC-32 do registro; commit: CRC-32 dos blocos da transação.
+
+    JournalRecord(uint32_t recordType = 0, uint32_t seq = 0, uint32_t n = 0)
+        : magic(JOURNAL_MAGIC), type(recordType), sequence(seq), count(n), checksum(0) {}
+};
+
+// Arquivo regular (com índice em cadeia ou em árvore, ou mapeado por extensões)
+inline bool isRegularFile(char fileType)
+{
+    return fileType == '1' || fileType == '3';
+}
+
+// Nome do tipo de arquivo para as listagens
+inline const char *fileTypeName(char fileType)
+{
+    return fileType == '1' ? "Arquivo" : (fileType == '3' ? "Arquivo (extensões)" : (fileType == '2' ? "Diretório" : "Tipo Desconhecido"));
+}
+
+static_assert(sizeof(Superblock) == 48, "Layout do superbloco alterado");
+static_assert(sizeof(JournalRecord) == 20, "Layout do registro do diário alterado");
+static_assert(sizeof(RootDirEntry) == ENTRY_SIZE, "Entrada de diretório deve ter ENTRY_SIZE bytes");
+static_assert(is_trivially_copyable<Superblock>::value && is_trivially_copyable<RootDirEntry>::value,
+              "Estruturas do disco devem ser copiáveis byte a byte");
+
+// CRC-32 (polinômio 0xEDB88320), usado para validar estruturas gravadas no disco.
+// Processa 8 bytes por iteração (slicing-by-8): o diário calcula o CRC de cada transação inteira.
+inline uint32_t crc32(const void *data, size_t size, uint32_t crc = 0)
+{
+    static const array<array<uint32_t, 256>, 8> table = [] {
+        array<array<uint32_t, 256>, 8> t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                t[k][i] = t[0][t[k - 1][i] & 0xFF] ^ (t[k - 1][i] >> 8);
+            }
+        }
+        return t;
+    }();
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (; size >= 8; size -= 8, bytes += 8) {
+        uint32_t low = crc ^ (bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24);
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][bytes[4]] ^ table[2][bytes[5]] ^ table[1][bytes[6]] ^ table[0][bytes[7]];
+    }
+    for (size_t i = 0; i < size; i++) {
+        crc = table[0][(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Checksum do superbloco (o próprio campo checksum é considerado zero; a versão 2 não tem os campos do diário)
+inline uint32_t superblockChecksum(Superblock sb)
+{
+    sb.checksum = 0;
+    return crc32(&sb, sb.version >= 3 ? sizeof(Superblock) : offsetof(Superblock, journal_start));
+}
+
+// Hash de um nome no índice por hash dos diretórios
+inline uint32_t nameHash(const string &name)
+{
+    return crc32(name.data(), name.size());
+}
@@ -7,7 +7,7 @@ void displayMenu() {
     cout << "===== Sistema de Arquivos =====" << endl;
     cout << "1. Criar Arquivo" << endl;
     cout << "2. Ler Arquivo" << endl;
-    cout << "3. Escrever em Arquivo - Não funciona" << endl; 
+    cout << "3. Escrever em Arquivo" << endl;
     cout << "4. Deletar Arquivo" << endl;
     cout << "5. Listar Arquivos" << endl;
     cout << "6. Listar Blocos Livres" << endl;
@@ -21,21 +21,36 @@ void displayMenu() {
 
 int main(int argc, char *argv[]) {
     if (argc < 3) {
-        cerr << "Uso: " << argv[0] << " <caminho_do_disco> <numero_de_blocos>" << endl;
+        cerr << "Uso: " << argv[0] << " <caminho_do_disco> <numero_de_blocos> [pread|mmap] [tamanho_do_bloco] [sparse|prealloc|zero]  (formata o disco)" << endl;
+        cerr << "     " << argv[0] << " <caminho_do_disco> mount [pread|mmap]  (monta um disco já formatado)" << endl;
         return EXIT_FAILURE;
     }
 
     string diskPath = argv[1]; // Obtém o caminho do disco do primeiro argumento
     string numBlocks = argv[2];
+    // Forma de acesso ao disco (opcional, pread por padrão)
+    DiskBackend backend = (argc > 3 && string(argv[3]) == "mmap") ? DiskBackend::MMAP : DiskBackend::PREAD;
+    // Tamanho do bloco em bytes (opcional, de 512 a 65536)
+    u_int32_t blockSize = argc > 4 ? stoul(argv[4]) : DEFAULT_BLOCK_SIZE;
+    // Alocação da imagem na formatação (opcional, esparsa por padrão)
+    string allocationArg = argc > 5 ? argv[5] : "sparse";
+    ImageAllocation allocation = allocationArg == "prealloc" ? ImageAllocation::PREALLOCATE : (allocationArg == "zero" ? ImageAllocation::ZERO : ImageAllocation::SPARSE);
 
 
-    FileSystem fs(diskPath, stoi(numBlocks));
+    unique_ptr<FileSystem> fs;
+    try {
+        fs = numBlocks == "mount" ? FileSystem::mount(diskPath, backend) : FileSystem::mkfs(diskPath, stoi(numBlocks), blockSize, backend, CACHE_CAPACITY, allocation);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
 
     string choice;
     string filename;
+    string parentDir;
     char filetype;
     uint32_t index_block;
-    char data[BLOCK_SIZE];
+    vector<char> data(fs->blockSize());
     uint32_t size;
 
     do {
@@ -47,16 +62,18 @@ int main(int argc, char *argv[]) {
             case 1: {
                 cout << "Digite o nome do arquivo: ";
                 getline(cin, filename);
-                cout << "Digite o tipo do arquivo (1 para arquivo, 2 para diretório): ";
+                cout << "Digite o tipo do arquivo (1 para arquivo, 2 para diretório, 3 para arquivo mapeado por extensões): ";
                 cin >> filetype;
                 cin.ignore();
-                fs.createFile(filename, filetype);
+                cout << "Digite o diretório pai (./ para a raiz, ex: /a/b): ";
+                getline(cin, parentDir);
+                fs->createFile(filename, filetype, parentDir.empty() ? "./" : parentDir);
                 break;
             }
             case 2: {
                 cout << "Digite o nome do arquivo: ";
                 getline(cin, filename);
-                fs.readFile(filename, &filetype, &index_block);
+                fs->readFile(filename, &filetype, &index_block);
                 cout << "Tipo do arquivo: " << filetype << ", Bloco de índice: " << index_block << endl;
                 break;
             }
@@ -64,37 +81,38 @@ int main(int argc, char *argv[]) {
                 cout << "Digite o nome do arquivo: ";
                 getline(cin, filename);
                 cout << "Digite os dados a serem escritos: ";
-                cin.getline(data, BLOCK_SIZE);
+                cin.getline(data.data(), data.size());
                 cout << "Digite o tamanho dos dados: ";
                 cin >> size;
                 cin.ignore();
-                fs.writeFile(filename, data, size);
+                size = min<uint32_t>(size, data.size()); // O buffer tem um bloco
+                fs->writeFile(filename, data.data(), size);
                 break;
             }
             case 4: {
                 cout << "Digite o nome do arquivo: ";
                 getline(cin, filename);
-                fs.deleteFile(filename);
+                fs->deleteFile(filename);
                 break;
             }
             case 5: {
-                fs.listFilesRecursively();
+                fs->listFilesRecursively();
                 break;
             }
             case 6: {
-                fs.listFreeBlocks();
+                fs->listFreeBlocks();
                 break;
             }
             case 7: {
-                fs.listSuperblock();
+                fs->listSuperblock();
                 break;
             }
             case 8: {
-                fs.listBitmap();
+                fs->listBitmap();
                 break;
             }
             case 9: {
-                fs.listDiskHex();
+                fs->listDiskHex();
                 break;
             }
             case 10: {
@@ -113,6 +131,7 @@ int main(int argc, char *argv[]) {
 }
 
 /*
-    Compilar: g++ -o nome_arq main.cpp -std=c++17
-    Executar: ./nome_arq <caminho_do_disco> <numero_de_blocos>
+    Compilar: g++ -o nome_arq main.cpp -std=c++17 -pthread
+    Formatar: ./nome_arq <caminho_do_disco> <numero_de_blocos> [pread|mmap] [tamanho_do_bloco] [sparse|prealloc|zero]
+    Montar:   ./nome_arq <caminho_do_disco> mount [pread|mmap]
 */
\ No newline at end of file
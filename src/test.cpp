@@ -0,0 +1,283 @@
+// Teste dos dois backends de disco (pread/pwrite com cache de blocos e mmap): cria arquivos e diretórios, escreve e lê
+// o conteúdo, lista a árvore, apaga, monta a imagem de novo e confere que nenhum bloco vazou, inclusive depois de uma
+// escrita que fica sem espaço no meio
+#include "FileSystem.h"
+
+using namespace std;
+
+static FILE *report = stdout; // Relatório (as operações do sistema de arquivos escrevem mensagens no stdout)
+static uint32_t failures = 0;
+
+static void check(bool condition, const string &what)
+{
+    if (!condition)
+    {
+        fprintf(report, "    FALHA: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+/**
+ * @brief Conteúdo de referência do arquivo de número file
+ *
+ */
+static vector<char> contents(uint32_t file, uint32_t size)
+{
+    vector<char> data(size);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        data[i] = (char)((i + file * 31) * 2654435761u >> 11);
+    }
+    return data;
+}
+
+/**
+ * @brief Escreve o arquivo inteiro (em dois pedaços, o segundo antes do primeiro)
+ *
+ */
+static void writeContents(FileSystem &fs, const string &path, const vector<char> &data)
+{
+    u_int32_t handle = fs.openFile(path);
+    check(handle != 0xFFFFFFFF, "abrir " + path);
+    if (handle == 0xFFFFFFFF)
+    {
+        return;
+    }
+    uint32_t half = data.size() / 2;
+    check(fs.writeFile(handle, half, data.data() + half, data.size() - half) == data.size() - half, "escrever " + path);
+    check(fs.writeFile(handle, 0, data.data(), half) == half, "escrever " + path);
+    fs.closeFile(handle);
+}
+
+/**
+ * @brief Lê o arquivo inteiro e compara com o conteúdo esperado
+ *
+ */
+static void checkContents(FileSystem &fs, const string &path, const vector<char> &data)
+{
+    u_int32_t handle = fs.openFile(path);
+    check(handle != 0xFFFFFFFF, "abrir " + path);
+    if (handle == 0xFFFFFFFF)
+    {
+        return;
+    }
+    vector<char> buffer(data.size() + 16);
+    uint32_t n = fs.readFileAt(handle, 0, buffer.data(), buffer.size());
+    fs.closeFile(handle);
+    check(n == data.size() && memcmp(buffer.data(), data.data(), n) == 0, "conteúdo de " + path);
+}
+
+/**
+ * @brief Caminhos mostrados por listFilesRecursively, em ordem
+ *
+ */
+static vector<string> listPaths(FileSystem &fs, const string &scratch)
+{
+    fflush(stdout);
+    if (freopen(scratch.c_str(), "w", stdout) == nullptr)
+    {
+        throw runtime_error("Erro ao redirecionar o stdout");
+    }
+    fs.listFilesRecursively();
+    cout.flush();
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == nullptr)
+    {
+        throw runtime_error("Erro ao redirecionar o stdout");
+    }
+
+    vector<string> paths;
+    ifstream listing(scratch);
+    string line;
+    const string prefix = "Filename: ";
+    while (getline(listing, line))
+    {
+        if (line.compare(0, prefix.size(), prefix) == 0)
+        {
+            paths.push_back(line.substr(prefix.size(), line.find(',') - prefix.size()));
+        }
+    }
+    ::unlink(scratch.c_str());
+    return paths;
+}
+
+/**
+ * @brief Criação, leitura, listagem e remoção com um backend, antes e depois de montar a imagem de novo
+ *
+ */
+static void testBackend(string &path, DiskBackend backend, u_int32_t blockSize)
+{
+    const string scratch = path + ".list";
+    const vector<uint32_t> sizes = {0, 10, blockSize - 4, blockSize + 1, 3 * blockSize + 100, 64 * blockSize};
+    uint32_t freeBefore;
+    {
+        unique_ptr<FileSystem> fs = FileSystem::mkfs(path, 8192, blockSize, backend);
+        freeBefore = fs->fsck(1, false).freeBlocksActual;
+
+        string docs = "docs", deep = "deep";
+        fs->createFile(docs, '2');
+        fs->createFile(deep, '2', "/docs");
+        for (uint32_t i = 0; i < sizes.size(); i++)
+        {
+            string name = "f" + to_string(i);
+            fs->createFile(name, i % 2 == 0 ? '1' : '3', i < 2 ? "/docs" : "/docs/deep");
+        }
+        string top = "top";
+        fs->createFile(top, '1');
+        for (uint32_t i = 0; i < sizes.size(); i++)
+        {
+            string file = (i < 2 ? "/docs/f" : "/docs/deep/f") + to_string(i);
+            writeContents(*fs, file, contents(i, sizes[i]));
+            checkContents(*fs, file, contents(i, sizes[i]));
+        }
+        writeContents(*fs, "/top", contents(99, 1000));
+
+        char type;
+        u_int32_t indexBlock;
+        string file = "/docs/f1";
+        fs->readFile(file, &type, &indexBlock);
+        check(type == '3', "tipo de /docs/f1");
+
+        vector<string> expected = {"/docs", "/docs/deep"};
+        for (uint32_t i = 2; i < sizes.size(); i++)
+        {
+            expected.push_back("/docs/deep/f" + to_string(i));
+        }
+        expected.insert(expected.end(), {"/docs/f0", "/docs/f1", "/top"});
+        check(listPaths(*fs, scratch) == expected, "listagem depois da criação");
+
+        string removed = "/docs/f0";
+        fs->deleteFile(removed);
+        check(fs->openFile(removed) == 0xFFFFFFFF, "abrir um arquivo apagado");
+        expected.erase(find(expected.begin(), expected.end(), removed));
+        check(listPaths(*fs, scratch) == expected, "listagem depois da remoção");
+        check(fs->fsck(1, false).clean, "fsck antes da desmontagem");
+    }
+
+    unique_ptr<FileSystem> fs = FileSystem::mount(path, backend);
+    for (uint32_t i = 1; i < sizes.size(); i++)
+    {
+        checkContents(*fs, (i < 2 ? "/docs/f" : "/docs/deep/f") + to_string(i), contents(i, sizes[i]));
+    }
+    checkContents(*fs, "/top", contents(99, 1000));
+
+    // Um diretório com arquivos não é apagado; depois de esvaziado, sim
+    string docs = "/docs";
+    fs->deleteFile(docs);
+    checkContents(*fs, "/docs/f1", contents(1, sizes[1]));
+    for (uint32_t i = 1; i < sizes.size(); i++)
+    {
+        string file = (i < 2 ? "/docs/f" : "/docs/deep/f") + to_string(i);
+        fs->deleteFile(file);
+    }
+    for (string dir : {"/docs/deep", "/docs", "/top"})
+    {
+        fs->deleteFile(dir);
+    }
+    check(listPaths(*fs, scratch).empty(), "listagem do disco vazio");
+    FsckReport fsck = fs->fsck(1, false);
+    check(fsck.clean, "fsck depois da remoção");
+    check(fsck.freeBlocksActual == freeBefore, "blocos livres depois da remoção (" + to_string(fsck.freeBlocksActual) +
+                                                   " de " + to_string(freeBefore) + ")");
+}
+
+/**
+ * @brief Escrita que fica sem espaço no meio, num arquivo pequeno que precisa passar os dados para um bloco próprio:
+ * a operação é desfeita e o arquivo aberto volta ao índice anterior, então o fechamento não grava ponteiros para os
+ * blocos que voltaram a ficar livres
+ *
+ */
+static void testFullDisk(string &path, DiskBackend backend)
+{
+    unique_ptr<FileSystem> fs = FileSystem::mkfs(path, 2048, 512, backend);
+    string small = "a", large = "b";
+    fs->createFile(small, '1');
+    fs->createFile(large, '1');
+    writeContents(*fs, "/a", contents(1, 5));
+    vector<char> data = contents(2, (fs->fsck(1, false).freeBlocksActual - 100) * 512);
+    u_int32_t handle = fs->openFile(large);
+    check(handle != 0xFFFFFFFF && fs->writeFile(handle, 0, data.data(), data.size()) == data.size(), "escrever /b");
+    fs->closeFile(handle);
+    uint32_t freeBefore = fs->fsck(1, false).freeBlocksActual;
+
+    handle = fs->openFile(small);
+    check(handle != 0xFFFFFFFF, "abrir /a");
+    if (handle == 0xFFFFFFFF)
+    {
+        return;
+    }
+    data = contents(3, 400 * 512);
+    bool full = false;
+    try
+    {
+        full = fs->writeFile(handle, 0, data.data(), data.size()) < data.size();
+    }
+    catch (const exception &)
+    {
+        full = true;
+    }
+    check(full, "escrita maior que o espaço livre");
+    fs->closeFile(handle);
+    fs->sync();
+
+    FsckReport fsck = fs->fsck(1, false);
+    check(fsck.clean, "fsck depois da escrita sem espaço" + (fsck.messages.empty() ? "" : ": " + fsck.messages[0]));
+    if (backend == DiskBackend::PREAD)
+    {
+        // Com o diário (só no modo pread), a escrita é desfeita por inteiro; sem ele, o bloco de dados de /a fica
+        check(fsck.freeBlocksActual == freeBefore, "blocos livres depois da escrita sem espaço (" +
+                                                       to_string(fsck.freeBlocksActual) + " de " + to_string(freeBefore) + ")");
+    }
+    checkContents(*fs, "/a", contents(1, 5));
+}
+
+int main(int argc, char *argv[])
+{
+    string path = argc > 1 ? argv[1] : "test.img";
+
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    setvbuf(report, nullptr, _IOLBF, 0);
+    if (freopen("/dev/null", "w", stdout) == nullptr)
+    {
+        cerr << "Erro ao redirecionar o stdout" << endl;
+    }
+
+    for (DiskBackend backend : {DiskBackend::PREAD, DiskBackend::MMAP})
+    {
+        for (u_int32_t blockSize : {512u, 4096u})
+        {
+            uint32_t before = failures;
+            fprintf(report, "%s, blocos de %u bytes\n", backend == DiskBackend::PREAD ? "pread" : "mmap", blockSize);
+            try
+            {
+                testBackend(path, backend, blockSize);
+            }
+            catch (const exception &e)
+            {
+                check(false, e.what());
+            }
+            fprintf(report, "  %s\n", failures == before ? "OK" : "FALHA");
+        }
+
+        uint32_t before = failures;
+        fprintf(report, "%s, disco cheio no meio de uma escrita\n", backend == DiskBackend::PREAD ? "pread" : "mmap");
+        try
+        {
+            testFullDisk(path, backend);
+        }
+        catch (const exception &e)
+        {
+            check(false, e.what());
+        }
+        fprintf(report, "  %s\n", failures == before ? "OK" : "FALHA");
+    }
+    ::unlink(path.c_str());
+
+    fprintf(report, "%s\n", failures == 0 ? "Resultado: OK" : "Resultado: FALHA");
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
+
+/*
+    Compilar: g++ -o test test.cpp -std=c++17 -O2 -pthread
+    Executar: ./test [caminho_do_disco]
+*/
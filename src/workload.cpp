@@ -0,0 +1,259 @@
+// Carga mista com a API de corrotinas: vários clientes (corrotinas) em poucas threads criam, escrevem, leem e
+// apagam arquivos; relata a vazão e a latência de cada tipo de operação para cada número de operações em andamento
+#include <chrono>
+#include <random>
+#include "AsyncFileSystem.h"
+
+using namespace std;
+
+static FILE *report = stdout; // Relatório (as operações do sistema de arquivos escrevem mensagens no stdout)
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Tipos de operação da carga
+enum Operation
+{
+    READ,   // Leitura de um trecho aleatório de um arquivo pré-existente
+    CREATE, // Criação, escrita e fechamento de um arquivo novo do cliente
+    WRITE,  // Reescrita de um trecho de um arquivo pré-existente
+    DELETE, // Remoção de um arquivo criado pelo cliente
+    OPERATIONS
+};
+
+static const char *operationNames[OPERATIONS] = {"leitura", "criação", "escrita", "remoção"};
+
+// Latências de uma rodada, por tipo de operação (cada cliente escreve no próprio vetor)
+struct Latencies
+{
+    vector<double> samples[OPERATIONS];
+};
+
+struct Workload
+{
+    AsyncFileSystem &afs;
+    vector<u_int32_t> handles; // Arquivos pré-existentes, abertos durante toda a carga
+    uint32_t fileBytes;
+    uint32_t ioBytes;
+    atomic<bool> valid{true};
+};
+
+// Conteúdo esperado do byte pos de um arquivo pré-existente (as escritas da carga regravam o mesmo padrão)
+static char expected(uint32_t file, uint64_t pos)
+{
+    return (char)((pos * 2654435761u >> 11) + file * 131);
+}
+
+static void fillExpected(uint32_t file, uint64_t pos, char *data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        data[i] = expected(file, pos + i);
+    }
+}
+
+/**
+ * @brief Um cliente: executa operations operações sorteadas (60% leituras, 15% criações, 15% escritas, 10% remoções)
+ *
+ */
+static Task<void> client(Workload &load, uint32_t id, uint32_t operations, Latencies &latencies)
+{
+    mt19937 rng(id * 7919 + 1);
+    vector<char> buffer(load.ioBytes);
+    vector<char> check(load.ioBytes);
+    vector<string> created;
+    uint32_t serial = 0;
+    for (uint32_t i = 0; i < operations; i++)
+    {
+        uint32_t draw = rng() % 100;
+        Operation op = draw < 60 ? READ : (draw < 75 ? CREATE : (draw < 90 ? WRITE : DELETE));
+        if (op == DELETE && created.empty())
+        {
+            op = CREATE;
+        }
+        uint32_t file = rng() % load.handles.size();
+        uint32_t offset = rng() % (load.fileBytes - load.ioBytes + 1);
+        double start = now();
+        switch (op)
+        {
+        case READ:
+        {
+            uint32_t n = co_await load.afs.readFile(load.handles[file], offset, buffer.data(), load.ioBytes);
+            fillExpected(file, offset, check.data(), load.ioBytes);
+            if (n != load.ioBytes || memcmp(buffer.data(), check.data(), n) != 0)
+            {
+                load.valid = false;
+            }
+            break;
+        }
+        case CREATE:
+        {
+            string name = "c" + to_string(id) + "_" + to_string(serial++);
+            co_await load.afs.createFile(name, '1', "/carga");
+            u_int32_t handle = co_await load.afs.openFile("/carga/" + name);
+            co_await load.afs.writeFile(handle, 0, buffer.data(), load.ioBytes);
+            co_await load.afs.closeFile(handle);
+            created.push_back("/carga/" + name);
+            break;
+        }
+        case WRITE:
+        {
+            fillExpected(file, offset, buffer.data(), load.ioBytes);
+            co_await load.afs.writeFile(load.handles[file], offset, buffer.data(), load.ioBytes);
+            break;
+        }
+        default:
+        {
+            co_await load.afs.deleteFile(created.back());
+            created.pop_back();
+            break;
+        }
+        }
+        latencies.samples[op].push_back(now() - start);
+    }
+    for (const string &path : created)
+    {
+        co_await load.afs.deleteFile(path);
+    }
+}
+
+static double percentile(vector<double> &values, double p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    size_t k = getMin<size_t>(values.size() - 1, (size_t)(p * values.size()));
+    nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "Uso: " << argv[0] << " <caminho_do_disco> [clientes_max] [threads] [operacoes] [tamanho_do_bloco]" << endl;
+        return EXIT_FAILURE;
+    }
+    string diskPath = argv[1];
+    uint32_t maxClients = argc > 2 ? stoul(argv[2]) : 256;
+    uint32_t threads = argc > 3 ? stoul(argv[3]) : 2;
+    uint32_t totalOperations = argc > 4 ? stoul(argv[4]) : 20000;
+    u_int32_t blockSize = argc > 5 ? stoul(argv[5]) : 4096;
+    uint32_t files = 64;
+    uint32_t fileBytes = 4 << 20;
+    uint32_t ioBytes = 4096;
+
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    setvbuf(report, nullptr, _IOLBF, 0);
+    if (freopen("/dev/null", "w", stdout) == nullptr)
+    {
+        cerr << "Erro ao redirecionar o stdout" << endl;
+    }
+
+    bool ok = true;
+    try
+    {
+        uint64_t dataBlocks = (uint64_t)files * fileBytes / blockSize;
+        u_int32_t numBlocks = dataBlocks + dataBlocks / 16 + (uint64_t)maxClients * 1024 + 65536;
+        unique_ptr<FileSystem> fs = FileSystem::mkfs(diskPath, numBlocks, blockSize);
+        string dataDir = "dados";
+        string loadDir = "carga";
+        fs->createFile(dataDir, '2');
+        fs->createFile(loadDir, '2');
+        vector<u_int32_t> handles;
+        vector<char> chunk(1 << 20);
+        for (uint32_t f = 0; f < files; f++)
+        {
+            string name = "f" + to_string(f);
+            fs->createFile(name, '1', "/dados");
+            u_int32_t handle = fs->openFile("/dados/" + name);
+            for (uint64_t pos = 0; pos < fileBytes; pos += chunk.size())
+            {
+                fillExpected(f, pos, chunk.data(), chunk.size());
+                fs->writeFile(handle, pos, chunk.data(), chunk.size());
+            }
+            handles.push_back(handle);
+        }
+
+        fprintf(report, "Carga mista (60%% leituras de %u bytes, 15%% criações, 15%% escritas, 10%% remoções), %u threads, blocos de %u bytes\n",
+                ioBytes, threads, blockSize);
+        fprintf(report, "  %8s %10s   %-8s %10s %10s %10s\n", "clientes", "ops/s", "operação", "p50 (us)", "p99 (us)", "máx (us)");
+        for (uint32_t clients = 1; clients <= maxClients; clients *= 4)
+        {
+            // Descartar as páginas da imagem para que as leituras cheguem ao dispositivo
+            fs->sync();
+            int fd = ::open(diskPath.c_str(), O_RDONLY);
+            if (fd >= 0)
+            {
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                ::close(fd);
+            }
+
+            vector<Latencies> latencies(clients);
+            double elapsed;
+            {
+                Executor executor(fs->asyncIo(), threads);
+                AsyncFileSystem afs(*fs, executor);
+                Workload load{afs, handles, fileBytes, ioBytes};
+                double start = now();
+                for (uint32_t c = 0; c < clients; c++)
+                {
+                    executor.spawn(client(load, c, totalOperations / clients, latencies[c]));
+                }
+                executor.join();
+                elapsed = now() - start;
+                ok &= load.valid;
+            }
+
+            Latencies all;
+            uint64_t count = 0;
+            for (Latencies &l : latencies)
+            {
+                for (int op = 0; op < OPERATIONS; op++)
+                {
+                    all.samples[op].insert(all.samples[op].end(), l.samples[op].begin(), l.samples[op].end());
+                    count += l.samples[op].size();
+                }
+            }
+            for (int op = 0; op < OPERATIONS; op++)
+            {
+                vector<double> &values = all.samples[op];
+                double p50 = percentile(values, 0.50) * 1e6;
+                double p99 = percentile(values, 0.99) * 1e6;
+                double max = values.empty() ? 0 : *max_element(values.begin(), values.end()) * 1e6;
+                if (op == 0)
+                {
+                    fprintf(report, "  %8u %10.0f   ", clients, count / elapsed);
+                }
+                else
+                {
+                    fprintf(report, "  %8s %10s   ", "", "");
+                }
+                fprintf(report, "%-8s %10.1f %10.1f %10.1f\n", operationNames[op], p50, p99, max);
+            }
+        }
+
+        for (u_int32_t handle : handles)
+        {
+            fs->closeFile(handle);
+        }
+        fs.reset();
+        fs = FileSystem::mount(diskPath);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << endl;
+        ok = false;
+    }
+
+    fprintf(report, "%s\n", ok ? "Resultado: OK" : "Resultado: FALHA");
+    return ok ? 0 : EXIT_FAILURE;
+}
+
+/*
+    Compilar: g++ -o workload workload.cpp -std=c++20 -O2 -pthread
+    Executar: ./workload <caminho_do_disco> [clientes_max] [threads] [operacoes] [tamanho_do_bloco]
+*/